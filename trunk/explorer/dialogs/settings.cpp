@@ -170,9 +170,11 @@ int TaskbarSettingsDlg::Notify(int id, NMHDR* pnmh)
 	switch(pnmh->code) {
 	  case PSN_APPLY:
 		_cfg_org = g_Globals._cfg;
+		g_Globals.cfg_changed();
 		break;
 
 	  case PSN_RESET:
+		g_Globals._cfg_writer.wait_idle();
 		g_Globals._cfg = _cfg_org;
 		SendMessage(g_Globals._hwndDesktopBar, PM_REFRESH_CONFIG, 0, 0);
 		break;
@@ -259,6 +261,8 @@ int	MdiSdiDlg::Command(int id, int code)
 
 			XMLBoolRef(explorer_options, "mdi") = mdi;
 			XMLBoolRef(explorer_options, "separate-folders") = separateFolders;
+
+			g_Globals.cfg_changed();
 		  } // fall through
 
 		  case IDCANCEL:
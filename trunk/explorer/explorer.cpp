@@ -72,6 +72,8 @@ ExplorerGlobals::ExplorerGlobals()
 	_hwndDesktopBar = 0;
 	_hwndShellView = 0;
 	_hwndDesktop = 0;
+
+	_cfg_write_timer = 0;
 }
 
 
@@ -92,8 +94,10 @@ void ExplorerGlobals::read_persistent()
 	 // read configuration file
 	_cfg_dir.printf(TEXT("%s\\ReactOS"), (LPCTSTR)SpecialFolderFSPath(CSIDL_APPDATA,0));
 	_cfg_path.printf(TEXT("%s\\ros-explorer-cfg.xml"), _cfg_dir.c_str());
+	_cfg_cache_path.printf(TEXT("%s\\ros-explorer-cfg.xsb"), _cfg_dir.c_str());
 
-	if (!_cfg.read_file(_cfg_path)) {
+	 // use the binary snapshot while the XML file is unchanged
+	if (!_cfg.read_file_cached(_cfg_path, _cfg_cache_path)) {
 		if (!_cfg._errors.empty())
 			MessageBox(_hwndDesktop, _cfg._errors.str(),
 						TEXT("ROS Explorer - reading user settings"), MB_OK);
@@ -113,15 +117,182 @@ void ExplorerGlobals::read_persistent()
 void ExplorerGlobals::write_persistent()
 {
 	 // write configuration file
-	RecursiveCreateDirectory(_cfg_dir);
+	write_cfg(false);
 
-	_cfg.write_file(_cfg_path);
 	_favorites.write(_favorites_path);
 }
 
 
+static void CALLBACK CfgWriteTimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+	g_Globals.write_cfg(true);
+}
+
+ /// schedule writing the configuration file after CFG_WRITE_DELAY ms
+ // Each call restarts the delay, so a burst of changes results in a single write.
+void ExplorerGlobals::cfg_changed()
+{
+	_cfg_write_timer = SetTimer(0, _cfg_write_timer, CFG_WRITE_DELAY, CfgWriteTimerProc);
+}
+
+ /// write _cfg to the configuration file, serializing it in background if requested
+void ExplorerGlobals::write_cfg(bool background)
+{
+	if (_cfg_write_timer) {
+		KillTimer(0, _cfg_write_timer);
+		_cfg_write_timer = 0;
+	}
+
+	RecursiveCreateDirectory(_cfg_dir);
+
+	if (background)
+		_cfg_writer.write(_cfg_path, _cfg);
+	else
+		_cfg_writer.write_now(_cfg_path, _cfg);
+}
+
+
+ConfigWriterThread::ConfigWriterThread()
+ :	_doc(NULL)
+{
+	_evtWrite = CreateEvent(NULL, FALSE, FALSE, NULL);
+	_evtIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+}
+
+ConfigWriterThread::~ConfigWriterThread()
+{
+	Stop();
+
+	delete _doc;
+
+	CloseHandle(_evtWrite);
+	CloseHandle(_evtIdle);
+}
+
+ /// pass a snapshot of 'doc' to the thread, which is cheap as it shares the nodes of 'doc'
+void ConfigWriterThread::write(LPCTSTR path, const XMLDoc& doc)
+{
+	XMLDoc* snapshot = new XMLDoc(doc);
+
+	{
+	Lock lock(_crit_sect);
+
+	_path = path;
+	delete _doc;
+	_doc = snapshot;
+
+	ResetEvent(_evtIdle);
+	}
+
+	Start();
+	SetEvent(_evtWrite);
+}
+
+ /// write 'doc' synchronously, superseding a pending snapshot
+void ConfigWriterThread::write_now(LPCTSTR path, const XMLDoc& doc)
+{
+	 // wait for a running background write
+	Stop();
+
+	std::string data;
+	serialize(data, doc);
+
+	write_file(path, data);
+}
+
+ /// wait until the thread doesn't read the nodes of the last snapshot any more
+void ConfigWriterThread::wait_idle()
+{
+	WaitForSingleObject(_evtIdle, INFINITE);
+}
+
+ /// only the modified parts of the document are encoded again
+void ConfigWriterThread::serialize(std::string& data, const XMLDoc& doc)
+{
+	std::ostringstream out;
+
+	doc.write(out, _write_cache);
+
+	data = out.str();
+}
+
+int ConfigWriterThread::Run()
+{
+	HANDLE events[] = {_evtFinish, _evtWrite};
+
+	while(WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0+1) {
+		String path;
+		XMLDoc* doc;
+
+		{
+		Lock lock(_crit_sect);
+
+		path = _path;
+		doc = _doc;
+		_doc = NULL;
+		}
+
+		if (!doc)
+			continue;
+
+		std::string data;
+		serialize(data, *doc);
+
+		 // stop sharing the nodes before the document may change again
+		delete doc;
+
+		{
+		Lock lock(_crit_sect);
+
+		if (!_doc)
+			SetEvent(_evtIdle);
+		}
+
+		write_file(path, data);
+	}
+
+	 // a pending snapshot is dropped when stopping
+	Lock lock(_crit_sect);
+
+	delete _doc;
+	_doc = NULL;
+
+	SetEvent(_evtIdle);
+
+	return 0;
+}
+
+ /// write to a temporary file first, so that an interrupted write does not destroy the old file
+bool ConfigWriterThread::write_file(LPCTSTR path, const std::string& data)
+{
+	String tmp_path;
+	tmp_path.printf(TEXT("%s.tmp"), path);
+
+	{
+		tofstream out(tmp_path);
+
+		out.write(data.data(), data.length());
+		out.flush();
+
+		if (!out.good())
+			return false;
+	}
+
+	if (!MoveFileEx(tmp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+		 // MoveFileEx() is not available on Win9x
+		DeleteFile(path);
+
+		return MoveFile(tmp_path, path)!=FALSE;
+	}
+
+	return true;
+}
+
+
 XMLPos ExplorerGlobals::get_cfg()
 {
+	_cfg_writer.wait_idle();
+
 	XMLPos cfg_pos(&_cfg);
 
 	cfg_pos.smart_create("explorer-cfg");
@@ -131,10 +302,12 @@ XMLPos ExplorerGlobals::get_cfg()
 
 XMLPos ExplorerGlobals::get_cfg(const char* path)
 {
+	_cfg_writer.wait_idle();
+
 	XMLPos cfg_pos(&_cfg);
 
 	cfg_pos.smart_create("explorer-cfg");
-	cfg_pos.create_relative(path);
+	cfg_pos.create_relative(_cfg_paths.get(path));
 
 	return cfg_pos;
 }
@@ -222,17 +395,16 @@ LPCTSTR FileTypeManager::set_type(Entry* entry, bool dont_hide_ext)
 		const FileTypeInfo& type = (*this)[ext];
 
 		if (!type._displayname.empty())
-			entry->_type_name = _tcsdup(type._displayname);
+			entry->_type_name = entry->dup_string(type._displayname);
 
 		 // hide some file extensions
 		if (type._neverShowExt && !dont_hide_ext) {
 			int len = ext - entry->_data.cFileName;
 
 			if (entry->_display_name != entry->_data.cFileName)
-				free(entry->_display_name);
+				entry->free_string(entry->_display_name);
 
-			entry->_display_name = (LPTSTR) malloc((len+1)*sizeof(TCHAR));
-			lstrcpyn(entry->_display_name, entry->_data.cFileName, len + 1);
+			entry->_display_name = entry->dup_string(entry->_data.cFileName, len);
 		}
 
 		if (is_exe_file(ext))
@@ -254,6 +254,36 @@ struct Desktops : public vector<DesktopRef>
 };
 
 
+#define	CFG_WRITE_DELAY	2000	// ms to wait for further changes before writing the configuration file
+
+ /// Thread for serializing and writing the configuration file in background
+ // The thread writes a snapshot sharing the nodes of the document. A snapshot passed while
+ // a write is still pending replaces the older one. The document must not be changed before
+ // wait_idle() returns, as the thread reads the shared nodes.
+struct ConfigWriterThread : public Thread
+{
+	ConfigWriterThread();
+	~ConfigWriterThread();
+
+	void	write(LPCTSTR path, const XMLDoc& doc);
+	void	write_now(LPCTSTR path, const XMLDoc& doc);
+	void	wait_idle();
+
+	int		Run();
+
+	static bool write_file(LPCTSTR path, const std::string& data);
+
+protected:
+	HANDLE		_evtWrite;
+	HANDLE		_evtIdle;	// reset while a snapshot is pending or being serialized
+	String		_path;	// protected by _crit_sect
+	XMLDoc*		_doc;	// pending snapshot, protected by _crit_sect
+	XMLWriteCache _write_cache;	// serialized subtrees of the last write, used by one thread at a time
+
+	void	serialize(std::string& data, const XMLDoc& doc);
+};
+
+
  /// structure containing global variables of Explorer
 extern struct ExplorerGlobals
 {
@@ -264,6 +294,9 @@ extern struct ExplorerGlobals
 	void	read_persistent();
 	void	write_persistent();
 
+	void	cfg_changed();
+	void	write_cfg(bool background);
+
 	XMLPos	get_cfg();
 	XMLPos	get_cfg(const char* path);
 
@@ -293,8 +326,12 @@ extern struct ExplorerGlobals
 	Desktops	_desktops;
 
 	XMLDoc		_cfg;
+	XPathCache	_cfg_paths;	// parsed paths of get_cfg()
 	String		_cfg_dir;
 	String		_cfg_path;
+	String		_cfg_cache_path;	// binary snapshot of _cfg_path
+	ConfigWriterThread _cfg_writer;
+	UINT_PTR	_cfg_write_timer;
 
 	Favorites	_favorites;
 	String		_favorites_path;
@@ -40,9 +40,13 @@ Entry::Entry(ENTRY_TYPE etype)
 	_down = NULL;
 	_expanded = false;
 	_scanned = false;
-	_bhfi_valid = false;
+	_cleanup = false;
+	_bhfi = NULL;
+	_arena = NULL;
 	_level = 0;
 	_icon_id = ICID_UNKNOWN;
+	_heap_name = false;
+	_data.clear();
 	_display_name = _data.cFileName;
 	_type_name = NULL;
 	_content = NULL;
@@ -56,10 +60,14 @@ Entry::Entry(Entry* parent, ENTRY_TYPE etype)
 	_down = NULL;
 	_expanded = false;
 	_scanned = false;
-	_bhfi_valid = false;
+	_cleanup = false;
+	_bhfi = NULL;
+	_arena = NULL;
 	_level = 0;
 	_icon_id = ICID_UNKNOWN;
 	_shell_attribs = 0;
+	_heap_name = false;
+	_data.clear();
 	_display_name = _data.cFileName;
 	_type_name = NULL;
 	_content = NULL;
@@ -77,20 +85,25 @@ Entry::Entry(const Entry& other)
 
 	_expanded = other._expanded;
 	_scanned = other._scanned;
+	_cleanup = false;
 	_level = other._level;
 
 	_data = other._data;
 
 	_shell_attribs = other._shell_attribs;
 	_display_name = other._display_name==other._data.cFileName? _data.cFileName: _tcsdup(other._display_name);
+	_arena = NULL;
+
+	_heap_name = false;
+	set_names(other._data.cFileName, other._data.cAlternateFileName);	// The copy has no parent, so we can't share the pooled names.
+
 	_type_name = other._type_name? _tcsdup(other._type_name): NULL;
 	_content = other._content? _tcsdup(other._content): NULL;
 
 	_etype = other._etype;
 	_icon_id = other._icon_id;
 
-	_bhfi = other._bhfi;
-	_bhfi_valid = other._bhfi_valid;
+	_bhfi = other._bhfi? new BY_HANDLE_FILE_INFORMATION(*other._bhfi): NULL;
 }
 
  // free a directory entry
@@ -100,16 +113,314 @@ Entry::~Entry()
 		g_Globals._icon_cache.free_icon(_icon_id);
 
 	if (_display_name != _data.cFileName)
-		free(_display_name);
+		free_string(_display_name);
 
 	if (_type_name)
-		free(_type_name);
+		free_string(_type_name);
 
 	if (_content)
-		free(_content);
+		free_string(_content);
+
+	free_subentries();
+	delete _arena;
+
+	if (!_up)
+		delete _bhfi;
+
+	free_names();
+}
+
+
+ // store the file data as returned by FindFirstFile()/FindNextFile()
+void Entry::set_find_data(const WIN32_FIND_DATA& w32fd)
+{
+	_data.dwFileAttributes = w32fd.dwFileAttributes;
+	_data.nFileSizeHigh = w32fd.nFileSizeHigh;
+	_data.nFileSizeLow = w32fd.nFileSizeLow;
+	_data.ftCreationTime = w32fd.ftCreationTime;
+	_data.ftLastAccessTime = w32fd.ftLastAccessTime;
+	_data.ftLastWriteTime = w32fd.ftLastWriteTime;
+
+	set_names(w32fd.cFileName, w32fd.cAlternateFileName);
+}
+
+ // build the WIN32_FIND_DATA block on demand
+void Entry::get_find_data(WIN32_FIND_DATA& w32fd) const
+{
+	memset(&w32fd, 0, sizeof(WIN32_FIND_DATA));
+
+	w32fd.dwFileAttributes = _data.dwFileAttributes;
+	w32fd.nFileSizeHigh = _data.nFileSizeHigh;
+	w32fd.nFileSizeLow = _data.nFileSizeLow;
+	w32fd.ftCreationTime = _data.ftCreationTime;
+	w32fd.ftLastAccessTime = _data.ftLastAccessTime;
+	w32fd.ftLastWriteTime = _data.ftLastWriteTime;
+
+	lstrcpyn(w32fd.cFileName, _data.cFileName, COUNTOF(w32fd.cFileName));
+	lstrcpyn(w32fd.cAlternateFileName, _data.cAlternateFileName, COUNTOF(w32fd.cAlternateFileName));
+}
+
+void Entry::copy_data(const Entry& other)
+{
+	LPTSTR name = _data.cFileName;
+	bool heap_name = _heap_name;
+
+	_data = other._data;
+
+	 // restore the own name before replacing it by a copy of the other one
+	_data.cFileName = name;
+	_heap_name = heap_name;
+
+	set_names(other._data.cFileName, other._data.cAlternateFileName);
+}
+
+void Entry::clear_data()
+{
+	LPTSTR name = _data.cFileName;
+
+	free_names();
+	_data.clear();
+
+	if (_display_name == name)
+		_display_name = _data.cFileName;
+}
+
+ // replace the file name, keeping the alternate name
+void Entry::set_name(LPCTSTR name)
+{
+	set_names(name, _data.cAlternateFileName);
+}
+
+ // store both names in the parent's arena, on the heap for entries without parent
+void Entry::set_names(LPCTSTR name, LPCTSTR alt_name)
+{
+	LPTSTR old_name = _data.cFileName;
+	LPTSTR str;
+
+	if (_up) {
+		str = _up->arena().add_names(name, alt_name);
+	} else {
+		size_t l = _tcslen(name) + 1;
+		size_t la = _tcslen(alt_name) + 1;
+
+		str = (LPTSTR) malloc((l+la)*sizeof(TCHAR));
+		memcpy(str, name, l*sizeof(TCHAR));
+		memcpy(str+l, alt_name, la*sizeof(TCHAR));
+	}
+
+	free_names();
+
+	_data.cFileName = str;
+	_data.cAlternateFileName = str + _tcslen(str) + 1;
+	_heap_name = !_up;
+
+	if (_display_name == old_name)
+		_display_name = str;
+}
+
+void Entry::free_names()
+{
+	if (_heap_name) {
+		free(_data.cFileName);
+		_heap_name = false;
+	}
+}
+
+void Entry::set_bhfi(const BY_HANDLE_FILE_INFORMATION& bhfi)
+{
+	if (!_bhfi)
+		if (_up)
+			_bhfi = (BY_HANDLE_FILE_INFORMATION*) _up->arena().alloc(sizeof(BY_HANDLE_FILE_INFORMATION));
+		else
+			_bhfi = new BY_HANDLE_FILE_INFORMATION;
+
+	*_bhfi = bhfi;
+}
+
+ // allocate a string buffer for len characters, in the parent's arena for sub-entries
+LPTSTR Entry::alloc_string(size_t len)
+{
+	size_t size = (len+1) * sizeof(TCHAR);
+
+	if (_up)
+		return (LPTSTR) _up->arena().alloc(size, sizeof(TCHAR));
+	else
+		return (LPTSTR) malloc(size);
+}
+
+LPTSTR Entry::dup_string(LPCTSTR str, int len)
+{
+	if (len < 0)
+		len = _tcslen(str);
+
+	LPTSTR s = alloc_string(len);
+
+	memcpy(s, str, len*sizeof(TCHAR));
+	s[len] = TEXT('\0');
+
+	return s;
+}
+
+ // free a string from alloc_string() - arena strings are released with the arena
+void Entry::free_string(LPTSTR str)
+{
+	if (!_up)
+		free(str);
+}
+
+ // register the entry to be destroyed by free_subentries() of its parent
+void Entry::need_cleanup()
+{
+	if (_up && !_cleanup) {
+		_up->arena().add_cleanup(this);
+		_cleanup = true;
+	}
+}
+
+
+EntryArena& Entry::arena()
+{
+	if (!_arena) {
+		_arena = new EntryArena;
+
+		need_cleanup();	// the sub-entries have to be released together with this entry
+	}
 
-	if (_down)
-		delete _down;
+	return *_arena;
+}
+
+
+static TCHAR s_empty_names[2] = {TEXT('\0'), TEXT('\0')};
+
+void EntryData::clear()
+{
+	memset(this, 0, sizeof(EntryData));
+
+	cFileName = s_empty_names;
+	cAlternateFileName = s_empty_names + 1;
+}
+
+ // store name and alternate name one after the other
+LPTSTR EntryArena::add_names(LPCTSTR name, LPCTSTR alt_name)
+{
+	++_gen;	// a renamed sub-entry invalidates the name index and the sort orders
+
+	size_t l = _tcslen(name) + 1;
+	size_t la = _tcslen(alt_name) + 1;
+
+	LPTSTR str = (LPTSTR) alloc((l+la)*sizeof(TCHAR), sizeof(TCHAR));
+
+	memcpy(str, name, l*sizeof(TCHAR));
+	memcpy(str+l, alt_name, la*sizeof(TCHAR));
+
+	return str;
+}
+
+
+#define	ENTRY_SLAB_SIZE	0x10000	// 64 KB per slab, enough for some hundred entries
+
+ // statistics of all arenas for EntryArena::dump_stats()
+ // The byte and total counters can exceed 32 bits in long sessions, so they are guarded by a lock instead of Interlocked...().
+static CritSect s_arena_stats_lock;
+static size_t s_arena_slabs = 0;
+static ULONGLONG s_arena_slab_bytes = 0;
+static ULONGLONG s_arena_total_slabs = 0;
+static ULONGLONG s_arena_total_allocs = 0;
+
+void* EntryArena::alloc(size_t size, size_t align)
+{
+	size_t pos = (_used+align-1) & ~(align-1);
+
+	if (!_slab || pos+size>_size) {
+		size_t slab_size = size>ENTRY_SLAB_SIZE? size: ENTRY_SLAB_SIZE;
+
+		Slab* slab = (Slab*) malloc(sizeof(Slab) + slab_size);
+
+		if (!slab)
+			throw std::bad_alloc();
+
+		slab->_next = _slab;
+		slab->_size = slab_size;
+
+		_slab = slab;
+		_size = slab_size;
+		pos = 0;
+		++_slabs;
+
+		Lock lock(s_arena_stats_lock);
+
+		++s_arena_slabs;
+		++s_arena_total_slabs;
+		s_arena_slab_bytes += slab_size;
+	}
+
+	_used = pos + size;
+	++_allocs;
+	_bytes += size;
+
+	return (LPBYTE)(_slab+1) + pos;
+}
+
+void EntryArena::add_cleanup(Entry* entry)
+{
+	Cleanup* cleanup = (Cleanup*) alloc(sizeof(Cleanup));
+
+	cleanup->_next = _cleanup;
+	cleanup->_entry = entry;
+
+	_cleanup = cleanup;
+}
+
+ // free all slabs at once - the registered objects have to be destroyed before
+void EntryArena::clear()
+{
+	size_t slab_bytes = 0;
+
+	while(_slab) {
+		Slab* next = _slab->_next;
+
+		slab_bytes += _slab->_size;
+
+		free(_slab);
+		_slab = next;
+	}
+
+	{
+		Lock lock(s_arena_stats_lock);
+
+		s_arena_slabs -= _slabs;
+		s_arena_slab_bytes -= slab_bytes;
+		s_arena_total_allocs += _allocs;
+	}
+
+	_cleanup = NULL;
+
+	++_gen;	// the cached sort orders and the name index refer to the released sub-entries
+
+	_used = 0;
+	_size = 0;
+	_slabs = 0;
+	_allocs = 0;
+	_bytes = 0;
+}
+
+void EntryArena::free_caches()
+{
+	for(int i=0; i<=SORT_DATE; ++i)
+		free(_sorted[i]._entries);
+
+	free(_index._slots);
+
+	memset(_sorted, 0, sizeof(_sorted));
+	memset(&_index, 0, sizeof(_index));
+}
+
+void EntryArena::dump_stats()
+{
+	Lock lock(s_arena_stats_lock);
+
+	LOG(FmtString(TEXT("EntryArena: %") LONGLONGARG TEXT("u slabs with %") LONGLONGARG TEXT("u KB in use, %") LONGLONGARG TEXT("u slabs and %") LONGLONGARG TEXT("u allocations released"),
+					(ULONGLONG)s_arena_slabs, s_arena_slab_bytes/1024, s_arena_total_slabs-s_arena_slabs, s_arena_total_allocs));
 }
 
 
@@ -170,6 +481,10 @@ Root::~Root()
 		_entry->free_subentries();
 		delete _entry;
 	}
+
+#ifdef _DEBUG
+	EntryArena::dump_stats();
+#endif
 }
 
 
@@ -197,154 +512,407 @@ static TYPE_ORDER TypeOrderFromDirname(LPCTSTR name)
 	return TO_OTHER_DIR;		// any other directory
 }
 
- // directories first...
-static int compareType(const Entry* entry1, const Entry* entry2)
+ // type order of an entry: directories first...
+static TYPE_ORDER TypeOrderFromEntry(const Entry* entry)
 {
-	const WIN32_FIND_DATA* fd1 = &entry1->_data;
-	const WIN32_FIND_DATA* fd2 = &entry2->_data;
+	if (!(entry->_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		return TO_FILE;
 
-	TYPE_ORDER order1 = fd1->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY? TO_DIR: TO_FILE;
-	TYPE_ORDER order2 = fd2->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY? TO_DIR: TO_FILE;
+	 // Move virtual folders after physical folders
+	if (!(entry->_shell_attribs & SFGAO_FILESYSTEM))
+		return TO_VIRTUAL_FOLDER;
 
 	 // Handle "." and ".." as special case and move them at the very first beginning.
-	if (order1==TO_DIR && order2==TO_DIR) {
-		order1 = TypeOrderFromDirname(fd1->cFileName);
-		order2 = TypeOrderFromDirname(fd2->cFileName);
+	return TypeOrderFromDirname(entry->_data.cFileName);
+}
+
+
+ /// sort key of an entry, computed once per sort_directory() call
+struct EntrySortKey
+{
+	Entry*		_entry;
+	int			_type;	// TYPE_ORDER
+	const char*	_name;	// collation key of the file name
+	const char*	_ext;	// collation key of the file extension
+	ULONGLONG	_size;
+	ULONGLONG	_time;
+};
+
+ // Compute a collation key, which compares by strcmp() like the string itself by lstrcmpi().
+static const char* make_collation_key(LPCTSTR str, EntryArena& memory)
+{
+	BYTE buffer[512];
 
-		 // Move virtual folders after physical folders
-		if (!(entry1->_shell_attribs & SFGAO_FILESYSTEM))
-			order1 = TO_VIRTUAL_FOLDER;
+	int len = LCMapString(LOCALE_USER_DEFAULT, LCMAP_SORTKEY|NORM_IGNORECASE, str, -1, (LPTSTR)buffer, sizeof(buffer));
 
-		if (!(entry2->_shell_attribs & SFGAO_FILESYSTEM))
-			order2 = TO_VIRTUAL_FOLDER;
+	if (len) {
+		char* key = (char*) memory.alloc(len, 1);
+		memcpy(key, buffer, len);
+		return key;
 	}
 
-	return order2==order1? 0: order1<order2? -1: 1;
+	 // very long name: query the needed key size
+	len = LCMapString(LOCALE_USER_DEFAULT, LCMAP_SORTKEY|NORM_IGNORECASE, str, -1, NULL, 0);
+
+	char* key = (char*) memory.alloc(len>0? len: 1, 1);
+
+	if (len<=0 || !LCMapString(LOCALE_USER_DEFAULT, LCMAP_SORTKEY|NORM_IGNORECASE, str, -1, (LPTSTR)key, len))
+		*key = '\0';
+
+	return key;
+}
+
+static void make_sort_keys(EntrySortKey* keys, size_t count, SORT_ORDER sortOrder, EntryArena& memory)
+{
+	for(EntrySortKey*key=keys; key<keys+count; ++key) {
+		const EntryData& data = key->_entry->_data;
+
+		key->_type = TypeOrderFromEntry(key->_entry);
+
+		switch(sortOrder) {
+		  case SORT_EXT: {
+			LPCTSTR ext = _tcsrchr(data.cFileName, TEXT('.'));
+
+			key->_ext = make_collation_key(ext? ext+1: TEXT(""), memory);
+			key->_name = make_collation_key(data.cFileName, memory);
+			break;}
+
+		  case SORT_SIZE:
+			key->_size = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+			break;
+
+		  case SORT_DATE:
+			key->_time = ((ULONGLONG)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+			break;
+
+		  default:
+			key->_name = make_collation_key(data.cFileName, memory);
+		}
+	}
 }
 
 
-static int compareNothing(const void* arg1, const void* arg2)
+ // comparison functors for the different sort orders
+
+struct LessName {
+	bool operator()(const EntrySortKey& a, const EntrySortKey& b) const
+	{
+		if (a._type != b._type)
+			return a._type < b._type;
+
+		return strcmp(a._name, b._name) < 0;
+	}
+};
+
+struct LessExt {
+	bool operator()(const EntrySortKey& a, const EntrySortKey& b) const
+	{
+		if (a._type != b._type)
+			return a._type < b._type;
+
+		int cmp = strcmp(a._ext, b._ext);
+		if (cmp)
+			return cmp < 0;
+
+		return strcmp(a._name, b._name) < 0;
+	}
+};
+
+ // biggest files first
+struct LessSize {
+	bool operator()(const EntrySortKey& a, const EntrySortKey& b) const
+	{
+		if (a._type != b._type)
+			return a._type < b._type;
+
+		return a._size > b._size;
+	}
+};
+
+ // newest files first
+struct LessDate {
+	bool operator()(const EntrySortKey& a, const EntrySortKey& b) const
+	{
+		if (a._type != b._type)
+			return a._type < b._type;
+
+		return a._time > b._time;
+	}
+};
+
+
+ // stable merge sort of the key arrays
+
+#define	INSERTION_SORT_MAX	16
+
+template<typename LESS> static void insertion_sort(EntrySortKey* keys, size_t count, LESS less)
 {
-	return -1;
+	for(size_t i=1; i<count; ++i) {
+		EntrySortKey key = keys[i];
+		size_t j = i;
+
+		for(; j>0 && less(key, keys[j-1]); --j)
+			keys[j] = keys[j-1];
+
+		keys[j] = key;
+	}
 }
 
-static int compareName(const void* arg1, const void* arg2)
+template<typename LESS> static void merge_runs(const EntrySortKey* a, size_t na, const EntrySortKey* b, size_t nb, EntrySortKey* out, LESS less)
 {
-	const Entry* entry1 = *(const Entry**)arg1;
-	const Entry* entry2 = *(const Entry**)arg2;
+	const EntrySortKey* a_end = a + na;
+	const EntrySortKey* b_end = b + nb;
+
+	while(a<a_end && b<b_end)
+		if (less(*b, *a))
+			*out++ = *b++;
+		else
+			*out++ = *a++;
 
-	int cmp = compareType(entry1, entry2);
-	if (cmp)
-		return cmp;
+	while(a < a_end)
+		*out++ = *a++;
 
-	return lstrcmpi(entry1->_data.cFileName, entry2->_data.cFileName);
+	while(b < b_end)
+		*out++ = *b++;
 }
 
-static int compareExt(const void* arg1, const void* arg2)
+template<typename LESS> static void merge_sort_to(EntrySortKey* src, EntrySortKey* dst, size_t count, LESS less);
+
+ // sort keys in place, using tmp as buffer of the same size
+template<typename LESS> static void merge_sort(EntrySortKey* keys, EntrySortKey* tmp, size_t count, LESS less)
 {
-	const Entry* entry1 = *(const Entry**)arg1;
-	const Entry* entry2 = *(const Entry**)arg2;
-	const TCHAR *name1, *name2, *ext1, *ext2;
+	if (count <= INSERTION_SORT_MAX) {
+		insertion_sort(keys, count, less);
+		return;
+	}
 
-	int cmp = compareType(entry1, entry2);
-	if (cmp)
-		return cmp;
+	size_t half = count / 2;
 
-	name1 = entry1->_data.cFileName;
-	name2 = entry2->_data.cFileName;
+	merge_sort_to(keys, tmp, half, less);
+	merge_sort_to(keys+half, tmp+half, count-half, less);
 
-	ext1 = _tcsrchr(name1, TEXT('.'));
-	ext2 = _tcsrchr(name2, TEXT('.'));
+	merge_runs(tmp, half, tmp+half, count-half, keys, less);
+}
 
-	if (ext1)
-		++ext1;
-	else
-		ext1 = TEXT("");
+ // sort src into dst, using src as buffer
+template<typename LESS> static void merge_sort_to(EntrySortKey* src, EntrySortKey* dst, size_t count, LESS less)
+{
+	if (count <= INSERTION_SORT_MAX) {
+		memcpy(dst, src, count*sizeof(EntrySortKey));
+		insertion_sort(dst, count, less);
+		return;
+	}
 
-	if (ext2)
-		++ext2;
-	else
-		ext2 = TEXT("");
+	size_t half = count / 2;
 
-	cmp = lstrcmpi(ext1, ext2);
-	if (cmp)
-		return cmp;
+	merge_sort(src, dst, half, less);
+	merge_sort(src+half, dst+half, count-half, less);
 
-	return lstrcmpi(name1, name2);
+	merge_runs(src, half, src+half, count-half, dst, less);
 }
 
-static int compareSize(const void* arg1, const void* arg2)
+ // merge the sorted runs [bounds[i], bounds[i+1]) pairwise until there is only one left
+ // return keys or tmp, whichever holds the result
+template<typename LESS> static EntrySortKey* merge_all_runs(EntrySortKey* keys, EntrySortKey* tmp, size_t* bounds, int runs, LESS less)
 {
-	const Entry* entry1 = *(const Entry**)arg1;
-	const Entry* entry2 = *(const Entry**)arg2;
+	EntrySortKey* src = keys;
+	EntrySortKey* dst = tmp;
 
-	int cmp = compareType(entry1, entry2);
-	if (cmp)
-		return cmp;
+	while(runs > 1) {
+		int n = 0;
 
-	cmp = entry2->_data.nFileSizeHigh - entry1->_data.nFileSizeHigh;
+		for(int i=0; i<runs; i+=2) {
+			if (i+1 < runs)
+				merge_runs(src+bounds[i], bounds[i+1]-bounds[i], src+bounds[i+1], bounds[i+2]-bounds[i+1], dst+bounds[i], less);
+			else
+				memcpy(dst+bounds[i], src+bounds[i], (bounds[i+1]-bounds[i])*sizeof(EntrySortKey));
 
-	if (cmp < 0)
-		return -1;
-	else if (cmp > 0)
-		return 1;
+			bounds[n++] = bounds[i];
+		}
 
-	cmp = entry2->_data.nFileSizeLow - entry1->_data.nFileSizeLow;
+		bounds[n] = bounds[runs];
+		runs = n;
 
-	return cmp<0? -1: cmp>0? 1: 0;
+		EntrySortKey* t = src;
+		src = dst;
+		dst = t;
+	}
+
+	return src;
 }
 
-static int compareDate(const void* arg1, const void* arg2)
+static void sort_keys(EntrySortKey* keys, EntrySortKey* tmp, size_t count, SORT_ORDER sortOrder)
 {
-	const Entry* entry1 = *(const Entry**)arg1;
-	const Entry* entry2 = *(const Entry**)arg2;
-
-	int cmp = compareType(entry1, entry2);
-	if (cmp)
-		return cmp;
+	switch(sortOrder) {
+	  case SORT_EXT:	merge_sort(keys, tmp, count, LessExt());	break;
+	  case SORT_SIZE:	merge_sort(keys, tmp, count, LessSize());	break;
+	  case SORT_DATE:	merge_sort(keys, tmp, count, LessDate());	break;
+	  default:			merge_sort(keys, tmp, count, LessName());
+	}
+}
 
-	return CompareFileTime(&entry2->_data.ftLastWriteTime, &entry1->_data.ftLastWriteTime);
+static EntrySortKey* merge_key_runs(EntrySortKey* keys, EntrySortKey* tmp, size_t* bounds, int runs, SORT_ORDER sortOrder)
+{
+	switch(sortOrder) {
+	  case SORT_EXT:	return merge_all_runs(keys, tmp, bounds, runs, LessExt());
+	  case SORT_SIZE:	return merge_all_runs(keys, tmp, bounds, runs, LessSize());
+	  case SORT_DATE:	return merge_all_runs(keys, tmp, bounds, runs, LessDate());
+	  default:			return merge_all_runs(keys, tmp, bounds, runs, LessName());
+	}
 }
 
 
-static int (*sortFunctions[])(const void* arg1, const void* arg2) = {
-	compareNothing,	// SORT_NONE
-	compareName,	// SORT_NAME
-	compareExt, 	// SORT_EXT
-	compareSize,	// SORT_SIZE
-	compareDate 	// SORT_DATE
+ /// thread computing the keys of and sorting one part of a directory
+struct SortThread : public Thread
+{
+	SortThread(EntrySortKey* keys, EntrySortKey* tmp, size_t count, SORT_ORDER sortOrder)
+	 :	_keys(keys),
+		_tmp(tmp),
+		_count(count),
+		_sort_order(sortOrder)
+	{
+	}
+
+	int Run()
+	{
+		make_sort_keys(_keys, _count, _sort_order, _key_memory);
+		sort_keys(_keys, _tmp, _count, _sort_order);
+
+		return 0;
+	}
+
+protected:
+	EntrySortKey* _keys;
+	EntrySortKey* _tmp;
+	size_t	_count;
+	SORT_ORDER _sort_order;
+
+	EntryArena _key_memory;	// collation keys, released with the thread object
 };
 
+#define	SORT_PARALLEL_THRESHOLD	0x4000	// minimum number of entries to sort in multiple threads
+#define	SORT_MAX_THREADS		16
+
+static int get_sort_thread_count()
+{
+	static int s_processors = 0;
+
+	if (!s_processors) {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+
+		s_processors = info.dwNumberOfProcessors>SORT_MAX_THREADS? SORT_MAX_THREADS: (int)info.dwNumberOfProcessors;
+	}
+
+	return s_processors;
+}
+
 
 void Entry::sort_directory(SORT_ORDER sortOrder)
 {
-	if (sortOrder != SORT_NONE) {
-		Entry* entry = _down;
-		Entry** array, **p;
-		int len;
+	if (sortOrder == SORT_NONE)
+		return;
+
+	Entry* entry;
+	size_t len = 0;
+
+	for(entry=_down; entry; entry=entry->_next)
+		++len;
 
-		len = 0;
-		for(entry=_down; entry; entry=entry->_next)
-			++len;
+	if (len <= 1)
+		return;
 
-		if (len) {
-			array = (Entry**) alloca(len*sizeof(Entry*));
+	 // Just relink the entries if they have already been sorted this way since the last change of the list.
+	if (_arena) {
+		EntryArena::SortCache& cache = _arena->_sorted[sortOrder];
 
-			p = array;
-			for(entry=_down; entry; entry=entry->_next)
-				*p++ = entry;
+		if (cache._gen==_arena->_gen && cache._count==len) {
+			link_sorted(cache._entries, len);
+			return;
+		}
+	}
+
+	 // keys and merge buffer on the heap - huge directories would overflow the stack
+	EntrySortKey* keys = (EntrySortKey*) malloc(2*len*sizeof(EntrySortKey));
+
+	if (!keys)
+		return;
+
+	EntrySortKey* tmp = keys + len;
+	EntrySortKey* p = keys;
+
+	for(entry=_down; entry; entry=entry->_next)
+		(p++)->_entry = entry;
+
+	int threads = len>=SORT_PARALLEL_THRESHOLD? get_sort_thread_count(): 1;
+
+	if (threads > 1) {
+		SortThread* workers[SORT_MAX_THREADS];
+		size_t bounds[SORT_MAX_THREADS+1];
+
+		for(int i=0; i<=threads; ++i)
+			bounds[i] = len * i / threads;
+
+		for(int i=0; i<threads; ++i)
+			workers[i] = new SortThread(keys+bounds[i], tmp+bounds[i], bounds[i+1]-bounds[i], sortOrder);
 
-			 // call qsort with the appropriate compare function
-			qsort(array, len, sizeof(array[0]), sortFunctions[sortOrder]);
+		 // start the workers and sort the last part in this thread
+		for(int i=0; i<threads-1; ++i)
+			workers[i]->Start();
 
-			_down = array[0];
+		workers[threads-1]->Run();
 
-			for(p=array; --len; p++)
-				(*p)->_next = p[1];
+		for(int i=0; i<threads-1; ++i)
+			workers[i]->Stop();	// wait for the worker to finish
 
-			(*p)->_next = 0;
+		p = merge_key_runs(keys, tmp, bounds, threads, sortOrder);
+
+		for(int i=0; i<threads; ++i)
+			delete workers[i];
+	} else {
+		EntryArena key_memory;
+
+		make_sort_keys(keys, len, sortOrder, key_memory);
+		sort_keys(keys, tmp, len, sortOrder);
+
+		p = keys;
+	}
+
+	 // cache the sort order until the sub-entries change, reusing the array of the previous sort
+	EntryArena::SortCache& cache = arena()._sorted[sortOrder];
+
+	if (cache._capacity < len) {
+		Entry** entries = (Entry**) realloc(cache._entries, len*sizeof(Entry*));
+
+		if (!entries) {
+			free(keys);
+			throw std::bad_alloc();
 		}
+
+		cache._entries = entries;
+		cache._capacity = len;
 	}
+
+	for(size_t i=0; i<len; ++i)
+		cache._entries[i] = p[i]._entry;
+
+	cache._count = len;
+	cache._gen = _arena->_gen;
+
+	free(keys);
+
+	link_sorted(cache._entries, len);
+}
+
+ // relink the sub-entries in the given order
+void Entry::link_sorted(Entry** entries, size_t count)
+{
+	_down = entries[0];
+
+	for(size_t i=1; i<count; ++i)
+		entries[i-1]->_next = entries[i];
+
+	entries[count-1]->_next = NULL;
 }
 
 
@@ -423,6 +991,9 @@ int Entry::extract_icon(ICONCACHE_FLAGS flags)
 		}
 	}
 
+	if (icon_id > ICID_NONE)
+		need_cleanup();	// The destructor frees the icon.
+
 	return icon_id;
 }
 
@@ -740,19 +1311,119 @@ bool Entry::get_path_base ( PTSTR path, size_t path_count, ENTRY_TYPE etype ) co
  // recursively free all child entries
 void Entry::free_subentries()
 {
-	Entry *entry, *next=_down;
+	_down = 0;
+
+	if (_arena) {
+		 // Only entries registered by need_cleanup() have to be destroyed, the memory belongs to our arena.
+		for(EntryArena::Cleanup* cleanup=_arena->_cleanup; cleanup; cleanup=cleanup->_next)
+			cleanup->_entry->~Entry();	// The destructor frees the sub-entries of the entry.
+
+		_arena->clear();
+	}
+}
+
+
+
+static inline TCHAR fold_char(TCHAR c, int find_flags)
+{
+	return find_flags&FIND_IGNORE_CASE? (TCHAR)_totlower(c): c;
+}
+
+static size_t hash_name(LPCTSTR name, size_t len, int find_flags)
+{
+	size_t hash = 2166136261U;	// FNV-1a
+
+	for(size_t i=0; i<len; ++i)
+		hash = (hash ^ (size_t)fold_char(name[i], find_flags)) * 16777619U;
+
+	return hash;
+}
+
+static bool match_name(LPCTSTR name, size_t len, LPCTSTR entry_name, int find_flags)
+{
+	for(size_t i=0; i<len; ++i)
+		if (!entry_name[i] || fold_char(name[i], find_flags)!=fold_char(entry_name[i], find_flags))
+			return false;
+
+	return !entry_name[len];
+}
+
+static void index_insert(Entry** index, size_t mask, LPCTSTR name, int find_flags, Entry* entry)
+{
+	size_t slot = hash_name(name, _tcslen(name), find_flags) & mask;
+
+	while(index[slot])
+		slot = (slot+1) & mask;
+
+	index[slot] = entry;
+}
+
+ // build the hash index of the sub-entry names, reusing the table of the previous index
+void Entry::build_index(int find_flags)
+{
+	size_t count = 0;
+
+	for(Entry*entry=_down; entry; entry=entry->_next)
+		++count;
+
+	 // room for long and alternate names with a load factor of at most 1/2
+	size_t size = 16;
 
-	if (next) {
-		_down = 0;
+	while(size < count*4)
+		size <<= 1;
 
-		do {
-			entry = next;
-			next = entry->_next;
+	EntryArena::NameIndex& idx = arena()._index;
 
-			entry->free_subentries();
-			delete entry;
-		} while(next);
+	if (idx._capacity < size) {
+		Entry** slots = (Entry**) realloc(idx._slots, size*sizeof(Entry*));
+
+		if (!slots)
+			throw std::bad_alloc();
+
+		idx._slots = slots;
+		idx._capacity = size;
+	}
+
+	Entry** index = idx._slots;
+
+	memset(index, 0, size*sizeof(Entry*));
+
+	for(Entry*entry=_down; entry; entry=entry->_next) {
+		index_insert(index, size-1, entry->_data.cFileName, find_flags, entry);
+
+		if ((find_flags&FIND_ALT_NAMES) && entry->_data.cAlternateFileName[0])
+			index_insert(index, size-1, entry->_data.cAlternateFileName, find_flags, entry);
+	}
+
+	idx._size = size;
+	idx._flags = find_flags;
+	idx._gen = _arena->_gen;
+}
+
+ // find the sub-entry named by the first len characters of name
+ // Only whole names match. The former find_entry() loops of the file system classes
+ // also accepted an entry if name was just a prefix of it, so "Win" found "Windows".
+Entry* Entry::find_sub_entry(LPCTSTR name, size_t len, int find_flags)
+{
+	if (!_down)
+		return NULL;
+
+	if (!_arena || _arena->_index._gen!=_arena->_gen || _arena->_index._flags!=find_flags)
+		build_index(find_flags);
+
+	Entry** index = _arena->_index._slots;
+	size_t mask = _arena->_index._size - 1;
+	Entry* entry;
+
+	for(size_t slot=hash_name(name, len, find_flags)&mask; (entry=index[slot]); slot=(slot+1)&mask) {
+		if (match_name(name, len, entry->_data.cFileName, find_flags))
+			return entry;
+
+		if ((find_flags&FIND_ALT_NAMES) && match_name(name, len, entry->_data.cAlternateFileName, find_flags))
+			return entry;
 	}
+
+	return NULL;
 }
 
 
@@ -55,6 +55,11 @@ enum SCAN_FLAGS {
 	SCAN_NO_FILESYSTEM		= 4
 };
 
+enum FIND_FLAGS {
+	FIND_IGNORE_CASE	= 1,
+	FIND_ALT_NAMES		= 2		// also match cAlternateFileName
+};
+
 #ifndef ATTRIBUTE_SYMBOLIC_LINK
 #define	ATTRIBUTE_LONGNAME			0x08000000
 #define	ATTRIBUTE_VOLNAME			0x10000000
@@ -78,6 +83,98 @@ enum ICONCACHE_FLAGS {
 #endif
 
 
+ /// file data of an entry, compact replacement for WIN32_FIND_DATA
+ /// The names point into the arena of the parent entry, so this needs 44 bytes (56 bytes on Win64)
+ /// instead of the 592 bytes of WIN32_FIND_DATAW. Use Entry::get_find_data() to get a WIN32_FIND_DATA.
+struct EntryData
+{
+	DWORD	dwFileAttributes;
+	DWORD	nFileSizeHigh;
+	DWORD	nFileSizeLow;
+	FILETIME ftCreationTime;
+	FILETIME ftLastAccessTime;
+	FILETIME ftLastWriteTime;
+	LPTSTR	cFileName;
+	LPTSTR	cAlternateFileName;	// follows cFileName in the same allocation
+
+	void	clear();
+};
+
+
+struct Entry;
+
+ /// slab allocator for the sub-entries of a directory
+ /// Allocation is a pointer increment, and releasing all sub-entries frees just the slabs.
+ /// Only the few entries registered by Entry::need_cleanup() are destroyed before.
+ /// The arena also caches the sort orders and the name index of the sub-entries, as they share its lifetime.
+struct EntryArena
+{
+	EntryArena() : _cleanup(NULL), _gen(1), _slab(NULL), _used(0), _size(0), _slabs(0), _allocs(0), _bytes(0) {memset(_sorted, 0, sizeof(_sorted)); memset(&_index, 0, sizeof(_index));}
+	~EntryArena() {clear(); free_caches();}
+
+	void*	alloc(size_t size, size_t align=8);
+	void	clear();
+
+	 /// allocate a sub-entry, which changes the list of sub-entries
+	void*	alloc_entry(size_t size) {++_gen; return alloc(size);}
+
+	 /// list of sub-entries holding resources outside of the arena
+	struct Cleanup {
+		Cleanup* _next;
+		Entry*	_entry;
+	};
+
+	Cleanup* _cleanup;
+
+	void	add_cleanup(Entry* entry);
+
+	 /// generation of the sub-entry list, incremented by alloc_entry(), add_names() and clear()
+	 /// The caches below are valid only as long as their generation matches.
+	size_t	_gen;
+
+	 /// sub-entries in one sort order, see Entry::sort_directory()
+	struct SortCache {
+		Entry**	_entries;	// allocated by malloc() and reused for the following sorts
+		size_t	_capacity;
+		size_t	_count;
+		size_t	_gen;
+	};
+
+	SortCache _sorted[SORT_DATE+1];
+
+	 /// hash table of the sub-entries by name, see Entry::find_sub_entry()
+	struct NameIndex {
+		Entry**	_slots;		// allocated by malloc() and reused when the index is rebuilt
+		size_t	_capacity;
+		size_t	_size;		// number of slots in use, a power of two
+		int		_flags;		// FIND_FLAGS of the indexed names
+		size_t	_gen;
+	};
+
+	NameIndex _index;
+
+	LPTSTR	add_names(LPCTSTR name, LPCTSTR alt_name);
+
+	void	free_caches();
+
+	size_t	_slabs;
+	size_t	_allocs;
+	size_t	_bytes;
+
+	static void dump_stats();
+
+protected:
+	struct Slab {
+		Slab*	_next;
+		size_t	_size;
+	};
+
+	Slab*	_slab;
+	size_t	_used;
+	size_t	_size;
+};
+
+
  /// base of all file and directory entries
 struct Entry
 {
@@ -95,9 +192,11 @@ public:
 
 	bool		_expanded;
 	bool		_scanned;
+	bool		_cleanup;	// registered in the parent's arena to be destroyed by free_subentries()
+	bool		_heap_name;	// _data.cFileName has been allocated by malloc() instead of the parent's arena
 	int 		_level;
 
-	WIN32_FIND_DATA _data;
+	EntryData	_data;
 
 	SFGAOF		_shell_attribs;
 	LPTSTR		_display_name;
@@ -107,10 +206,34 @@ public:
 	ENTRY_TYPE	_etype;
 	int /*ICON_ID*/ _icon_id;
 
-	BY_HANDLE_FILE_INFORMATION _bhfi;
-	bool		_bhfi_valid;
+	BY_HANDLE_FILE_INFORMATION* _bhfi;	// file index information, NULL if not available
+
+	EntryArena*	_arena;	// memory of the sub-entries, see arena()
+
+	 // Sub-entries are allocated by "new(arena()) XYEntry(this)" and released by free_subentries().
+	 // Their strings and the BY_HANDLE_FILE_INFORMATION block live in the same arena, see dup_string().
+	 // Entries holding other resources call need_cleanup() to get their destructor called.
+	static void* operator new(size_t size) {return ::operator new(size);}
+	static void* operator new(size_t size, EntryArena& arena) {return arena.alloc_entry(size);}
+	static void operator delete(void* p) {::operator delete(p);}
+	static void operator delete(void* p, EntryArena& arena) {}	// the arena memory is freed by EntryArena::clear()
+
+	EntryArena&	arena();
+
+	void	set_find_data(const WIN32_FIND_DATA& w32fd);
+	void	get_find_data(WIN32_FIND_DATA& w32fd) const;
+	void	copy_data(const Entry& other);
+	void	clear_data();
+	void	set_name(LPCTSTR name);
+	void	set_bhfi(const BY_HANDLE_FILE_INFORMATION& bhfi);
+
+	LPTSTR	alloc_string(size_t len);
+	LPTSTR	dup_string(LPCTSTR str, int len=-1);
+	void	free_string(LPTSTR str);
+	void	need_cleanup();
 
 	void	free_subentries();
+	Entry*	find_sub_entry(LPCTSTR name, size_t len, int find_flags);
 
 	void	read_directory_base(SORT_ORDER sortOrder=SORT_NAME, int scan_flags=0);
 	Entry*	read_tree(const void* path, SORT_ORDER sortOrder=SORT_NAME, int scan_flags=0);
@@ -131,6 +254,12 @@ public:
 
 protected:
 	bool	get_path_base(PTSTR path, size_t path_count, ENTRY_TYPE etype) const;
+
+	void	set_names(LPCTSTR name, LPCTSTR alt_name);
+	void	free_names();
+
+	void	link_sorted(Entry** entries, size_t count);
+	void	build_index(int find_flags);
 };
 
 
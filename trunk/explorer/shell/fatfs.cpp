@@ -172,14 +172,14 @@ void FATDirectory::read_directory(int scan_flags)
 
 				if (w32fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
 					_tcscpy_s(pname, plen, w32fd.cFileName);
-					entry = new FATDirectory(_drive, this, buffer, e.fclus);
+					entry = new(arena()) FATDirectory(_drive, this, buffer, e.fclus);
 				} else
-					entry = new FATEntry(this, e.fclus);
+					entry = new(arena()) FATEntry(this, e.fclus);
 
-				memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+				entry->set_find_data(w32fd);
 
 				if (!long_name.empty()) {
-					entry->_content = _tcsdup(long_name);
+					entry->_content = entry->dup_string(long_name);
 					long_name.erase();
 				}
 
@@ -225,25 +225,7 @@ Entry* FATDirectory::find_entry(const void* p)
 {
 	LPCTSTR name = (LPCTSTR)p;
 
-	for(Entry*entry=_down; entry; entry=entry->_next) {
-		LPCTSTR p = name;
-		LPCTSTR q = entry->_data.cFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-
-		p = name;
-		q = entry->_data.cAlternateFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-	}
-
-	return NULL;
+	return find_sub_entry(name, _tcscspn(name, TEXT("\\/")), FIND_IGNORE_CASE|FIND_ALT_NAMES);
 }
 
 
@@ -273,7 +255,7 @@ FATDirectory::FATDirectory(FATDrive& drive, LPCTSTR root_path)
  :	FATEntry(),
 	_drive(drive)
 {
-	_path = _tcsdup(root_path);
+	_path = dup_string(root_path);
 
 	_secarr 	= NULL;
 	_cur_bufs	= 0;
@@ -286,7 +268,7 @@ FATDirectory::FATDirectory(FATDrive& drive, Entry* parent, LPCTSTR path, unsigne
  :	FATEntry(parent, cluster),
 	_drive(drive)
 {
-	_path = _tcsdup(path);
+	_path = dup_string(path);
 
 	_secarr 	= NULL;
 	_cur_bufs	= 0;
@@ -296,7 +278,7 @@ FATDirectory::FATDirectory(FATDrive& drive, Entry* parent, LPCTSTR path, unsigne
 
 FATDirectory::~FATDirectory()
 {
-	free(_path);
+	free_string((LPTSTR)_path);
 	_path = NULL;
 }
 
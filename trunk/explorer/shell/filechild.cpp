@@ -228,9 +228,9 @@ FileChildWindow::FileChildWindow(HWND hwnd, const FileChildWndInfo& info)
 
 	if (_root._entry) {
 		if (info._etype != ET_SHELL)
-			wsprintf(_root._entry->_data.cFileName, TEXT("%s - %s"), drv, _root._fs);
+			_root._entry->set_name(FmtString(TEXT("%s - %s"), drv, _root._fs));
 	/*@@else
-			lstrcpy(_root._entry->_data.cFileName, TEXT("GetDesktopFolder"));*/
+			_root._entry->set_name(TEXT("GetDesktopFolder"));*/
 
 		_root._entry->_data.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
 
@@ -650,7 +650,7 @@ void FileChildWindow::scan_entry(Entry* entry)
 	entry->_expanded = false;
 
 	 // read contents from disk
-	entry->read_directory_base(_root._sort_order);	///@todo use modifyable sort order instead of fixed file system default
+	entry->read_directory_base(_root._sort_order);	// sort order as selected in the header of the right pane
 
 	 // insert found entries in right pane
 	HiddenWindow hide(_right_hwnd);
@@ -665,10 +665,46 @@ void FileChildWindow::scan_entry(Entry* entry)
 
 int FileChildWindow::Notify(int id, NMHDR* pnmh)
 {
+	if (pnmh->idFrom==IDW_HEADER_RIGHT && pnmh->code==HDN_ITEMCLICK) {
+		 // sort by the clicked column
+		switch(((NMHEADER*)pnmh)->iItem) {
+		  case 1:	sort_right_pane(SORT_NAME);	break;	// Name
+		  case 2:	sort_right_pane(SORT_EXT);	break;	// Type
+		  case 3:	sort_right_pane(SORT_SIZE);	break;	// Size
+		  case 6:	sort_right_pane(SORT_DATE);	break;	// MDate
+		}
+
+		return 0;
+	}
+
 	return (pnmh->idFrom==IDW_HEADER_LEFT? _left: _right)->Notify(id, pnmh);
 }
 
 
+ // Resort the current directory. This is a simple relink of the entries
+ // if the directory has already been displayed in the requested order.
+void FileChildWindow::sort_right_pane(SORT_ORDER sortOrder)
+{
+	Entry* dir = _right->_cur;
+
+	if (!dir || !dir->_scanned)
+		return;
+
+	WaitCursor wait;
+
+	_root._sort_order = sortOrder;
+
+	dir->sort_directory(sortOrder);
+
+	_right->_root = dir->_down? dir->_down: dir;
+
+	HiddenWindow hide(_right_hwnd);
+
+	ListBox_ResetContent(_right_hwnd);
+	_right->insert_entries(dir->_down);
+}
+
+
 String FileChildWindow::jump_to_int(LPCTSTR url)
 {
 	String dir, fname;
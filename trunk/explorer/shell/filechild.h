@@ -108,6 +108,7 @@ protected:
 
 	void	set_curdir(Entry* entry);
 	void	activate_entry(Pane* pane);
+	void	sort_right_pane(SORT_ORDER sortOrder);
 
 	void	refresh();
 
@@ -256,7 +256,7 @@ void NtObjDirectory::read_directory(int scan_flags)
 			if (type == DIRECTORY_OBJECT) {
 				w32fd.dwFileAttributes |= FILE_ATTRIBUTE_DIRECTORY;
 
-				entry = new NtObjDirectory(this, buffer);
+				entry = new(arena()) NtObjDirectory(this, buffer);
 			}
 
 			else if (type == SYMBOLICLINK_OBJECT) {
@@ -269,21 +269,21 @@ void NtObjDirectory::read_directory(int scan_flags)
 					if (!_tcsncmp(buffer,TEXT("\\??\\"),4) ||		// NT4
 						!_tcsncmp(buffer,TEXT("\\GLOBAL??"),9)) {	// XP
 						w32fd.dwFileAttributes |= FILE_ATTRIBUTE_DIRECTORY;
-						entry = new WinDirectory(this, w32fd.cFileName);
+						entry = new(arena()) WinDirectory(this, w32fd.cFileName);
 					}
 #endif
 
 				if (!entry)
-					entry = new NtObjDirectory(this, buffer);
+					entry = new(arena()) NtObjDirectory(this, buffer);
 			}
 
 			else if (type == KEY_OBJECT) {
 				w32fd.dwFileAttributes |= FILE_ATTRIBUTE_DIRECTORY;
 
-				entry = new RegistryRoot(this, buffer);
+				entry = new(arena()) RegistryRoot(this, buffer);
 			}
 			else
-				entry = new NtObjEntry(this, type);
+				entry = new(arena()) NtObjEntry(this, type);
 
 			HANDLE handle;
 
@@ -301,9 +301,11 @@ void NtObjDirectory::read_directory(int scan_flags)
 				if (!(*g_NTDLL->NtQueryObject)(handle, 0/*ObjectBasicInformation*/, &object, sizeof(NtObject), &read)) {
 					memcpy(&w32fd.ftCreationTime, &object.creation_time, sizeof(FILETIME));
 
-					memset(&entry->_bhfi, 0, sizeof(BY_HANDLE_FILE_INFORMATION));
-					entry->_bhfi.nNumberOfLinks = object.reference_count - 1;
-					entry->_bhfi_valid = true;
+					BY_HANDLE_FILE_INFORMATION bhfi;
+
+					memset(&bhfi, 0, sizeof(BY_HANDLE_FILE_INFORMATION));
+					bhfi.nNumberOfLinks = object.reference_count - 1;
+					entry->set_bhfi(bhfi);
 				}
 
 				if (type == SYMBOLICLINK_OBJECT) {
@@ -312,7 +314,7 @@ void NtObjDirectory::read_directory(int scan_flags)
 
 					if (!(*g_NTDLL->NtQuerySymbolicLinkObject)(handle, &link, NULL)) {
 						int len = link.string_len/sizeof(WCHAR);
-						entry->_content = (LPTSTR) malloc((len+1)*sizeof(TCHAR));
+						entry->_content = entry->alloc_string(len);
 #ifdef UNICODE
 						wcsncpy_s(entry->_content, len+1, link, len);
 #else
@@ -325,14 +327,14 @@ void NtObjDirectory::read_directory(int scan_flags)
 				(*g_NTDLL->NtClose)(handle);
 			}
 
-			memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+			entry->set_find_data(w32fd);
 
 #ifdef UNICODE
-			entry->_type_name = _wcsdup(info->type.string_ptr);
+			entry->_type_name = entry->dup_string(info->type.string_ptr);
 #else
 			char type_name[32];
 			WideCharToMultiByte(CP_ACP, 0, info->type.string_ptr, info->type.string_len, type_name, 32, 0, 0);
-			entry->_type_name = _strdup(type_name);
+			entry->_type_name = entry->dup_string(type_name);
 #endif
 
 			if (!first_entry)
@@ -360,25 +362,7 @@ Entry* NtObjDirectory::find_entry(const void* p)
 {
 	LPCTSTR name = (LPCTSTR)p;
 
-	for(Entry*entry=_down; entry; entry=entry->_next) {
-		LPCTSTR p = name;
-		LPCTSTR q = entry->_data.cFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-
-		p = name;
-		q = entry->_data.cAlternateFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-	}
-
-	return NULL;
+	return find_sub_entry(name, _tcscspn(name, TEXT("\\/")), FIND_IGNORE_CASE|FIND_ALT_NAMES);
 }
 
 
@@ -102,18 +102,18 @@ struct NtObjDirectory : public NtObjEntry, public Directory
 	NtObjDirectory(LPCTSTR root_path)
 	 :	NtObjEntry(DIRECTORY_OBJECT)
 	{
-		_path = _tcsdup(root_path);
+		_path = dup_string(root_path);
 	}
 
 	NtObjDirectory(Entry* parent, LPCTSTR path)
 	 :	NtObjEntry(parent, DIRECTORY_OBJECT)
 	{
-		_path = _tcsdup(path);
+		_path = dup_string(path);
 	}
 
 	~NtObjDirectory()
 	{
-		free(_path);
+		free_string((LPTSTR)_path);
 		_path = NULL;
 	}
 
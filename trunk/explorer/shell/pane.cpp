@@ -129,7 +129,8 @@ LRESULT Pane::WndProc(UINT nmsg, WPARAM wparam, LPARAM lparam)
 
 bool Pane::create_header(HWND hparent, int id)
 {
-	HWND hwnd = CreateWindow(WC_HEADER, 0, WS_CHILD|WS_VISIBLE|HDS_HORZ/*@todo |HDS_BUTTONS + sort orders*/,
+	 // header buttons in the file list pane to select the sort order
+	HWND hwnd = CreateWindow(WC_HEADER, 0, WS_CHILD|WS_VISIBLE|HDS_HORZ|(_treePane? 0: HDS_BUTTONS),
 								0, 0, 0, 0, hparent, (HMENU)id, g_Globals._hInstance, 0);
 	if (!hwnd)
 		return false;
@@ -537,8 +538,8 @@ void Pane::draw_item(LPDRAWITEMSTRUCT dis, Entry* entry, int calcWidthCol)
 	} else
 		col += 3;
 
-	if (entry->_bhfi_valid) {
-		ULONGLONG index = ((ULONGLONG)entry->_bhfi.nFileIndexHigh << 32) | entry->_bhfi.nFileIndexLow;
+	if (entry->_bhfi) {
+		ULONGLONG index = ((ULONGLONG)entry->_bhfi->nFileIndexHigh << 32) | entry->_bhfi->nFileIndexLow;
 
 		if (visible_cols & COL_INDEX) {
 			_stprintf(buffer, TEXT("%") LONGLONGARG TEXT("X"), index);
@@ -552,7 +553,7 @@ void Pane::draw_item(LPDRAWITEMSTRUCT dis, Entry* entry, int calcWidthCol)
 		}
 
 		if (visible_cols & COL_LINKS) {
-			wsprintf(buffer, TEXT("%d"), entry->_bhfi.nNumberOfLinks);
+			wsprintf(buffer, TEXT("%d"), entry->_bhfi->nNumberOfLinks);
 
 			if (calcWidthCol == -1)
 				_out_wrkr.output_text(dis, _positions, col, buffer, DT_RIGHT);
@@ -68,12 +68,12 @@ void RegDirectory::read_directory(int scan_flags)
 			_tcsncpy(w32fd.cFileName, name, name_len);
 
 			_tcscpy_s(pname, plen, name);
-			entry = new RegDirectory(this, buffer, _hKeyRoot);
+			entry = new(arena()) RegDirectory(this, buffer, _hKeyRoot);
 
-			memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+			entry->set_find_data(w32fd);
 
 			if (class_len)
-				entry->_type_name = _tcsdup(String(class_name, class_len));
+				entry->_type_name = entry->dup_string(class_name, class_len);
 
 			if (!first_entry)
 				first_entry = entry;
@@ -94,11 +94,11 @@ void RegDirectory::read_directory(int scan_flags)
 
 			lstrcpy(w32fd.cFileName, TEXT("(Default)"));
 
-			entry = new RegEntry(this);
+			entry = new(arena()) RegEntry(this);
 
-			memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+			entry->set_find_data(w32fd);
 
-			entry->_content = _tcsdup(value);
+			entry->_content = entry->dup_string(value);
 
 			if (!first_entry)
 				first_entry = entry;
@@ -125,23 +125,23 @@ void RegDirectory::read_directory(int scan_flags)
 			else
 				lstrcpy(w32fd.cFileName, TEXT("(Default)"));
 
-			entry = new RegEntry(this);
+			entry = new(arena()) RegEntry(this);
 
-			memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+			entry->set_find_data(w32fd);
 
 			switch(type) {
-			  case REG_NONE:						entry->_type_name = _tcsdup(TEXT("REG_NONE"));						break;
-			  case REG_SZ:							entry->_type_name = _tcsdup(TEXT("REG_SZ"));						break;
-			  case REG_EXPAND_SZ:					entry->_type_name = _tcsdup(TEXT("REG_EXPAND_SZ"));					break;
-			  case REG_BINARY:						entry->_type_name = _tcsdup(TEXT("REG_BINARY"));					break;
-			  case REG_DWORD:						entry->_type_name = _tcsdup(TEXT("REG_DWORD"));						break;
-			  case REG_DWORD_BIG_ENDIAN:			entry->_type_name = _tcsdup(TEXT("REG_DWORD_BIG_ENDIAN"));			break;
-			  case REG_LINK:						entry->_type_name = _tcsdup(TEXT("REG_LINK"));						break;
-			  case REG_MULTI_SZ:					entry->_type_name = _tcsdup(TEXT("REG_MULTI_SZ"));					break;
-			  case REG_RESOURCE_LIST:				entry->_type_name = _tcsdup(TEXT("REG_RESOURCE_LIST"));				break;
-			  case REG_FULL_RESOURCE_DESCRIPTOR:	entry->_type_name = _tcsdup(TEXT("REG_FULL_RESOURCE_DESCRIPTOR"));	break;
-			  case REG_RESOURCE_REQUIREMENTS_LIST:	entry->_type_name = _tcsdup(TEXT("REG_RESOURCE_REQUIREMENTS_LIST"));break;
-			  case REG_QWORD:						entry->_type_name = _tcsdup(TEXT("REG_QWORD"));						break;
+			  case REG_NONE:						entry->_type_name = entry->dup_string(TEXT("REG_NONE"));						break;
+			  case REG_SZ:							entry->_type_name = entry->dup_string(TEXT("REG_SZ"));						break;
+			  case REG_EXPAND_SZ:					entry->_type_name = entry->dup_string(TEXT("REG_EXPAND_SZ"));					break;
+			  case REG_BINARY:						entry->_type_name = entry->dup_string(TEXT("REG_BINARY"));					break;
+			  case REG_DWORD:						entry->_type_name = entry->dup_string(TEXT("REG_DWORD"));						break;
+			  case REG_DWORD_BIG_ENDIAN:			entry->_type_name = entry->dup_string(TEXT("REG_DWORD_BIG_ENDIAN"));			break;
+			  case REG_LINK:						entry->_type_name = entry->dup_string(TEXT("REG_LINK"));						break;
+			  case REG_MULTI_SZ:					entry->_type_name = entry->dup_string(TEXT("REG_MULTI_SZ"));					break;
+			  case REG_RESOURCE_LIST:				entry->_type_name = entry->dup_string(TEXT("REG_RESOURCE_LIST"));				break;
+			  case REG_FULL_RESOURCE_DESCRIPTOR:	entry->_type_name = entry->dup_string(TEXT("REG_FULL_RESOURCE_DESCRIPTOR"));	break;
+			  case REG_RESOURCE_REQUIREMENTS_LIST:	entry->_type_name = entry->dup_string(TEXT("REG_RESOURCE_REQUIREMENTS_LIST"));break;
+			  case REG_QWORD:						entry->_type_name = entry->dup_string(TEXT("REG_QWORD"));						break;
 			}
 
 			 ///@todo This can also be done in the RegEnumValue() call if we dynamically adjust the return buffer size.
@@ -150,11 +150,11 @@ void RegDirectory::read_directory(int scan_flags)
 
 			if (!RegQueryValueEx(hkey, name, NULL, NULL, (LPBYTE)value, &value_len)) {
 				if (type==REG_SZ || type==REG_EXPAND_SZ || type==REG_LINK)
-					entry->_content = _tcsdup(value);
+					entry->_content = entry->dup_string(value);
 				else if (type == REG_DWORD) {
 					TCHAR b[32];
 					_stprintf(b, TEXT("%ld"), *(DWORD*)&value);
-					entry->_content = _tcsdup(b);
+					entry->_content = entry->dup_string(b);
 				}
 			}
 
@@ -201,25 +201,7 @@ Entry* RegDirectory::find_entry(const void* p)
 {
 	LPCTSTR name = (LPCTSTR)p;
 
-	for(Entry*entry=_down; entry; entry=entry->_next) {
-		LPCTSTR p = name;
-		LPCTSTR q = entry->_data.cFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-
-		p = name;
-		q = entry->_data.cAlternateFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-	}
-
-	return NULL;
+	return find_sub_entry(name, _tcscspn(name, TEXT("\\/")), FIND_IGNORE_CASE|FIND_ALT_NAMES);
 }
 
 
@@ -239,9 +221,9 @@ RegDirectory::RegDirectory(Entry* parent, LPCTSTR path, HKEY hKeyRoot)
  :	RegEntry(parent),
 	_hKeyRoot(hKeyRoot)
 {
-	_path = _tcsdup(path);
+	_path = dup_string(path);
 
-	memset(&_data, 0, sizeof(WIN32_FIND_DATA));
+	clear_data();
 	_data.dwFileAttributes |= FILE_ATTRIBUTE_DIRECTORY;
 }
 
@@ -253,50 +235,50 @@ void RegistryRoot::read_directory(int scan_flags)
 
 	_data.dwFileAttributes |= FILE_ATTRIBUTE_DIRECTORY;
 
-	entry = new RegDirectory(this, TEXT("\\"), HKEY_CURRENT_USER);
-	_tcscpy(entry->_data.cFileName, TEXT("HKEY_CURRENT_USER"));
+	entry = new(arena()) RegDirectory(this, TEXT("\\"), HKEY_CURRENT_USER);
+	entry->set_name(TEXT("HKEY_CURRENT_USER"));
 	entry->_level = level;
 
 	first_entry = entry;
 	last = entry;
 
-	entry = new RegDirectory(this, TEXT("\\"), HKEY_LOCAL_MACHINE);
-	_tcscpy(entry->_data.cFileName, TEXT("HKEY_LOCAL_MACHINE"));
+	entry = new(arena()) RegDirectory(this, TEXT("\\"), HKEY_LOCAL_MACHINE);
+	entry->set_name(TEXT("HKEY_LOCAL_MACHINE"));
 	entry->_level = level;
 
 	last->_next = entry;
 	last = entry;
 
-	entry = new RegDirectory(this, TEXT("\\"), HKEY_CLASSES_ROOT);
-	_tcscpy(entry->_data.cFileName, TEXT("HKEY_CLASSES_ROOT"));
+	entry = new(arena()) RegDirectory(this, TEXT("\\"), HKEY_CLASSES_ROOT);
+	entry->set_name(TEXT("HKEY_CLASSES_ROOT"));
 	entry->_level = level;
 
 	last->_next = entry;
 	last = entry;
 
-	entry = new RegDirectory(this, TEXT("\\"), HKEY_USERS);
-	_tcscpy(entry->_data.cFileName, TEXT("HKEY_USERS"));
+	entry = new(arena()) RegDirectory(this, TEXT("\\"), HKEY_USERS);
+	entry->set_name(TEXT("HKEY_USERS"));
 	entry->_level = level;
 
 	last->_next = entry;
 	last = entry;
 /*
-	entry = new RegDirectory(this, TEXT("\\"), HKEY_PERFORMANCE_DATA);
-	_tcscpy(entry->_data.cFileName, TEXT("HKEY_PERFORMANCE_DATA"));
+	entry = new(arena()) RegDirectory(this, TEXT("\\"), HKEY_PERFORMANCE_DATA);
+	entry->set_name(TEXT("HKEY_PERFORMANCE_DATA"));
 	entry->_level = level;
 
 	last->_next = entry;
 	last = entry;
 */
-	entry = new RegDirectory(this, TEXT("\\"), HKEY_CURRENT_CONFIG);
-	_tcscpy(entry->_data.cFileName, TEXT("HKEY_CURRENT_CONFIG"));
+	entry = new(arena()) RegDirectory(this, TEXT("\\"), HKEY_CURRENT_CONFIG);
+	entry->set_name(TEXT("HKEY_CURRENT_CONFIG"));
 	entry->_level = level;
 
 	last->_next = entry;
 	last = entry;
 /*
-	entry = new RegDirectory(this, TEXT("\\"), HKEY_DYN_DATA);
-	_tcscpy(entry->_data.cFileName, TEXT("HKEY_DYN_DATA"));
+	entry = new(arena()) RegDirectory(this, TEXT("\\"), HKEY_DYN_DATA);
+	entry->set_name(TEXT("HKEY_DYN_DATA"));
 	entry->_level = level;
 
 	last->_next = entry;
@@ -46,7 +46,7 @@ struct RegDirectory : public RegEntry, public Directory
 
 	~RegDirectory()
 	{
-		free(_path);
+		free_string((LPTSTR)_path);
 		_path = NULL;
 	}
 
@@ -69,12 +69,12 @@ struct RegistryRoot : public RegEntry, public Directory
 	RegistryRoot(Entry* parent, LPCTSTR path)
 	 :	RegEntry(parent)
 	{
-		_path = _tcsdup(path);
+		_path = dup_string(path);
 	}
 
 	~RegistryRoot()
 	{
-		free(_path);
+		free_string((LPTSTR)_path);
 		_path = NULL;
 	}
 
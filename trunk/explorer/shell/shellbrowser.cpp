@@ -105,7 +105,7 @@ void ShellBrowser::Init()
 	jump_to(_create_info._shell_path);
 
 	/* already filled by ShellDirectory constructor
-	lstrcpy(_root._entry->_data.cFileName, TEXT("Desktop")); */
+	_root._entry->set_name(TEXT("Desktop")); */
 }
 
 void ShellBrowser::jump_to(LPCITEMIDLIST pidl)
@@ -293,9 +293,9 @@ void ShellDirectory::read_directory(int scan_flags)
 				lstrcpy(p+1, w32fd.cFileName);
 
 				if (w32fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-					entry = new WinDirectory(this, buffer);
+					entry = new(arena()) WinDirectory(this, buffer);
 				else
-					entry = new WinEntry(this);
+					entry = new(arena()) WinEntry(this);
 
 				if (!first_entry)
 					first_entry = entry;
@@ -303,7 +303,7 @@ void ShellDirectory::read_directory(int scan_flags)
 				if (last)
 					last->_next = entry;
 
-				memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+				entry->set_find_data(w32fd);
 
 				entry->_level = level;
 
@@ -312,8 +312,10 @@ void ShellDirectory::read_directory(int scan_flags)
 												0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
 
 					if (hFile != INVALID_HANDLE_VALUE) {
-						if (GetFileInformationByHandle(hFile, &entry->_bhfi))
-							entry->_bhfi_valid = true;
+						BY_HANDLE_FILE_INFORMATION bhfi;
+
+						if (GetFileInformationByHandle(hFile, &bhfi))
+							entry->set_bhfi(bhfi);
 
 						if (ScanNTFSStreams(entry, hFile))
 							entry->_scanned = true;	// There exist named NTFS sub-streams in this file.
@@ -418,9 +420,9 @@ void ShellDirectory::read_directory(int scan_flags)
 					Entry* entry = NULL;	// eliminate useless GCC warning by initializing entry
 
 					if (w32fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-						entry = new ShellDirectory(this, pidls[n], _hwnd);
+						entry = new(arena()) ShellDirectory(this, pidls[n], _hwnd);
 					else
-						entry = new ShellEntry(this, pidls[n]);
+						entry = new(arena()) ShellEntry(this, pidls[n]);
 
 					if (!first_entry)
 						first_entry = entry;
@@ -428,21 +430,21 @@ void ShellDirectory::read_directory(int scan_flags)
 					if (last)
 						last->_next = entry;
 
-					memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+					entry->set_find_data(w32fd);
 
 					if (bhfi_valid)
-						memcpy(&entry->_bhfi, &bhfi, sizeof(BY_HANDLE_FILE_INFORMATION));
+						entry->set_bhfi(bhfi);
 
 					 // store path in entry->_data.cFileName in case fill_w32fdata_shell() didn't already fill it
 					if (!entry->_data.cFileName[0])
 						if (SUCCEEDED(path_from_pidl(_folder, pidls[n], path, COUNTOF(path))))
-							_tcscpy(entry->_data.cFileName, path);
+							entry->set_name(path);
 
 					if (SUCCEEDED(name_from_pidl(_folder, pidls[n], name, COUNTOF(name), SHGDN_INFOLDER|0x2000/*0x2000=SHGDN_INCLUDE_NONFILESYS*/))) {
 						if (!entry->_data.cFileName[0])
-							_tcscpy(entry->_data.cFileName, name);
+							entry->set_name(name);
 						else if (_tcscmp(entry->_display_name, name))
-							entry->_display_name = _tcsdup(name);	// store display name separate from file name; sort display by file name
+							entry->_display_name = entry->dup_string(name);	// store display name separate from file name; sort display by file name
 					}
 
 					if (attribs & SFGAO_LINK)
@@ -450,7 +452,6 @@ void ShellDirectory::read_directory(int scan_flags)
 
 					entry->_level = level;
 					entry->_shell_attribs = attribs;
-					entry->_bhfi_valid = bhfi_valid;
 
 					 // set file type name
 					g_Globals._ftype_mgr.set_type(entry);
@@ -29,8 +29,8 @@
  /// shell file/directory entry
 struct ShellEntry : public Entry
 {
-	ShellEntry(Entry* parent, LPITEMIDLIST shell_path) : Entry(parent, ET_SHELL), _pidl(shell_path) {}
-	ShellEntry(Entry* parent, const ShellPath& shell_path) : Entry(parent, ET_SHELL), _pidl(shell_path) {}
+	ShellEntry(Entry* parent, LPITEMIDLIST shell_path) : Entry(parent, ET_SHELL), _pidl(shell_path) {need_cleanup();}	// The destructor frees the PIDL.
+	ShellEntry(Entry* parent, const ShellPath& shell_path) : Entry(parent, ET_SHELL), _pidl(shell_path) {need_cleanup();}
 
 	virtual bool		get_path(PTSTR path, size_t path_count) const;
 	virtual ShellPath	create_absolute_pidl() const;
@@ -59,7 +59,7 @@ struct ShellDirectory : public ShellEntry, public Directory
 	{
 		CONTEXT("ShellDirectory::ShellDirectory()");
 
-		lstrcpy(_data.cFileName, root_folder.get_name(shell_path, SHGDN_FORADDRESSBAR));
+		set_name(root_folder.get_name(shell_path, SHGDN_FORADDRESSBAR));
 		_data.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
 		_shell_attribs = SFGAO_FOLDER;
 
@@ -75,7 +75,7 @@ struct ShellDirectory : public ShellEntry, public Directory
 		_hwnd(hwnd)
 	{
 		/* not neccessary - the caller will fill the info
-		lstrcpy(_data.cFileName, _folder.get_name(shell_path));
+		set_name(_folder.get_name(shell_path));
 		_data.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
 		_shell_attribs = SFGAO_FOLDER; */
 
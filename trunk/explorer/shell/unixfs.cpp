@@ -64,9 +64,9 @@ void UnixDirectory::read_directory()
 			int statres = stat(buffer, &st);
 
 			if (!statres && S_ISDIR(st.st_mode))
-				entry = new UnixDirectory(this, buffer);
+				entry = new(arena()) UnixDirectory(this, buffer);
 			else
-				entry = new UnixEntry(this);
+				entry = new(arena()) UnixEntry(this);
 
 			if (!first_entry)
 				first_entry = entry;
@@ -74,7 +74,7 @@ void UnixDirectory::read_directory()
 			if (last)
 				last->_next = entry;
 
-			lstrcpy(entry->_data.cFileName, ent->d_name);
+			entry->set_name(ent->d_name);
 			entry->_data.dwFileAttributes = ent->d_name[0]=='.'? FILE_ATTRIBUTE_HIDDEN: 0;
 
 			strcpy(p, ent->d_name);
@@ -90,16 +90,18 @@ void UnixDirectory::read_directory()
 				time_to_filetime(&st.st_atime, &entry->_data.ftLastAccessTime);
 				time_to_filetime(&st.st_mtime, &entry->_data.ftLastWriteTime);
 
-				entry->_bhfi.nFileIndexLow = ent->d_ino;
-				entry->_bhfi.nFileIndexHigh = 0;
+				BY_HANDLE_FILE_INFORMATION bhfi;
 
-				entry->_bhfi.nNumberOfLinks = st.st_nlink;
+				memset(&bhfi, 0, sizeof(BY_HANDLE_FILE_INFORMATION));
+				bhfi.nFileIndexLow = ent->d_ino;
+				bhfi.nFileIndexHigh = 0;
 
-				entry->_bhfi_valid = TRUE;
+				bhfi.nNumberOfLinks = st.st_nlink;
+
+				entry->set_bhfi(bhfi);
 			} else {
 				entry->_data.nFileSizeLow = 0;
 				entry->_data.nFileSizeHigh = 0;
-				entry->_bhfi_valid = FALSE;
 			}
 
 			entry->_up = this;
@@ -141,17 +143,7 @@ Entry* UnixDirectory::find_entry(const void* p)
 {
 	LPCTSTR name = (LPCTSTR)p;
 
-	for(Entry*entry=_down; entry; entry=entry->_next) {
-		LPCTSTR p = name;
-		LPCTSTR q = entry->_data.cFileName;
-
-		do {
-			if (!*p || *p==TEXT('/'))
-				return entry;
-		} while(*p++ == *q++);
-	}
-
-	return NULL;
+	return find_sub_entry(name, _tcscspn(name, TEXT("/")), 0);
 }
 
 
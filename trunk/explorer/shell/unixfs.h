@@ -43,18 +43,18 @@ struct UnixDirectory : public UnixEntry, public Directory
 	UnixDirectory(LPCTSTR root_path)
 	 :	UnixEntry()
 	{
-		_path = _tcsdup(root_path);
+		_path = dup_string(root_path);
 	}
 
 	UnixDirectory(UnixDirectory* parent, LPCTSTR path)
 	 :	UnixEntry(parent)
 	{
-		_path = _tcsdup(path);
+		_path = dup_string(path);
 	}
 
 	~UnixDirectory()
 	{
-		free(_path);
+		free_string((LPTSTR)_path);
 		_path = NULL;
 	}
 
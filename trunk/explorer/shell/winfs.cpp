@@ -71,10 +71,10 @@ int ScanNTFSStreams(Entry* entry, HANDLE hFile)
 					l = e - p;
 				}
 
-				Entry* stream_entry = new WinEntry(entry);
+				Entry* stream_entry = new(entry->arena()) WinEntry(entry);
 
-				memcpy(&stream_entry->_data, &entry->_data, sizeof(WIN32_FIND_DATA));
-				lstrcpy(stream_entry->_data.cFileName, String(p, l));
+				stream_entry->copy_data(*entry);
+				stream_entry->set_name(String(p, l));
 
 				stream_entry->_down = NULL;
 				stream_entry->_expanded = false;
@@ -143,9 +143,9 @@ void WinDirectory::read_directory(int scan_flags)
 			lstrcpy(pname+1, w32fd.cFileName);
 
 			if (w32fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-				entry = new WinDirectory(this, buffer);
+				entry = new(arena()) WinDirectory(this, buffer);
 			else
-				entry = new WinEntry(this);
+				entry = new(arena()) WinEntry(this);
 
 			if (!first_entry)
 				first_entry = entry;
@@ -153,7 +153,7 @@ void WinDirectory::read_directory(int scan_flags)
 			if (last)
 				last->_next = entry;
 
-			memcpy(&entry->_data, &w32fd, sizeof(WIN32_FIND_DATA));
+			entry->set_find_data(w32fd);
 			entry->_level = level;
 
 			 // display file type names, but don't hide file extensions
@@ -164,8 +164,10 @@ void WinDirectory::read_directory(int scan_flags)
 											0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
 
 				if (hFile != INVALID_HANDLE_VALUE) {
-					if (GetFileInformationByHandle(hFile, &entry->_bhfi))
-						entry->_bhfi_valid = true;
+					BY_HANDLE_FILE_INFORMATION bhfi;
+
+					if (GetFileInformationByHandle(hFile, &bhfi))
+						entry->set_bhfi(bhfi);
 
 					if (ScanNTFSStreams(entry, hFile))
 						entry->_scanned = true;	// There exist named NTFS sub-streams in this file.
@@ -209,25 +211,7 @@ Entry* WinDirectory::find_entry(const void* p)
 {
 	LPCTSTR name = (LPCTSTR)p;
 
-	for(Entry*entry=_down; entry; entry=entry->_next) {
-		LPCTSTR p = name;
-		LPCTSTR q = entry->_data.cFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-
-		p = name;
-		q = entry->_data.cAlternateFileName;
-
-		do {
-			if (!*p || *p==TEXT('\\') || *p==TEXT('/'))
-				return entry;
-		} while(tolower(*p++) == tolower(*q++));
-	}
-
-	return NULL;
+	return find_sub_entry(name, _tcscspn(name, TEXT("\\/")), FIND_IGNORE_CASE|FIND_ALT_NAMES);
 }
 
 
@@ -45,18 +45,18 @@ struct WinDirectory : public WinEntry, public Directory
 	WinDirectory(LPCTSTR root_path)
 	 :	WinEntry()
 	{
-		_path = _tcsdup(root_path);
+		_path = dup_string(root_path);
 	}
 
 	WinDirectory(Entry* parent, LPCTSTR path)
 	 :	WinEntry(parent)
 	{
-		_path = _tcsdup(path);
+		_path = dup_string(path);
 	}
 
 	~WinDirectory()
 	{
-		free(_path);
+		free_string((LPTSTR)_path);
 		_path = NULL;
 	}
 
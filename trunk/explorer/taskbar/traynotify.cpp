@@ -334,6 +334,8 @@ void NotifyArea::write_config()
 	}
 
 	cfg_pos.back();	// smart_create
+
+	g_Globals.cfg_changed();
 }
 
 void NotifyArea::show_clock(bool flag)
@@ -1131,6 +1133,9 @@ int TrayNotifyDlg::Command(int id, int code)
 			break;
 
 		  case IDOK:
+			if (_pNotifyArea)
+				_pNotifyArea->write_config();
+
 			EndDialog(_hwnd, id);
 			break;
 
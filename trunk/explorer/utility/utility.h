@@ -366,6 +366,12 @@ struct Thread
 	void Start()
 	{
 		if (!_alive) {
+			 // a restart after Stop() forgets the finished thread and its finish request
+			if (_hThread != INVALID_HANDLE_VALUE)
+				CloseHandle(_hThread);
+
+			ResetEvent(_evtFinish);
+
 			_alive = true;
 			_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
 		}
@@ -0,0 +1,1253 @@
+
+ //
+ // xmlbench.cpp
+ //
+ // Benchmarks for the XMLStorage classes in xmlstorage.cpp, xs-native.cpp
+ //
+ // Build with Makefile-xmlbench, e.g. "make -f Makefile-xmlbench".
+ // xmlbench-list is built with XS_LIST_CHILDREN to compare the children containers,
+ // xmlbench-expat with XS_USE_EXPAT to compare the parser backends.
+ //
+ // "xmlbench suite [max-size] [min-size]" runs the regression suite on synthetic documents
+ // and prints one JSON object per measurement, see run_suite().
+ //
+
+
+#ifndef XS_NO_COMMENT
+#define XS_NO_COMMENT
+#endif
+
+#include "xmlstorage.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi")
+#endif
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+using namespace XMLStorage;
+
+
+ // count heap allocations of the whole process by replacing the glibc malloc entry points
+#if defined(__GLIBC__) && !defined(XMLBENCH_NO_MALLOC_STATS)
+
+#define XMLBENCH_MALLOC_STATS
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+}
+
+static volatile long s_allocs;
+static volatile long s_alloc_bytes;
+
+static inline void count_alloc(size_t size)
+{
+	__sync_add_and_fetch(&s_allocs, 1);
+	__sync_add_and_fetch(&s_alloc_bytes, (long)size);
+}
+
+extern "C" void* malloc(size_t size) __THROW
+{
+	count_alloc(size);
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) __THROW
+{
+	count_alloc(n*size);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) __THROW
+{
+	count_alloc(size);
+	return __libc_realloc(p, size);
+}
+
+extern "C" void free(void* p) __THROW
+{
+	__libc_free(p);
+}
+
+#endif
+
+ /// number and total size of allocations since program start, zero if not available
+struct AllocStats
+{
+	AllocStats()
+	{
+#ifdef XMLBENCH_MALLOC_STATS
+		_count = s_allocs;
+		_bytes = s_alloc_bytes;
+#else
+		_count = 0;
+		_bytes = 0;
+#endif
+	}
+
+	long	_count;
+	long	_bytes;
+};
+
+
+ /// wall clock time in milliseconds
+static double now_ms()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+	return cnt.QuadPart * 1000. / freq.QuadPart;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+#endif
+}
+
+ /// print one result line: benchmark name, operation count, total time and throughput
+static void report(const char* name, long ops, double ms)
+{
+	char line[256];
+
+	sprintf(line, "%-24s %10ld ops %10.1f ms %12.0f ops/s", name, ops, ms, ms>0? ops*1000./ms: 0.);
+
+	std::cout << line << std::endl;
+}
+
+ /// peak resident set size of the process in KB
+static long peak_rss_kb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return (long)(pmc.PeakWorkingSetSize / 1024);
+
+	return 0;
+#else
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_maxrss;	// KB on Linux
+#endif
+}
+
+static std::string num_str(const char* prefix, int n)
+{
+	char b[32];
+
+	sprintf(b, "%s%d", prefix, n);
+
+	return b;
+}
+
+
+ /// build a document with 'count' nodes below the root: groups of 1000 entries, each tenth one named "icon"
+static void build_doc(XMLDoc& doc, int count, int group_size=1000)
+{
+	XMLPos pos(&doc);
+
+	pos.create("root");
+
+	for(int g=0; count>0; ++g) {
+		pos.create("group");
+		pos["name"] = num_str("g", g);
+		--count;
+
+		for(int e=0; e<group_size && count>0; ++e, --count) {
+			pos.create(e%10==9? "icon": "entry");
+			pos["name"] = num_str("e", e);
+			pos["flag"] = e&1? "true": "false";
+			pos.back();
+		}
+
+		pos.back();
+	}
+}
+
+ /// count all nodes of a tree by iterating over the children lists
+static long count_nodes(const XMLNode* node)
+{
+	long cnt = 1;
+
+	const XMLNode::Children& children = node->get_children();
+
+	for(XMLNode::Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+		cnt += count_nodes(*it);
+
+	return cnt;
+}
+
+static void bench_queries(XMLDoc& doc, int count, const std::string& prefix)
+{
+	 // full tree traversal
+	int rounds = 10;
+	long nodes = 0;
+
+	double t = now_ms();
+	for(int i=0; i<rounds; ++i)
+		nodes += count_nodes(&doc);
+	report((prefix+"traverse").c_str(), nodes, now_ms()-t);
+
+	 // name filtered iteration
+	XMLPos pos(&doc);
+	pos.go_down("root");
+
+	long icons = 0;
+
+	t = now_ms();
+	for(int i=0; i<rounds; ++i) {
+		XMLChildrenFilter groups(pos, "group");
+
+		for(XMLChildrenFilter::iterator it=groups.begin(); it!=groups.end(); ++it) {
+			XMLChildrenFilter filter(*it, "icon");
+
+			for(XMLChildrenFilter::iterator it2=filter.begin(); it2!=filter.end(); ++it2)
+				++icons;
+		}
+	}
+	report((prefix+"filter").c_str(), icons, now_ms()-t);
+
+	 // XPath lookups deep in the tree
+	int groups = count / 1001;
+	int lookups = 2000;
+	int found = 0;
+
+	t = now_ms();
+	for(int i=0; i<lookups; ++i) {
+		XPath xpath(num_str("group[@name=\"g", i%(groups?groups:1)) + "\"]/icon[@name=\"e999\"]");
+
+		if (pos->find_relative(xpath))
+			++found;
+	}
+	report((prefix+"find").c_str(), lookups, now_ms()-t);
+
+	if (found != (groups? lookups: 0))
+		std::cout << prefix << "find: only " << found << " nodes found" << std::endl;
+}
+
+static void bench_children(int count)
+{
+	XMLDoc doc;
+
+	double t = now_ms();
+	build_doc(doc, count);
+	report("build", count, now_ms()-t);
+
+	bench_queries(doc, count, "");
+
+	 // the same queries on a parsed document, whose nodes use the atom table of the document
+	std::ostringstream out;
+	doc.write(out, FORMAT_PLAIN);
+
+	XMLDoc parsed;
+	std::string xml = out.str();
+
+	t = now_ms();
+	parsed.read_buffer(xml);
+	report("parse", count, now_ms()-t);
+
+	bench_queries(parsed, count, "parsed ");
+
+	t = now_ms();
+	doc.clear();
+	report("clear", count, now_ms()-t);
+}
+
+#ifdef XS_NATIVE
+
+ /// pull the group nodes out of a serialized document using XMLStreamReader
+static void bench_stream(int count)
+{
+	std::string xml;
+
+	{
+		XMLDoc doc;
+		build_doc(doc, count);
+
+		std::ostringstream out;
+		doc.write(out, FORMAT_PRETTY);
+		xml = out.str();
+	}
+
+	std::istringstream in(xml);
+	XMLStreamReader reader(in);
+
+	int groups = 0;
+
+	double t = now_ms();
+	if (reader.first_child("root"))
+		for(bool ok=reader.first_child("group"); ok; ok=reader.next_skip_others("group"))
+			++groups;
+	report("stream skip", (long)xml.length()/1024, now_ms()-t);	// KB of input
+
+	if (groups != (count+1000)/1001)
+		std::cout << "stream skip: " << groups << " groups found" << std::endl;
+}
+
+#endif // XS_NATIVE
+
+ /// serialized form of build_doc() without building the tree
+static std::string build_xml(int count, int group_size=1000)
+{
+	std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<root>\n";
+
+	for(int g=0; count>0; ++g) {
+		xml += "<group name=\"" + num_str("g", g) + "\">\n";
+		--count;
+
+		for(int e=0; e<group_size && count>0; ++e, --count) {
+			xml += e%10==9? "<icon": "<entry";
+			xml += " name=\"" + num_str("e", e) + "\" flag=\"";
+			xml += e&1? "true\"/>\n": "false\"/>\n";
+		}
+
+		xml += "</group>\n";
+	}
+
+	xml += "</root>\n";
+
+	return xml;
+}
+
+#ifdef XS_NATIVE
+
+ /// SAX handler counting icon elements with flag="true"
+struct IconCounter : public XMLSaxHandler
+{
+	IconCounter() : _elements(0), _icons(0) {}
+
+	void StartElementHandler(const XMLSlice& name, const XMLSaxAttributes& attributes)
+	{
+		++_elements;
+
+		if (name == "icon") {
+			const XMLSlice* flag = attributes.find("flag");
+
+			if (flag && *flag=="true")
+				++_icons;
+		}
+	}
+
+	long	_elements;
+	long	_icons;
+};
+
+static long count_icons(const XMLNode* node)
+{
+	long cnt = *node=="icon" && node->get("flag")=="true"? 1: 0;
+
+	const XMLNode::Children& children = node->get_children();
+
+	for(XMLNode::Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+		cnt += count_icons(*it);
+
+	return cnt;
+}
+
+ /// aggregate data of the same input through the SAX parser and through a parsed XMLDoc
+ // Run first, as the peak RSS of the process only grows.
+static void bench_sax(int count)
+{
+	std::string xml = build_xml(count);
+	long kb = (long)xml.length() / 1024;
+
+	long rss = peak_rss_kb();
+
+	IconCounter counter;
+	XMLSaxParser<IconCounter> parser(counter);
+
+	double t = now_ms();
+	parser.parse(xml);
+	report("sax parse", kb, now_ms()-t);	// KB of input
+
+	long sax_rss = peak_rss_kb() - rss;
+	rss += sax_rss;
+
+	long icons;
+
+	{
+		XMLDoc doc;
+
+		t = now_ms();
+		doc.read_buffer(xml);
+		icons = count_icons(&doc);
+		report("dom parse", kb, now_ms()-t);
+	}
+
+	long dom_rss = peak_rss_kb() - rss;
+
+	std::cout << "peak RSS growth: sax " << sax_rss << " KB, dom " << dom_rss << " KB" << std::endl;
+
+	if (icons != counter._icons)
+		std::cout << "sax parse: " << counter._icons << " icons, dom: " << icons << std::endl;
+}
+
+#endif // XS_NATIVE
+
+ /// copy a document, change one entry in the copy and release both
+static void bench_copy(int count)
+{
+	XMLDoc doc;
+	build_doc(doc, count);
+
+	 // copy and release repeatedly, reading the root children through each copy
+	const XMLNode* root = doc.get_first_child();
+	long groups = 0;
+
+	double t = now_ms();
+
+	for(int i=0; i<count; ++i) {
+		const XMLDoc copy(doc);
+		groups += (long)copy.get_first_child()->get_children().size();
+	}
+
+	report("doc copy", count, now_ms()-t);
+
+	if (groups != count*(long)root->get_children().size())
+		std::cout << "doc copy: " << groups << " root children read" << std::endl;
+
+	XMLDoc* copy = new XMLDoc(doc);
+
+	t = now_ms();
+	XMLPos pos(copy);
+	if (pos.go("root/group[2]/entry[5]"))
+		pos["flag"] = "changed";
+	report("copy write access", 1, now_ms()-t);
+
+	t = now_ms();
+	delete copy;
+	report("copy release", 1, now_ms()-t);
+
+	if (count_nodes(&doc) != count+2)
+		std::cout << "doc copy: original changed" << std::endl;
+}
+
+ /// read a big file serially and in parallel
+#ifdef XS_NATIVE
+
+static void bench_parallel(int count)
+{
+	const char* path = "xmlbench.tmp";
+
+	{
+		std::string xml = build_xml(count);
+		std::ofstream out(path, std::ios::binary);
+
+		out.write(xml.data(), xml.length());
+	}
+
+	long nodes;
+
+	{
+		XMLDoc doc;
+
+		double t = now_ms();
+		doc.read_file_mapped(path);
+		report("read mapped", count, now_ms()-t);
+
+		nodes = count_nodes(&doc);
+	}
+
+	{
+		XMLDoc doc;
+
+		double t = now_ms();
+		doc.read_file_parallel(path);
+		report("read parallel", count, now_ms()-t);
+
+		if (count_nodes(&doc) != nodes)
+			std::cout << "read parallel: " << count_nodes(&doc) << " nodes instead of " << nodes << std::endl;
+	}
+
+	remove(path);
+}
+
+#endif // XS_NATIVE
+
+ /// read the same input through all input paths of the compiled parser backend
+ // Compare the output of xmlbench and xmlbench-expat, see "make -f Makefile-xmlbench compare".
+static void bench_backend(int count)
+{
+	const char* path = "xmlbench-backend.tmp";
+	std::string xml;
+
+	{
+		XMLDoc doc;
+		build_doc(doc, count);
+
+		std::ostringstream out;
+		doc.write(out, FORMAT_PRETTY);
+		xml = out.str();
+
+		std::ofstream file(path, std::ios::binary);
+		file.write(xml.data(), xml.length());
+	}
+
+	long kb = (long)xml.length() / 1024;
+	long nodes = count + 2;	// root and document node
+
+	{
+		XMLDoc doc;
+
+		double t = now_ms();
+		doc.read_buffer(xml);
+		report("backend buffer", kb, now_ms()-t);	// KB of input
+
+		if (count_nodes(&doc) != nodes)
+			std::cout << "backend buffer: " << count_nodes(&doc) << " nodes instead of " << nodes << std::endl;
+	}
+
+	{
+		XMLDoc doc;
+		std::istringstream in(xml);
+
+		double t = now_ms();
+		doc.read_stream(in);
+		report("backend stream", kb, now_ms()-t);
+	}
+
+	{
+		XMLDoc doc;
+
+		double t = now_ms();
+		doc.read_file(path);
+		report("backend file", kb, now_ms()-t);
+	}
+
+	{
+		XMLDoc doc;
+
+		double t = now_ms();
+		doc.read_file_mapped(path);
+		report("backend mapped", kb, now_ms()-t);
+
+		if (count_nodes(&doc) != nodes)
+			std::cout << "backend mapped: " << count_nodes(&doc) << " nodes instead of " << nodes << std::endl;
+	}
+
+#ifdef XS_USE_EXPAT
+	static const struct {int size; const char* name;} chunks[] = {
+		{0x4000, "backend stream 16K"},
+		{0x40000, "backend stream 256K"},
+		{0x100000, "backend stream 1M"}
+	};
+
+	for(size_t i=0; i<COUNTOF(chunks); ++i) {
+		XMLDoc doc;
+		std::istringstream in(xml);
+		XMLReader reader(&doc, in);
+
+		reader.set_chunk_size(chunks[i].size);
+
+		double t = now_ms();
+		doc.read(reader, std::string());
+		report(chunks[i].name, kb, now_ms()-t);
+	}
+#endif
+
+	remove(path);
+}
+
+ /// load a document from XML text and from a binary snapshot
+ // Both loads report the best of three runs, as the first allocations after writing
+ // the snapshot are slowed down by growing the heap again.
+static void bench_snapshot(int count)
+{
+	const char* path = "xmlbench.tmp";
+	const char* snapshot_path = "xmlbench.xsb";
+
+	{
+		std::string xml = build_xml(count);
+		std::ofstream out(path, std::ios::binary);
+
+		out.write(xml.data(), xml.length());
+	}
+
+	long nodes;
+
+	{
+		XMLDoc doc;
+		doc.read_file(path);
+
+		nodes = count_nodes(&doc);
+
+		double t = now_ms();
+		doc.write_snapshot(snapshot_path);
+		report("write snapshot", count, now_ms()-t);
+	}
+
+	double xml_ms = 0, snapshot_ms = 0;
+
+	for(int run=0; run<3; ++run) {
+		{
+			XMLDoc doc;
+
+			double t = now_ms();
+			doc.read_file(path);
+			t = now_ms() - t;
+
+			if (!run || t<xml_ms)
+				xml_ms = t;
+		}
+
+		{
+			XMLDoc doc;
+
+			double t = now_ms();
+			doc.read_snapshot(snapshot_path);
+			t = now_ms() - t;
+
+			if (!run || t<snapshot_ms)
+				snapshot_ms = t;
+
+			if (count_nodes(&doc) != nodes)
+				std::cout << "read snapshot: " << count_nodes(&doc) << " nodes instead of " << nodes << std::endl;
+		}
+	}
+
+	report("read xml", count, xml_ms);
+	report("read snapshot", count, snapshot_ms);
+
+	remove(path);
+	remove(snapshot_path);
+}
+
+ /// output stream buffer discarding all data
+struct NullStreamBuf : public std::streambuf
+{
+	int overflow(int c) {return c;}
+	std::streamsize xsputn(const char*, std::streamsize n) {return n;}
+};
+
+template<typename WRITER> static void write_tree(WRITER& writer, const XMLNode* node)
+{
+	writer.create(*node);
+
+	const XMLNode::AttributeMap& attributes = node->get_attributes();
+
+	for(XMLNode::AttributeMap::const_iterator it=attributes.begin(); it!=attributes.end(); ++it)
+		writer.put(it->first, it->second);
+
+	const XMLNode::Children& children = node->get_children();
+
+	for(XMLNode::Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+		write_tree(writer, *it);
+
+	writer.back();
+}
+
+ /// export a large tree through XMLWriter and XMLStreamWriter
+static void bench_writer(int count)
+{
+	XMLDoc doc;
+	build_doc(doc, count);
+
+	NullStreamBuf sink;
+	std::ostream out(&sink);
+
+	double t = now_ms();
+	{
+		XMLWriter writer(out);
+		write_tree(writer, doc.get_children().front());
+	}
+	report("writer", count, now_ms()-t);
+
+	t = now_ms();
+	{
+		XMLStreamWriter writer(out);
+		write_tree(writer, doc.get_children().front());
+	}
+	report("stream writer", count, now_ms()-t);
+}
+
+ /// repeated writes of a document changing a single attribute between them
+static void bench_write_cache(int count)
+{
+	const int writes = 5;
+
+	XMLDoc doc;
+	build_doc(doc, count);
+
+	NullStreamBuf sink;
+	std::ostream out(&sink);
+
+	XMLNode* node = doc.get_children().front()->get_children().back();
+
+	double t = now_ms();
+	for(int i=0; i<writes; ++i) {
+		node->put("flag", i&1? "true": "false");
+		doc.write(out);
+	}
+	report("write full", writes, now_ms()-t);
+
+	XMLWriteCache cache;
+	doc.write(out, cache);
+
+	t = now_ms();
+	for(int i=0; i<writes; ++i) {
+		node->put("flag", i&1? "true": "false");
+		doc.write(out, cache);
+	}
+	report("write cached", writes, now_ms()-t);
+}
+
+ /// reference conversion: the Win32 API or a byte by byte loop without validation
+static size_t ref_utf8_to_utf16(const char* s, size_t l, XS_UTF16* out)
+{
+#ifdef _WIN32
+	return MultiByteToWideChar(CP_UTF8, 0, s, (int)l, out, (int)l);
+#else
+	const unsigned char* p = (const unsigned char*)s;
+	const unsigned char* end = p + l;
+	XS_UTF16* o = out;
+
+	while(p < end) {
+		unsigned c = *p++;
+
+		if (c < 0x80)
+			*o++ = (XS_UTF16)c;
+		else if (c<0xE0 && p<end)
+			*o++ = (XS_UTF16)(((c&0x1F)<<6) | (*p++&0x3F));
+		else if (c<0xF0 && end-p>=2) {
+			*o++ = (XS_UTF16)(((c&0x0F)<<12) | ((p[0]&0x3F)<<6) | (p[1]&0x3F));
+			p += 2;
+		} else if (end-p >= 3) {
+			unsigned cp = (((c&0x07)<<18) | ((p[0]&0x3F)<<12) | ((p[1]&0x3F)<<6) | (p[2]&0x3F)) - 0x10000;
+			*o++ = (XS_UTF16)(0xD800 | (cp>>10));
+			*o++ = (XS_UTF16)(0xDC00 | (cp&0x3FF));
+			p += 3;
+		} else
+			break;
+	}
+
+	return o - out;
+#endif
+}
+
+static size_t ref_utf16_to_utf8(const XS_UTF16* s, size_t l, char* out)
+{
+#ifdef _WIN32
+	return WideCharToMultiByte(CP_UTF8, 0, s, (int)l, out, (int)(3*l), 0, 0);
+#else
+	unsigned char* o = (unsigned char*)out;
+
+	for(const XS_UTF16* p=s,*end=s+l; p<end; ) {
+		unsigned c = *p++;
+
+		if (c < 0x80)
+			*o++ = (unsigned char)c;
+		else if (c < 0x800) {
+			*o++ = (unsigned char)(0xC0 | (c>>6));
+			*o++ = (unsigned char)(0x80 | (c&0x3F));
+		} else if (c>=0xD800 && c<=0xDBFF && p<end) {
+			unsigned cp = 0x10000 + ((c-0xD800)<<10) + (*p++ - 0xDC00);
+			*o++ = (unsigned char)(0xF0 | (cp>>18));
+			*o++ = (unsigned char)(0x80 | ((cp>>12)&0x3F));
+			*o++ = (unsigned char)(0x80 | ((cp>>6)&0x3F));
+			*o++ = (unsigned char)(0x80 | (cp&0x3F));
+		} else {
+			*o++ = (unsigned char)(0xE0 | (c>>12));
+			*o++ = (unsigned char)(0x80 | ((c>>6)&0x3F));
+			*o++ = (unsigned char)(0x80 | (c&0x3F));
+		}
+	}
+
+	return o - (unsigned char*)out;
+#endif
+}
+
+ /// build 'count' UTF-8 strings, 'cjk_percent' of the words are Chinese/Japanese
+static void build_utf8_strings(std::vector<std::string>& strings, int count, int cjk_percent)
+{
+	static const char* const cjk_words[] = {
+		"\xe8\xa8\xad\xe5\xae\x9a",				// settings
+		"\xe6\xa1\x8c\xe9\x9d\xa2",				// desktop
+		"\xe3\x83\x95\xe3\x82\xa1\xe3\x82\xa4\xe3\x83\xab",	// file
+		"\xe9\x96\x8b\xe5\xa7\x8b",				// start
+		"\xe9\x80\x9a\xe7\x9f\xa5\xe9\xa0\x98\xe5\x9f\x9f",	// notification area
+		"\xe3\x83\x97\xe3\x83\xad\xe3\x82\xb0\xe3\x83\xa9\xe3\x83\xa0"	// program
+	};
+
+	static const char* const ascii_words[] = {
+		"C:\\Program Files\\", "explorer.exe", "show-clock", "notify-icons",
+		"Documents and Settings", "hide-inactive", "1024", "true"
+	};
+
+	strings.resize(count);
+
+	for(int i=0; i<count; ++i) {
+		std::string& s = strings[i];
+		int words = 2 + i%7;
+
+		for(int w=0; w<words; ++w)
+			if ((i*7+w*13)%100 < cjk_percent)
+				s += cjk_words[(i+w)%6];
+			else {
+				s += ascii_words[(i+w)%8];
+				s += ' ';
+			}
+	}
+}
+
+ /// UTF-8 <-> UTF-16 conversion of configuration like strings into reused buffers
+static void bench_utf8(int count)
+{
+	static const struct {const char* name; int cjk_percent;} inputs[] = {
+		{"ascii", 0}, {"mixed", 50}, {"cjk", 90}
+	};
+
+	std::vector<XS_UTF16> wbuffer;
+	std::string buffer;
+
+	for(int i=0; i<3; ++i) {
+		std::vector<std::string> strings;
+		build_utf8_strings(strings, count, inputs[i].cjk_percent);
+
+		size_t max_len = 0;
+		for(int j=0; j<count; ++j)
+			if (strings[j].length() > max_len)
+				max_len = strings[j].length();
+
+		wbuffer.resize(max_len);
+		buffer.resize(3*max_len);
+
+		std::string name = std::string("utf8->16 ") + inputs[i].name;
+		size_t total = 0;
+
+		double t = now_ms();
+		for(int j=0; j<count; ++j)
+			total += utf8_to_utf16(strings[j].data(), strings[j].length(), &wbuffer[0]);
+		report(name.c_str(), count, now_ms()-t);
+
+		t = now_ms();
+		for(int j=0; j<count; ++j)
+			total -= ref_utf8_to_utf16(strings[j].data(), strings[j].length(), &wbuffer[0]);
+		report((name+" ref").c_str(), count, now_ms()-t);
+
+		if (total)
+			std::cout << name << ": different output lengths" << std::endl;
+
+		 // convert back from UTF-16
+		std::vector<std::vector<XS_UTF16> > wstrings(count);
+
+		for(int j=0; j<count; ++j) {
+			wstrings[j].resize(strings[j].length());
+			wstrings[j].resize(utf8_to_utf16(strings[j].data(), strings[j].length(), &wstrings[j][0]));
+		}
+
+		name = std::string("utf16->8 ") + inputs[i].name;
+
+		t = now_ms();
+		for(int j=0; j<count; ++j)
+			total += utf16_to_utf8(&wstrings[j][0], wstrings[j].size(), &buffer[0]);
+		report(name.c_str(), count, now_ms()-t);
+
+		t = now_ms();
+		for(int j=0; j<count; ++j)
+			total -= ref_utf16_to_utf8(&wstrings[j][0], wstrings[j].size(), &buffer[0]);
+		report((name+" ref").c_str(), count, now_ms()-t);
+
+		if (total)
+			std::cout << name << ": different output lengths" << std::endl;
+	}
+}
+
+ /// repeated lookups of configuration paths below a node with many children
+static void bench_config(int lookups)
+{
+	XMLDoc doc;
+	XMLPos pos(&doc);
+
+	pos.create("explorer-cfg");
+
+	int sections = 200;
+
+	for(int i=0; i<sections; ++i) {
+		pos.create(num_str("section", i));
+		pos.create("options");
+		pos.back();
+		pos.back();
+	}
+
+	std::vector<std::string> paths;
+
+	for(int i=0; i<sections; i+=10)
+		paths.push_back(num_str("section", i) + "/options");
+
+	 // parse the XPath for each access and scan the children
+	int found = 0;
+
+	double t = now_ms();
+	for(int i=0; i<lookups; ++i) {
+		const XMLNode* node = pos->find_relative(XPath(paths[i%paths.size()]));
+
+		if (node)
+			++found;
+	}
+	report("cfg lookup", lookups, now_ms()-t);
+
+	 // cached XPath expressions using the child index
+	XPathCache cache;
+
+	t = now_ms();
+	for(int i=0; i<lookups; ++i) {
+		const XMLNode* node = pos->find_relative(cache.get(paths[i%paths.size()]));
+
+		if (node)
+			++found;
+	}
+	report("cfg lookup cached", lookups, now_ms()-t);
+
+	if (found != 2*lookups)
+		std::cout << "cfg lookup: only " << found << " nodes found" << std::endl;
+}
+
+
+ // typed settings read on every paint or timer tick
+static void bench_settings(int reads)
+{
+	XMLDoc doc;
+	XMLPos pos(&doc);
+
+	pos.create("desktopbar");
+	pos["show-clock"] = "TRUE";
+	pos["hide-inactive"] = "FALSE";
+	pos["icon-size"] = "32";
+	pos["opacity"] = "0.85";
+
+	const XMLNode* node = &*pos;
+	long sum = 0;
+
+	double t = now_ms();
+	for(int i=0; i<reads; ++i)
+		if (XMLBool(node, "show-clock") && !XMLBool(node, "hide-inactive"))
+			sum += XMLInt(node, "icon-size") + (int)XMLDouble(node, "opacity");
+	report("setting read", 4L*reads, now_ms()-t);
+
+	XMLBoolRef show_clock(&*pos, "show-clock");
+	XMLIntRef icon_size(&*pos, "icon-size");
+
+	t = now_ms();
+	for(int i=0; i<reads; ++i)
+		if (show_clock)
+			sum += icon_size;
+	report("setting ref read", 2L*reads, now_ms()-t);
+
+	 // each write invalidates the cached value
+	t = now_ms();
+	for(int i=0; i<reads; ++i) {
+		icon_size = 16 + (i&15);
+		sum += icon_size;
+	}
+	report("setting write+read", 2L*reads, now_ms()-t);
+
+	if (XMLInt(node, "icon-size") != 16+((reads-1)&15) || sum <= 0)
+		std::cout << "setting read: wrong value" << std::endl;
+}
+
+ /// attribute access on elements with many attributes
+static void bench_attributes(int elements, int attrs)
+{
+	XMLDoc doc;
+	XMLPos pos(&doc);
+
+	pos.create("root");
+
+	std::vector<std::string> names;
+
+	for(int a=0; a<attrs; ++a)
+		names.push_back(num_str("attribute", (a*7919)%attrs));	// insert in unsorted order
+
+	double t = now_ms();
+	for(int e=0; e<elements; ++e) {
+		pos.create("wide");
+
+		for(int a=0; a<attrs; ++a)
+			pos[names[a]] = "value";
+
+		pos.back();
+	}
+	report("attr insert", (long)elements*attrs, now_ms()-t);
+
+	long hits = 0;
+	const XMLNode::Children& children = pos->get_children();
+
+	t = now_ms();
+	for(XMLNode::Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+		for(int a=0; a<attrs; ++a)
+			if (!(*it)->get(names[a]).empty())
+				++hits;
+	report("attr lookup", hits, now_ms()-t);
+
+	 // parse the attribute heavy document and read one attribute per element
+	std::ostringstream out;
+	doc.write(out);
+	std::string xml = out.str();
+
+	XMLDoc parsed;
+
+	t = now_ms();
+	parsed.read_buffer(xml);
+	report("attr parse", (long)elements*attrs, now_ms()-t);
+
+	hits = 0;
+	const XMLNode::Children& parsed_children = parsed.get_children().front()->get_children();
+
+	t = now_ms();
+	for(XMLNode::Children::const_iterator it=parsed_children.begin(); it!=parsed_children.end(); ++it)
+		if (!(*it)->get(names[0]).empty())
+			++hits;
+	report("attr first lookup", hits, now_ms()-t);
+}
+
+
+ // regression suite on synthetic documents
+
+static const int SUITE_DEPTH = 100;	// nesting depth of the "deep" documents
+
+ /// synthetic XML text of about 'size' bytes
+ // deep: nested chains of SUITE_DEPTH elements, wide: one level of small elements,
+ // attrs: elements with 32 attributes, text: elements with escaped text content
+static std::string build_suite_xml(const std::string& shape, size_t size)
+{
+	std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<root>\n";
+
+	xml.reserve(size + 4096);
+
+	for(int n=0; xml.length()<size; ++n) {
+		if (shape == "deep") {
+			for(int d=0; d<SUITE_DEPTH; ++d)
+				xml += "<level n=\"" + num_str("", n) + "\">";
+
+			xml += num_str("leaf", n);
+
+			for(int d=0; d<SUITE_DEPTH; ++d)
+				xml += "</level>";
+
+			xml += "\n";
+		} else if (shape == "wide") {
+			xml += "<item id=\"" + num_str("", n) + "\" flag=\"" + (n&1? "true": "false") + "\"/>\n";
+		} else if (shape == "attrs") {
+			xml += "<rec";
+
+			for(int a=0; a<32; ++a)
+				xml += num_str(" a", a) + "=\"" + num_str("value", n+a) + "\"";
+
+			xml += "/>\n";
+		} else { // text
+			xml += "<para id=\"" + num_str("", n) + "\">";
+
+			for(int w=0; w<16; ++w)
+				xml += "Lorem ipsum dolor sit amet &amp; consectetur &lt;adipiscing&gt; elit. ";
+
+			xml += "</para>\n";
+		}
+	}
+
+	xml += "</root>\n";
+
+	return xml;
+}
+
+ /// XPath expression to look up a node in the middle of a suite document with 'n' root children
+static std::string suite_xpath(const std::string& shape, int n)
+{
+	if (shape == "deep") {
+		std::string path = "root/level[" + num_str("", n/2+1) + "]";
+
+		for(int d=1; d<SUITE_DEPTH; ++d)
+			path += "/level";
+
+		return path;
+	} else if (shape == "wide")
+		return "root/item[@id='" + num_str("", n/2) + "']";
+	else if (shape == "attrs")
+		return "root/rec[@a31='" + num_str("value", n/2+31) + "']";
+	else
+		return "root/para[@id='" + num_str("", n/2) + "']";
+}
+
+static void collect_nodes(XMLNode* node, std::vector<XMLNode*>& nodes)
+{
+	nodes.push_back(node);
+
+	XMLNode::Children& children = node->get_children();
+
+	for(XMLNode::Children::iterator it=children.begin(); it!=children.end(); ++it)
+		collect_nodes(*it, nodes);
+}
+
+ /// print one measurement as JSON object: throughput in MB/s for 'bytes' and in ops/s for 'ops'
+static void report_json(const std::string& shape, size_t size, const char* op, double ms,
+						size_t bytes, long ops, const AllocStats& before, bool ok=true)
+{
+	AllocStats after;
+	char line[512];
+
+	sprintf(line, "{\"shape\":\"%s\",\"size\":%lu,\"op\":\"%s\",\"ms\":%.3f,\"bytes\":%lu,\"mb_per_s\":%.1f,"
+				"\"ops\":%ld,\"ops_per_s\":%.0f,\"allocs\":%ld,\"alloc_bytes\":%ld,\"peak_rss_kb\":%ld,\"ok\":%s}",
+			shape.c_str(), (unsigned long)size, op, ms, (unsigned long)bytes, ms>0? bytes/1048.576/ms: 0.,
+			ops, ms>0? ops*1000./ms: 0., after._count-before._count, after._bytes-before._bytes,
+			peak_rss_kb(), ok? "true": "false");
+
+	std::cout << line << std::endl;
+}
+
+static void suite_write(const XMLDoc& doc, const std::string& shape, size_t size, const char* op, WRITE_MODE mode, std::string& out_str)
+{
+	std::ostringstream out;
+
+	AllocStats allocs;
+	double t = now_ms();
+	doc.write(out, mode);
+	double ms = now_ms() - t;
+
+	out_str = out.str();
+	report_json(shape, size, op, ms, out_str.length(), 0, allocs);
+}
+
+ /// parse, look up, change, write and re-read one synthetic document
+static void run_suite_doc(const std::string& shape, size_t size)
+{
+	std::string xml = build_suite_xml(shape, size);
+	XMLDoc doc;
+
+	AllocStats allocs;
+	double t = now_ms();
+	bool ok = doc.read_buffer(xml);
+	report_json(shape, size, "parse", now_ms()-t, xml.length(), 0, allocs, ok);
+
+	if (!ok || doc.get_children().empty())
+		return;
+
+	XPath xpath(suite_xpath(shape, (int)doc.get_children().front()->get_children().size()));
+	const int lookups = 1000;
+	int found = 0;
+
+	allocs = AllocStats();
+	t = now_ms();
+	for(int i=0; i<lookups; ++i)
+		if (doc.find_relative(xpath))
+			++found;
+	report_json(shape, size, "xpath", now_ms()-t, 0, lookups, allocs, found==lookups);
+
+	std::vector<XMLNode*> nodes;
+	collect_nodes(&doc, nodes);
+
+	allocs = AllocStats();
+	t = now_ms();
+	for(size_t i=1; i<nodes.size(); ++i)
+		nodes[i]->put(XS_TEXT("m"), XS_TEXT("1"));
+	report_json(shape, size, "mutate", now_ms()-t, 0, (long)nodes.size()-1, allocs);
+
+	std::string plain, smart, pretty;
+
+	suite_write(doc, shape, size, "write plain", FORMAT_PLAIN, plain);
+	suite_write(doc, shape, size, "write smart", FORMAT_SMART, smart);
+	suite_write(doc, shape, size, "write pretty", FORMAT_PRETTY, pretty);
+
+	 // read back the written document and compare its output
+	{
+		XMLDoc doc2;
+
+		allocs = AllocStats();
+		t = now_ms();
+		ok = doc2.read_buffer(smart);
+
+		std::ostringstream out;
+		doc2.write(out, FORMAT_SMART);
+		report_json(shape, size, "round trip", now_ms()-t, smart.length(), 0, allocs, ok && out.str()==smart);
+	}
+}
+
+ /// run the regression suite for all document shapes and sizes from 'min_size' to 'max_size' in steps of factor 16
+static void run_suite(size_t min_size, size_t max_size)
+{
+	static const char* shapes[] = {"deep", "wide", "attrs", "text"};
+
+	for(size_t size=min_size; size<=max_size; size*=16)
+		for(size_t s=0; s<COUNTOF(shapes); ++s)
+			run_suite_doc(shapes[s], size);
+}
+
+ /// parse sizes like "1024", "64K", "16M" or "1G"
+static size_t parse_size(const char* s)
+{
+	char* end;
+	size_t size = strtoul(s, &end, 10);
+
+	switch(toupper(*end)) {
+	  case 'K':	size <<= 10; break;
+	  case 'M':	size <<= 20; break;
+	  case 'G':	size <<= 30; break;
+	}
+
+	return size;
+}
+
+
+int main(int argc, char** argv)
+{
+	 // "xmlbench suite [max-size] [min-size]" only runs the regression suite, default 1K to 16M
+	if (argc>1 && !strcmp(argv[1], "suite")) {
+		run_suite(argc>3? parse_size(argv[3]): 1024, argc>2? parse_size(argv[2]): 16<<20);
+		return 0;
+	}
+
+	int count = argc>1? atoi(argv[1]): 1000000;
+
+#ifdef XS_USE_EXPAT
+	std::cout << "parser backend: Expat" << std::endl;
+#else
+	std::cout << "parser backend: native" << std::endl;
+#endif
+
+	 // "xmlbench <count> backend" only runs the backend comparison
+	if (argc>2 && !strcmp(argv[2], "backend")) {
+		bench_backend(count);
+		return 0;
+	}
+
+#ifdef XS_LIST_CHILDREN
+	std::cout << "children container: std::list" << std::endl;
+#else
+	std::cout << "children container: std::vector" << std::endl;
+#endif
+
+#ifdef XS_NATIVE
+	bench_sax(count);
+#endif
+	bench_children(count);
+	bench_attributes(count/64, 64);
+	bench_config(count/10);
+	bench_settings(count*5);
+#ifdef XS_NATIVE
+	bench_stream(count);
+#endif
+	bench_writer(count);
+	bench_write_cache(count);
+	bench_copy(count);
+	bench_utf8(count);
+	bench_backend(count);
+#ifdef XS_NATIVE
+	bench_parallel(count);
+#endif
+	bench_snapshot(count);
+
+	return 0;
+}
@@ -37,13 +37,30 @@
 
 */
 
+#ifndef XS_NO_PRECOMP
 #include <precomp.h>
+#endif
 
 #ifndef XS_NO_COMMENT
 #define XS_NO_COMMENT	// no #pragma comment(lib, ...) statements in .lib files to enable static linking
 #endif
 
-//#include "xmlstorage.h"
+#ifdef XS_NO_PRECOMP	// standalone build, see Makefile-xmlbench
+#include "xmlstorage.h"
+#endif
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#else
+#include <io.h>
+#endif
 
 
 namespace XMLStorage {
@@ -109,6 +126,214 @@ inline XS_String unescape(LPCXSSTR s, size_t l)
 }
 
 
+const XMLChildIndex* XMLNode::get_child_index() const
+{
+	const Children& children = get_children();
+	const XMLChildIndex* index = _child_index;
+
+	if (index && index->_list==&children && index->_gen==children._gen && index->_count==children.size())
+		return index;
+	else
+		return NULL;
+}
+
+const XMLChildIndex* XMLNode::get_child_index()
+{
+	const Children& children = static_cast<const XMLNode*>(this)->get_children();	// without detaching
+	size_t count = children.size();
+
+	if (count < XS_CHILD_INDEX_MIN)
+		return NULL;
+
+	if (_child_index && (_child_index->_list!=&children || _child_index->_gen!=children._gen)) {
+		delete _child_index;
+		_child_index = NULL;
+	}
+
+	if (!_child_index) {
+		need_cleanup();
+		_child_index = new XMLChildIndex;
+		_child_index->_list = &children;
+		_child_index->_gen = children._gen;
+		_child_index->_count = 0;
+	}
+
+	 // add the children appended since the last call
+	if (_child_index->_count < count) {
+		Children::const_iterator it = children.begin();
+		std::advance(it, _child_index->_count);
+
+		for(; it!=children.end(); ++it)
+			_child_index->_map[**it].push_back(*it);
+
+		_child_index->_count = count;
+	}
+
+	return _child_index;
+}
+
+ /// share the children list with a new copy of this node
+XMLNode::SharedChildren* XMLNode::share_children() const
+{
+	SharedChildren* shared = _shared;
+
+	if (!shared) {
+		if (_children.empty())
+			return NULL;
+
+		 // The node keeps its own list, so concurrent readers and copies of it aren't disturbed.
+		need_cleanup();
+		shared = new SharedChildren(this);
+		shared->_nodes.share(_children);
+
+		SharedChildren* prev = (SharedChildren*) xs_atomic_cas_ptr((void* volatile*)&_shared, shared, NULL);
+
+		if (prev) {
+			 // another thread has been faster
+			delete shared;
+			shared = prev;
+		}
+	}
+
+	xs_atomic_inc(&shared->_refs);
+
+	return shared;
+}
+
+ /// stop sharing the children list, cloning the shared nodes if 'keep' is set
+ // The node the list has been taken from keeps its original nodes and leaves clones to the other
+ // users, so pointers to nodes of the original stay valid and the copies don't depend on memory of
+ // the original document like its arena or its memory mapped input.
+void XMLNode::detach_children(bool keep)
+{
+	SharedChildren* shared = _shared;
+
+	if (!shared)
+		return;
+
+	_shared = NULL;
+
+	if (shared->_owner == this) {
+		if (xs_atomic_get(&shared->_refs) > 1) {
+			 // Publish the clones in a list of their own and leave the list of the originals untouched,
+			 // as copies on other threads may still be reading it.
+			Children* clones = new Children;
+			clones->copy(_children);
+			xs_atomic_cas_ptr((void* volatile*)&shared->_clones, clones, NULL);
+		}
+
+		shared->_owner = NULL;
+	} else {
+		delete _child_index;
+		_child_index = NULL;
+
+		if (xs_atomic_get(&shared->_refs) == 1) {
+			if (shared->_clones)
+				_children.move(*shared->_clones);	// last user of the list
+		} else if (keep)
+			_children.copy(shared->get_nodes());
+	}
+
+	if (!xs_atomic_dec(&shared->_refs))
+		delete shared;
+}
+
+ /// release the memory of an arena node outside of the arena, see XMLArena::release()
+ // Before destroying any node, all nodes stop sharing their children with nodes outside of the arena.
+void XMLNode::cleanup(void* obj, bool destroy)
+{
+	XMLNode* node = (XMLNode*) obj;
+
+	if (!destroy) {
+		node->detach_arena_children();
+		return;
+	}
+
+	node->_cleanup = NULL;
+
+	 // nodes listed by other nodes outside of the arena are destroyed together with their parent
+	if (node->_parent && !node->_parent->_arena_alloc)
+		return;
+
+	node->release_children();
+	node->~XMLNode();
+}
+
+ /// stop sharing the children with copies, continuing with the arena nodes shared by the clones left to them
+void XMLNode::detach_arena_children()
+{
+	if (!_shared)
+		return;
+
+	bool owner = _shared->_owner == this;
+
+	detach_children(false);
+
+	if (owner)
+		for(Children::iterator it=_children.begin(); it!=_children.end(); ++it)
+			if ((*it)->_arena_alloc)
+				(*it)->detach_arena_children();
+}
+
+ /// delete the children, only forgetting arena nodes which clean up on their own if needed
+void XMLNode::release_children()
+{
+	for(Children::iterator it=_children.begin(); it!=_children.end(); ++it) {
+		XMLNode* child = *it;
+
+		if (child->_arena_alloc)
+			child->_parent = NULL;
+		else
+			delete child;
+	}
+
+	_children.reset();
+}
+
+ /// detach the children lists of the ancestors sharing this node with copies, top down
+ // Detaching an ancestor lets the clones share the children of the originals on the path below,
+ // so this continues until the parent of this node keeps its children for its own.
+void XMLNode::unshare_ancestors()
+{
+	for(;;) {
+		XMLNode* top = NULL;
+
+		for(XMLNode* node=_parent; node; node=node->_parent)
+			if (node->_shared)
+				top = node;
+
+		if (!top)
+			break;
+
+		top->detach_children();
+	}
+}
+
+
+const XPath& XPathCache::get(const XS_String& path)
+{
+	std::map<XS_String, Entries::iterator>::iterator found = _map.find(path);
+
+	if (found != _map.end()) {
+		 // move to the front of the LRU list
+		_entries.splice(_entries.begin(), _entries, found->second);
+
+		return found->second->second;
+	}
+
+	_entries.push_front(std::make_pair(path, XPath()));
+	_entries.front().second.init(path.c_str());
+	_map[path] = _entries.begin();
+
+	if (_entries.size() > _capacity) {
+		_map.erase(_entries.back().first);
+		_entries.pop_back();
+	}
+
+	return _entries.front().second;
+}
+
+
  /// move to the position defined by xpath in XML tree
 bool XMLPos::go(const XPath& xpath)
 {
@@ -202,20 +427,40 @@ LPCXSSTR XPathElement::parse(LPCXSSTR path)
 
 XMLNode* XPathElement::find(XMLNode* node) const
 {
-	int n = 0;
+	 // A copy must not hand out the nodes it shares with the original for write access. Lookups in the
+	 // original leave the lists alone, changes of the found node call prepare_write() on their own.
+	XMLNode::SharedChildren* shared = node->_shared;
 
-	for(XMLNode::Children::const_iterator it=node->_children.begin(); it!=node->_children.end(); ++it)
-		if (matches(**it, n))
-			return *it;
+	if (shared && shared->_owner!=node)
+		node->detach_children();
 
-	return NULL;
+	if (_child_name != XS_TEXT("*"))
+		node->get_child_index();	// build the index used by const_find()
+
+	return const_cast<XMLNode*>(const_find(node));
 }
 
 const XMLNode* XPathElement::const_find(const XMLNode* node) const
 {
 	int n = 0;
 
-	for(XMLNode::Children::const_iterator it=node->_children.begin(); it!=node->_children.end(); ++it)
+	 // only look at the children with matching name if there is an index
+	const XMLChildIndex* index = _child_name!=XS_TEXT("*")? node->get_child_index(): NULL;
+
+	if (index) {
+		const XMLChildIndex::NodeList* children = index->find(_child_name);
+
+		if (children)
+			for(XMLChildIndex::NodeList::const_iterator it=children->begin(); it!=children->end(); ++it)
+				if (matches(**it, n))
+					return *it;
+
+		return NULL;
+	}
+
+	const XMLNode::Children& children = node->get_children();
+
+	for(XMLNode::Children::const_iterator it=children.begin(); it!=children.end(); ++it)
 		if (matches(**it, n))
 			return *it;
 
@@ -224,7 +469,7 @@ const XMLNode* XPathElement::const_find(const XMLNode* node) const
 
 bool XPathElement::matches(const XMLNode& node, int& n) const
 {
-	if (node != _child_name)
+	if (!_name_atom.matches(node, _child_name))
 		if (_child_name != XS_TEXT("*"))	// use asterisk as wildcard
 			return false;
 
@@ -323,7 +568,9 @@ int XMLNode::count(XPath::const_iterator from, const XPath::const_iterator& to)
 	int cnt = 0;
 	int n = 0;
 
-	for(XMLNode::Children::const_iterator it=_children.begin(); it!=_children.end(); ++it)
+	const Children& children = get_children();
+
+	for(Children::const_iterator it=children.begin(); it!=children.end(); ++it)
 		if (elem.matches(**it, n)) {
 			if (from != to)
 				 // iterate deeper
@@ -344,8 +591,12 @@ bool XMLNode::filter(const XPath& xpath, XMLNode& target) const
 		return false;
 
 	 // move returned nodes to target node
+	target.prepare_write();
+	target.detach_children();
 	target._children.move(ret->_children);
 	target._attributes = ret->_attributes;
+	target.need_cleanup();
+	target._modified = true;
 
 	delete ret;
 
@@ -361,7 +612,9 @@ XMLNode* XMLNode::filter(XPath::const_iterator from, const XPath::const_iterator
 	int cnt = 0;
 	int n = 0;
 
-	for(XMLNode::Children::const_iterator it=_children.begin(); it!=_children.end(); ++it)
+	const Children& children = get_children();
+
+	for(Children::const_iterator it=children.begin(); it!=children.end(); ++it)
 		if (elem.matches(**it, n)) {
 			if (!copy)
 				copy = new XMLNode(*this, XMLNode::COPY_NOCHILDREN);
@@ -388,531 +641,2139 @@ XMLNode* XMLNode::filter(XPath::const_iterator from, const XPath::const_iterator
 }
 
 
- /// encode XML string literals
-std::string EncodeXMLString(const XS_String& str, bool cdata)
-{
-	LPCXSSTR s = str.c_str();
-	size_t l = XS_len(s);
-
-	if (cdata) {
-		 // encode the whole string in a CDATA section
-		std::string ret = CDATA_START;
-
-#ifdef XS_STRING_UTF8
-		ret += str;
-#else
-		ret += get_utf8(str);
+ // SIMD kernels for scanning XML text with runtime CPU dispatch
+ // define XS_NO_SIMD to use only the scalar code
+
+#if !defined(XS_NO_SIMD) && (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#if defined(_MSC_VER) && _MSC_VER>=1700
+#define XS_SIMD_SSE2
+#define XS_SIMD_AVX2
+#define XS_TARGET_SSE2
+#define XS_TARGET_AVX2
+#elif defined(_MSC_VER) && _MSC_VER>=1400
+#define XS_SIMD_SSE2
+#define XS_TARGET_SSE2
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__>4 || (__GNUC__==4 && __GNUC_MINOR__>=9)))
+#define XS_SIMD_SSE2
+#define XS_SIMD_AVX2
+#define XS_TARGET_SSE2 __attribute__((target("sse2")))
+#define XS_TARGET_AVX2 __attribute__((target("avx2")))
 #endif
-
-#ifdef XS_STRICT_XML_1_0
-		for(char*p=&ret.at(9); *p; ++p) // strlen(CDATA_START) == 9
-			if ((unsigned)*p<0x20 && *p!='\t' && *p!='\r' && *p!='\n')
-				*p = '?';
 #endif
 
-		ret += CDATA_END;
-
-		return ret;
-	} else if (l <= BUFFER_LEN) {
-		LPXSSTR buffer = (LPXSSTR)alloca(6*sizeof(XS_CHAR)*XS_len(s));	// worst case "&quot;" / "&apos;"
-		LPXSSTR o = buffer;
-
-		for(LPCXSSTR p=s; *p; ++p)
-			switch(*p) {
-			  case '&':
-				*o++ = '&';	*o++ = 'a';	*o++ = 'm';	*o++ = 'p';	*o++ = ';';				// "&amp;"
-				break;
-
-			  case '<':
-				*o++ = '&';	*o++ = 'l'; *o++ = 't';	*o++ = ';';							// "&lt;"
-				break;
-
-			  case '>':
-				*o++ = '&';	*o++ = 'g'; *o++ = 't';	*o++ = ';';							// "&gt;"
-				break;
-
-			  case '"':
-				*o++ = '&';	*o++ = 'q'; *o++ = 'u'; *o++ = 'o'; *o++ = 't';	*o++ = ';';	// "&quot;"
-				break;
-
-			  case '\'':
-				*o++ = '&';	*o++ = 'a'; *o++ = 'p'; *o++ = 'o'; *o++ = 's';	*o++ = ';';	// "&apos;"
-				break;
-
-			  default:
-				if ((unsigned)*p>=0x20 || *p=='\t' || *p=='\r' || *p=='\n')
-					*o++ = *p;
-				else {
-#ifdef XS_STRICT_XML_1_0
-					*o++ = '?';
-#else
-					char b[16];
-					sprintf(b, "&#%d;", (unsigned)*p);
-					for(const char*q=b; *q; )
-						*o++ = *q++;
+#ifdef XS_SIMD_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
 #endif
-				}
-			}
-
-#ifdef XS_STRING_UTF8
-		return XS_String(buffer, o-buffer);
+#ifdef XS_SIMD_AVX2
+#include <immintrin.h>
 #else
-		return get_utf8(buffer, o-buffer);
+#include <emmintrin.h>
 #endif
-	} else { // l > BUFFER_LEN
-		 // alternative code for larger strings using ostringstream
-		 // and avoiding to use alloca() for preallocated memory
-		fast_ostringstream out;
-
-#ifdef XS_STRING_UTF8
-		LPCXSSTR s = str.c_str();
-#else
-		std::string utf8_str = get_utf8(str);
-		const char* s = utf8_str.c_str();
 #endif
 
-		for(const char* p=s; *p; ++p)
-			switch(*p) {
-			  case '&':
-				out << "&amp;";
-				break;
 
-			  case '<':
-				out << "&lt;";
-				break;
+static inline bool is_xml_special(unsigned char c)
+{
+	switch(c) {
+	  case '&': case '<': case '>': case '"': case '\'':
+		return true;
 
-			  case '>':
-				out << "&gt;";
-				break;
+	  default:
+		return c<0x20 && c!='\t' && c!='\r' && c!='\n';
+	}
+}
 
-			  case '"':
-				out << "&quot;";
-				break;
+static const char* find_xml_special_scalar(const char* p, const char* end)
+{
+	while(p<end && !is_xml_special(*p))
+		++p;
 
-			  case '\'':
-				out << "&apos;";
-				break;
+	return p;
+}
 
-			  default:
-				if ((unsigned)*p>=0x20 || *p=='\t' || *p=='\r' || *p=='\n')
-					out << (unsigned char)*p;
-				else {
-#ifdef XS_STRICT_XML_1_0
-					out << '?';
-#else
-					out << "&#" << (unsigned)*p << ";";
-#endif
-				}
-			}
+static const char* find_xml_char_scalar(const char* p, const char* end, char c)
+{
+	const char* found = (const char*) memchr(p, c, end-p);
 
-#ifdef XS_STRING_UTF8
-		return XS_String(out.str());
-#else
-		return out.str();
-#endif
-	}
+	return found? found: end;
 }
 
- /// decode XML string literals
-XS_String DecodeXMLString(const std::string& str_utf8)
+#ifdef XS_SIMD_SSE2
+
+ // index of the lowest bit set in a non-zero mask
+static inline unsigned first_bit(unsigned mask)
 {
-#ifdef XS_STRING_UTF8
-	const XS_String& str = str_utf8;
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return idx;
 #else
-	XS_String str;
-	assign_utf8(str, str_utf8.c_str(), str_utf8.length());
+	return __builtin_ctz(mask);
 #endif
+}
 
-	LPCXSSTR s = str.c_str();
-	size_t l = XS_len(s);
+XS_TARGET_SSE2 static const char* find_xml_special_sse2(const char* p, const char* end)
+{
+	const __m128i amp = _mm_set1_epi8('&');
+	const __m128i lt = _mm_set1_epi8('<');
+	const __m128i gt = _mm_set1_epi8('>');
+	const __m128i quot = _mm_set1_epi8('"');
+	const __m128i apos = _mm_set1_epi8('\'');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i ctrl_max = _mm_set1_epi8(0x1F);
+
+	for(; end-p>=16; p+=16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+
+		__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, lt)),
+					_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, gt), _mm_cmpeq_epi8(v, quot)), _mm_cmpeq_epi8(v, apos)));
+
+		 // unsigned compare c <= 0x1F, excluding TAB, CR and LF
+		__m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl_max), v);
+		__m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, cr)), _mm_cmpeq_epi8(v, lf));
+
+		unsigned mask = _mm_movemask_epi8(_mm_or_si128(m, _mm_andnot_si128(ws, ctrl)));
+
+		if (mask)
+			return p + first_bit(mask);
+	}
 
-	TMP_ALLOC(XS_CHAR, buffer, heap, l);
+	return find_xml_special_scalar(p, end);
+}
 
-	LPXSSTR o = buffer;
-	for(LPCXSSTR p=s; *p; ++p)
-		if (*p == '&') {
-			if (!XS_nicmp(p+1, XS_TEXT("lt;"), 3)) {
-				*o++ = '<';
-				p += 3;
-			} else if (!XS_nicmp(p+1, XS_TEXT("gt;"), 3)) {
-				*o++ = '>';
-				p += 3;
-			} else if (!XS_nicmp(p+1, XS_TEXT("amp;"), 4)) {
-				*o++ = '&';
-				p += 4;
-			} else if (!XS_nicmp(p+1, XS_TEXT("quot;"), 5)) {
-				*o++ = '"';
-				p += 5;
-			} else if (!XS_nicmp(p+1, XS_TEXT("apos;"), 5)) {
-				*o++ = '\'';
-				p += 5;
-			} else	//@@ maybe decode "&#xx;" special characters
-				*o++ = *p;
-		} else if (*p=='<' && !XS_nicmp(p+1,XS_TEXT("![CDATA["),8)) {
-			LPCXSSTR e = XS_strstr(p+9, XS_TEXT(CDATA_END));
-			if (e) {
-				p += 9;
-				size_t l = e - p;
-				memcpy(o, p, l);
-				o += l;
-				p = e + 2;
-			} else
-				*o++ = *p;
-		} else
-			*o++ = *p;
+XS_TARGET_SSE2 static const char* find_xml_char_sse2(const char* p, const char* end, char c)
+{
+	const __m128i pattern = _mm_set1_epi8(c);
 
-	return XS_String(buffer, o-buffer);
+	for(; end-p>=16; p+=16) {
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), pattern));
+
+		if (mask)
+			return p + first_bit(mask);
+	}
+
+	return find_xml_char_scalar(p, end, c);
 }
 
+#endif // XS_SIMD_SSE2
 
- /// write node with children tree to output stream using original white space
-void XMLNode::original_write_worker(std::ostream& out) const
+#ifdef XS_SIMD_AVX2
+
+XS_TARGET_AVX2 static const char* find_xml_special_avx2(const char* p, const char* end)
 {
-	out << _leading << '<' << EncodeXMLString(*this);
+	const __m256i amp = _mm256_set1_epi8('&');
+	const __m256i lt = _mm256_set1_epi8('<');
+	const __m256i gt = _mm256_set1_epi8('>');
+	const __m256i quot = _mm256_set1_epi8('"');
+	const __m256i apos = _mm256_set1_epi8('\'');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	const __m256i ctrl_max = _mm256_set1_epi8(0x1F);
 
-	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
-		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
+	for(; end-p>=32; p+=32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
 
-	if (!_children.empty() || !_content.empty()) {
-		out << '>';
+		__m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, amp), _mm256_cmpeq_epi8(v, lt)),
+					_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, gt), _mm256_cmpeq_epi8(v, quot)), _mm256_cmpeq_epi8(v, apos)));
 
-		if (_cdata_content)
-			out << CDATA_START << _content << CDATA_END;
-		else
-			out << _content;
+		__m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl_max), v);
+		__m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, tab), _mm256_cmpeq_epi8(v, cr)), _mm256_cmpeq_epi8(v, lf));
 
-		for(Children::const_iterator it=_children.begin(); it!=_children.end(); ++it)
-			(*it)->original_write_worker(out);
+		unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_or_si256(m, _mm256_andnot_si256(ws, ctrl)));
 
-		out << _end_leading << "</" << EncodeXMLString(*this) << '>';
-	} else
-		out << "/>";
+		if (mask)
+			return p + first_bit(mask);
+	}
 
-	out << _trailing;
+	return find_xml_special_sse2(p, end);
 }
 
-
- /// print node without any white space
-void XMLNode::plain_write_worker(std::ostream& out) const
+XS_TARGET_AVX2 static const char* find_xml_char_avx2(const char* p, const char* end, char c)
 {
-	out << '<' << EncodeXMLString(*this);
+	const __m256i pattern = _mm256_set1_epi8(c);
 
-	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
-		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
+	for(; end-p>=32; p+=32) {
+		unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), pattern));
 
-	 // strip leading white space from content
-	const char* content = _content.c_str();
-	while(isspace((unsigned char)*content)) ++content;
+		if (mask)
+			return p + first_bit(mask);
+	}
 
-	if (!_children.empty() || *content) {
-		out << ">" << content;
+	return find_xml_char_sse2(p, end, c);
+}
 
-		for(Children::const_iterator it=_children.begin(); it!=_children.end(); ++it)
-			(*it)->plain_write_worker(out);
+#endif // XS_SIMD_AVX2
 
-		out << "</" << EncodeXMLString(*this) << ">";
-	} else
-		out << "/>";
-}
 
+ // UTF-8 <-> UTF-16 conversion kernels
+ // The output position never runs ahead of the input position, so the SIMD loops may store
+ // whole blocks even if only a part of them is valid ASCII.
 
- /// pretty print node with children tree to output stream
-void XMLNode::pretty_write_worker(std::ostream& out, const XMLFormat& format, int indent) const
+ /// decode the UTF-8 sequence at 'p' not covered by the fast path of utf8_decode_seq()
+ // returns the number of bytes consumed: four byte sequences produce a surrogate pair, all others one code unit
+static size_t utf8_decode_other(const unsigned char* p, size_t avail, XS_UTF16* o)
 {
-	for(int i=indent; i--; )
-		out << XML_INDENT_SPACE;
+	unsigned c = *p;
 
-	out << '<' << EncodeXMLString(*this);
+	if (c>=0xC2 && c<=0xDF) {
+		if (avail>=2 && (p[1]&0xC0)==0x80) {
+			*o = (XS_UTF16)(((c&0x1F)<<6) | (p[1]&0x3F));
+			return 2;
+		}
+	} else if (c>=0xE0 && c<=0xEF) {
+		 // reject overlong forms and surrogates
+		unsigned lo = c==0xE0? 0xA0: 0x80;
+		unsigned hi = c==0xED? 0x9F: 0xBF;
+
+		if (avail>=3 && p[1]>=lo && p[1]<=hi && (p[2]&0xC0)==0x80) {
+			*o = (XS_UTF16)(((c&0x0F)<<12) | ((p[1]&0x3F)<<6) | (p[2]&0x3F));
+			return 3;
+		}
+	} else if (c>=0xF0 && c<=0xF4) {
+		 // reject overlong forms and code points above U+10FFFF
+		unsigned lo = c==0xF0? 0x90: 0x80;
+		unsigned hi = c==0xF4? 0x8F: 0xBF;
 
-	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
-		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
+		if (avail>=4 && p[1]>=lo && p[1]<=hi && (p[2]&0xC0)==0x80 && (p[3]&0xC0)==0x80) {
+			unsigned cp = (((c&0x07)<<18) | ((p[1]&0x3F)<<12) | ((p[2]&0x3F)<<6) | (p[3]&0x3F)) - 0x10000;
+
+			o[0] = (XS_UTF16)(0xD800 | (cp>>10));
+			o[1] = (XS_UTF16)(0xDC00 | (cp&0x3FF));
+			return 4;
+		}
+	}
+
+	*o = 0xFFFD;
+	return 1;
+}
+
+ /// decode the non-ASCII UTF-8 sequence at 'p', replacing an invalid lead byte by U+FFFD
+static inline void utf8_decode_seq(const unsigned char*& p, const unsigned char* end, XS_UTF16*& o)
+{
+	unsigned c = *p;
+	size_t avail = end - p;
+
+	 // fast path for the common 2 and 3 byte sequences, x^0x80 < 0x40 for continuation bytes
+	if (avail >= 3) {
+		unsigned c1 = p[1] ^ 0x80;
+		unsigned c2 = p[2] ^ 0x80;
+
+		if ((c&0xF0)==0xE0 && (c1|c2)<0x40) {
+			unsigned cp = ((c&0x0F)<<12) | (c1<<6) | c2;
+
+			if (cp>=0x800 && cp-0xD800>=0x800) {
+				*o++ = (XS_UTF16)cp;
+				p += 3;
+				return;
+			}
+		} else if ((c&0xE0)==0xC0 && c>=0xC2 && c1<0x40) {
+			*o++ = (XS_UTF16)(((c&0x1F)<<6) | c1);
+			p += 2;
+			return;
+		}
+	}
+
+	size_t n = utf8_decode_other(p, avail, o);
+
+	p += n;
+	o += n==4? 2: 1;
+}
+
+ /// encode the non-ASCII UTF-16 code unit at 'p', replacing unpaired surrogates by U+FFFD
+static inline void utf8_encode_seq(const XS_UTF16*& p, const XS_UTF16* end, unsigned char*& o)
+{
+	unsigned c = *p++;
+
+	if (c < 0x800) {
+		*o++ = (unsigned char)(0xC0 | (c>>6));
+		*o++ = (unsigned char)(0x80 | (c&0x3F));
+		return;
+	}
+
+	if (c>=0xD800 && c<=0xDFFF) {
+		if (c<=0xDBFF && p<end && *p>=0xDC00 && *p<=0xDFFF) {
+			unsigned cp = 0x10000 + ((c-0xD800)<<10) + (*p++ - 0xDC00);
+
+			*o++ = (unsigned char)(0xF0 | (cp>>18));
+			*o++ = (unsigned char)(0x80 | ((cp>>12)&0x3F));
+			*o++ = (unsigned char)(0x80 | ((cp>>6)&0x3F));
+			*o++ = (unsigned char)(0x80 | (cp&0x3F));
+			return;
+		}
+
+		c = 0xFFFD;
+	}
+
+	*o++ = (unsigned char)(0xE0 | (c>>12));
+	*o++ = (unsigned char)(0x80 | ((c>>6)&0x3F));
+	*o++ = (unsigned char)(0x80 | (c&0x3F));
+}
+
+static size_t utf8_to_utf16_scalar(const char* s, size_t l, XS_UTF16* out)
+{
+	const unsigned char* p = (const unsigned char*)s;
+	const unsigned char* end = p + l;
+	XS_UTF16* o = out;
+
+	while(p < end)
+		if (*p < 0x80)
+			*o++ = *p++;
+		else
+			utf8_decode_seq(p, end, o);
+
+	return o - out;
+}
+
+static size_t utf16_to_utf8_scalar(const XS_UTF16* s, size_t l, char* out)
+{
+	const XS_UTF16* p = s;
+	const XS_UTF16* end = p + l;
+	unsigned char* o = (unsigned char*)out;
+
+	while(p < end)
+		if (*p < 0x80)
+			*o++ = (unsigned char)*p++;
+		else
+			utf8_encode_seq(p, end, o);
+
+	return o - (unsigned char*)out;
+}
+
+#ifdef XS_SIMD_SSE2
+
+XS_TARGET_SSE2 static size_t utf8_to_utf16_sse2(const char* s, size_t l, XS_UTF16* out)
+{
+	const unsigned char* p = (const unsigned char*)s;
+	const unsigned char* end = p + l;
+	XS_UTF16* o = out;
+	const __m128i zero = _mm_setzero_si128();
+
+	while(p < end)
+		if (*p < 0x80) {
+			 // widen 16 bytes per step up to the first non-ASCII byte
+			while(end-p >= 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				unsigned mask = _mm_movemask_epi8(v);
+
+				_mm_storeu_si128((__m128i*)o, _mm_unpacklo_epi8(v, zero));
+				_mm_storeu_si128((__m128i*)(o+8), _mm_unpackhi_epi8(v, zero));
+
+				if (mask) {
+					unsigned n = first_bit(mask);
+					p += n;
+					o += n;
+					break;
+				}
+
+				p += 16;
+				o += 16;
+			}
+
+			while(p<end && *p<0x80)
+				*o++ = *p++;
+		} else
+			utf8_decode_seq(p, end, o);
+
+	return o - out;
+}
+
+XS_TARGET_SSE2 static size_t utf16_to_utf8_sse2(const XS_UTF16* s, size_t l, char* out)
+{
+	const XS_UTF16* p = s;
+	const XS_UTF16* end = p + l;
+	unsigned char* o = (unsigned char*)out;
+	const __m128i non_ascii = _mm_set1_epi16((short)0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+
+	while(p < end)
+		if (*p < 0x80) {
+			 // narrow 16 code units per step up to the first non-ASCII one
+			while(end-p >= 16) {
+				__m128i v0 = _mm_loadu_si128((const __m128i*)p);
+				__m128i v1 = _mm_loadu_si128((const __m128i*)(p+8));
+
+				__m128i ascii = _mm_packs_epi16(_mm_cmpeq_epi16(_mm_and_si128(v0, non_ascii), zero),
+												_mm_cmpeq_epi16(_mm_and_si128(v1, non_ascii), zero));
+				unsigned mask = ~_mm_movemask_epi8(ascii) & 0xFFFF;
+
+				_mm_storeu_si128((__m128i*)o, _mm_packus_epi16(v0, v1));
+
+				if (mask) {
+					unsigned n = first_bit(mask);
+					p += n;
+					o += n;
+					break;
+				}
+
+				p += 16;
+				o += 16;
+			}
+
+			while(p<end && *p<0x80)
+				*o++ = (unsigned char)*p++;
+		} else
+			utf8_encode_seq(p, end, o);
+
+	return o - (unsigned char*)out;
+}
+
+#endif // XS_SIMD_SSE2
+
+#ifdef XS_SIMD_AVX2
+
+ /// convert up to four 3 byte sequences at 'p' (16 bytes readable), return the number of valid sequences
+XS_TARGET_AVX2 static inline unsigned utf8_decode3_x4(const unsigned char* p, XS_UTF16* o)
+{
+	const __m128i gather = _mm_setr_epi8(2,1,0,-1, 5,4,3,-1, 8,7,6,-1, 11,10,9,-1);
+	const __m128i narrow = _mm_setr_epi8(0,1, 4,5, 8,9, 12,13, -1,-1,-1,-1, -1,-1,-1,-1);
+
+	 // one sequence per 32 bit lane: lead byte in bits 16..23
+	__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), gather);
+
+	 // 1110xxxx 10xxxxxx 10xxxxxx
+	__m128i valid = _mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32(0xF0C0C0)), _mm_set1_epi32(0xE08080));
+
+	__m128i cp = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, _mm_set1_epi32(0x3F)),
+				_mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x3F00)), 2)),
+				_mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x0F0000)), 4));
+
+	 // reject overlong forms below U+0800 and surrogates
+	__m128i range = _mm_and_si128(cp, _mm_set1_epi32(0xF800));
+	__m128i invalid = _mm_or_si128(_mm_cmpeq_epi32(range, _mm_setzero_si128()), _mm_cmpeq_epi32(range, _mm_set1_epi32(0xD800)));
+
+	_mm_storel_epi64((__m128i*)o, _mm_shuffle_epi8(cp, narrow));
+
+	unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(invalid, valid)));
+
+	return first_bit(~mask);
+}
+
+ /// convert up to four code units U+0800..U+FFFF at 'p' (4 units readable) into 3 byte sequences, return the number converted
+XS_TARGET_AVX2 static inline unsigned utf8_encode3_x4(const XS_UTF16* p, unsigned char* o)
+{
+	const __m128i pack = _mm_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+
+	__m128i c = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p));
+
+	__m128i range = _mm_and_si128(c, _mm_set1_epi32(0xF800));
+	__m128i invalid = _mm_or_si128(_mm_cmpeq_epi32(range, _mm_setzero_si128()), _mm_cmpeq_epi32(range, _mm_set1_epi32(0xD800)));
+
+	 // 1110xxxx 10xxxxxx 10xxxxxx in the low three bytes of each lane
+	__m128i b = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(c, 12),
+				_mm_and_si128(_mm_slli_epi32(c, 2), _mm_set1_epi32(0x3F00))),
+				_mm_or_si128(_mm_and_si128(_mm_slli_epi32(c, 16), _mm_set1_epi32(0x3F0000)), _mm_set1_epi32(0x8080E0)));
+
+	_mm_storeu_si128((__m128i*)o, _mm_shuffle_epi8(b, pack));
+
+	return first_bit(_mm_movemask_ps(_mm_castsi128_ps(invalid)) | 0x10);
+}
+
+XS_TARGET_AVX2 static size_t utf8_to_utf16_avx2(const char* s, size_t l, XS_UTF16* out)
+{
+	const unsigned char* p = (const unsigned char*)s;
+	const unsigned char* end = p + l;
+	XS_UTF16* o = out;
+
+	while(p < end)
+		if (*p < 0x80) {
+			 // widen 32 bytes per step up to the first non-ASCII byte
+			while(end-p >= 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				unsigned mask = (unsigned) _mm256_movemask_epi8(v);
+
+				_mm256_storeu_si256((__m256i*)o, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+				_mm256_storeu_si256((__m256i*)(o+16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+
+				if (mask) {
+					unsigned n = first_bit(mask);
+					p += n;
+					o += n;
+					break;
+				}
+
+				p += 32;
+				o += 32;
+			}
+
+			while(p<end && *p<0x80)
+				*o++ = *p++;
+		} else {
+			 // runs of 3 byte sequences as in CJK text
+			while(end-p >= 16) {
+				unsigned n = utf8_decode3_x4(p, o);
+
+				p += 3*n;
+				o += n;
+
+				if (n < 4)
+					break;
+			}
+
+			if (p<end && *p>=0x80)
+				utf8_decode_seq(p, end, o);
+		}
+
+	return o - out;
+}
+
+XS_TARGET_AVX2 static size_t utf16_to_utf8_avx2(const XS_UTF16* s, size_t l, char* out)
+{
+	const XS_UTF16* p = s;
+	const XS_UTF16* end = p + l;
+	unsigned char* o = (unsigned char*)out;
+	const __m256i non_ascii = _mm256_set1_epi16((short)0xFF80);
+	const __m256i zero = _mm256_setzero_si256();
+
+	while(p < end)
+		if (*p < 0x80) {
+			 // narrow 32 code units per step up to the first non-ASCII one
+			while(end-p >= 32) {
+				__m256i v0 = _mm256_loadu_si256((const __m256i*)p);
+				__m256i v1 = _mm256_loadu_si256((const __m256i*)(p+16));
+
+				 // the pack instructions work per 128 bit lane, so restore the order of the 64 bit quarters
+				__m256i ascii = _mm256_permute4x64_epi64(_mm256_packs_epi16(
+										_mm256_cmpeq_epi16(_mm256_and_si256(v0, non_ascii), zero),
+										_mm256_cmpeq_epi16(_mm256_and_si256(v1, non_ascii), zero)), 0xD8);
+				unsigned mask = ~(unsigned)_mm256_movemask_epi8(ascii);
+
+				_mm256_storeu_si256((__m256i*)o, _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), 0xD8));
+
+				if (mask) {
+					unsigned n = first_bit(mask);
+					p += n;
+					o += n;
+					break;
+				}
+
+				p += 32;
+				o += 32;
+			}
+
+			while(p<end && *p<0x80)
+				*o++ = (unsigned char)*p++;
+		} else {
+			 // runs of code units encoded in 3 bytes as in CJK text
+			while(end-p >= 8) {
+				unsigned n = utf8_encode3_x4(p, o);
+
+				p += n;
+				o += 3*n;
+
+				if (n < 4)
+					break;
+			}
+
+			if (p<end && *p>=0x80)
+				utf8_encode_seq(p, end, o);
+		}
+
+	return o - (unsigned char*)out;
+}
+
+#endif // XS_SIMD_AVX2
+
+
+enum SIMD_LEVEL {
+	SIMD_NONE,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+
+ /// check CPU and OS support for the SIMD kernels
+static SIMD_LEVEL detect_simd_level()
+{
+#if defined(XS_SIMD_SSE2) && defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+	int max_id = info[0];
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1<<26)) != 0;
+
+#ifdef XS_SIMD_AVX2
+	 // AVX2 needs OSXSAVE, AVX and enabled YMM state
+	if (max_id>=7 && (info[2]&(1<<27)) && (info[2]&(1<<28)) && (_xgetbv(0)&6)==6) {
+		__cpuidex(info, 7, 0);
+
+		if (info[1] & (1<<5))
+			return SIMD_AVX2;
+	}
+#endif
+
+	return sse2? SIMD_SSE2: SIMD_NONE;
+#elif defined(XS_SIMD_SSE2)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+
+	return SIMD_NONE;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+typedef const char* (*FIND_XML_SPECIAL_FCT)(const char* p, const char* end);
+typedef const char* (*FIND_XML_CHAR_FCT)(const char* p, const char* end, char c);
+typedef size_t (*UTF8_TO_UTF16_FCT)(const char* s, size_t l, XS_UTF16* out);
+typedef size_t (*UTF16_TO_UTF8_FCT)(const XS_UTF16* s, size_t l, char* out);
+
+static const char* find_xml_special_init(const char* p, const char* end);
+static const char* find_xml_char_init(const char* p, const char* end, char c);
+static size_t utf8_to_utf16_init(const char* s, size_t l, XS_UTF16* out);
+static size_t utf16_to_utf8_init(const XS_UTF16* s, size_t l, char* out);
+
+static FIND_XML_SPECIAL_FCT s_find_xml_special = find_xml_special_init;
+static FIND_XML_CHAR_FCT s_find_xml_char = find_xml_char_init;
+static UTF8_TO_UTF16_FCT s_utf8_to_utf16 = utf8_to_utf16_init;
+static UTF16_TO_UTF8_FCT s_utf16_to_utf8 = utf16_to_utf8_init;
+
+ /// select the scanning and conversion kernels on first use
+static void init_simd_dispatch()
+{
+	FIND_XML_SPECIAL_FCT find_special = find_xml_special_scalar;
+	FIND_XML_CHAR_FCT find_char = find_xml_char_scalar;
+	UTF8_TO_UTF16_FCT to_utf16 = utf8_to_utf16_scalar;
+	UTF16_TO_UTF8_FCT to_utf8 = utf16_to_utf8_scalar;
+
+	switch(detect_simd_level()) {
+#ifdef XS_SIMD_AVX2
+	  case SIMD_AVX2:
+		find_special = find_xml_special_avx2;
+		find_char = find_xml_char_avx2;
+		to_utf16 = utf8_to_utf16_avx2;
+		to_utf8 = utf16_to_utf8_avx2;
+		break;
+#endif
+
+#ifdef XS_SIMD_SSE2
+	  case SIMD_SSE2:
+		find_special = find_xml_special_sse2;
+		find_char = find_xml_char_sse2;
+		to_utf16 = utf8_to_utf16_sse2;
+		to_utf8 = utf16_to_utf8_sse2;
+		break;
+#endif
+
+	  default:
+		break;
+	}
+
+	s_find_xml_special = find_special;
+	s_find_xml_char = find_char;
+	s_utf8_to_utf16 = to_utf16;
+	s_utf16_to_utf8 = to_utf8;
+}
+
+static const char* find_xml_special_init(const char* p, const char* end)
+{
+	init_simd_dispatch();
+
+	return s_find_xml_special(p, end);
+}
+
+static const char* find_xml_char_init(const char* p, const char* end, char c)
+{
+	init_simd_dispatch();
+
+	return s_find_xml_char(p, end, c);
+}
+
+const char* find_xml_special(const char* p, const char* end)
+{
+	return s_find_xml_special(p, end);
+}
+
+const char* find_xml_char(const char* p, const char* end, char c)
+{
+	return s_find_xml_char(p, end, c);
+}
+
+static size_t utf8_to_utf16_init(const char* s, size_t l, XS_UTF16* out)
+{
+	init_simd_dispatch();
+
+	return s_utf8_to_utf16(s, l, out);
+}
+
+static size_t utf16_to_utf8_init(const XS_UTF16* s, size_t l, char* out)
+{
+	init_simd_dispatch();
+
+	return s_utf16_to_utf8(s, l, out);
+}
+
+size_t utf8_to_utf16(const char* s, size_t l, XS_UTF16* out)
+{
+	return s_utf8_to_utf16(s, l, out);
+}
+
+size_t utf16_to_utf8(const XS_UTF16* s, size_t l, char* out)
+{
+	return s_utf16_to_utf8(s, l, out);
+}
+
+
+ /// append XML encoded UTF-8 string to 'out'
+template<typename BUFFER> static void encode_xml_utf8(BUFFER& out, const char* s, size_t l)
+{
+	const char* end = s + l;
+
+	for(;;) {
+		 // copy runs of plain text in one step
+		const char* p = find_xml_special(s, end);
+
+		out.append(s, p-s);
+
+		if (p == end)
+			break;
+
+		switch(*p) {
+		  case '&':
+			out.append("&amp;", 5);
+			break;
+
+		  case '<':
+			out.append("&lt;", 4);
+			break;
+
+		  case '>':
+			out.append("&gt;", 4);
+			break;
+
+		  case '"':
+			out.append("&quot;", 6);
+			break;
+
+		  case '\'':
+			out.append("&apos;", 6);
+			break;
+
+		  default: {
+#ifdef XS_STRICT_XML_1_0
+			out += '?';
+#else
+			char b[16];
+			sprintf(b, "&#%d;", (unsigned char)*p);
+			out.append(b);
+#endif
+		  }
+		}
+
+		s = p + 1;
+	}
+}
+
+
+ /// encode XML string literals
+std::string EncodeXMLString(const XS_String& str, bool cdata)
+{
+	LPCXSSTR s = str.c_str();
+	size_t l = XS_len(s);
+
+	if (cdata) {
+		 // encode the whole string in a CDATA section
+		std::string ret = CDATA_START;
+
+#ifdef XS_STRING_UTF8
+		ret += str;
+#else
+		ret += get_utf8(str);
+#endif
+
+#ifdef XS_STRICT_XML_1_0
+		for(char*p=&ret.at(9); *p; ++p) // strlen(CDATA_START) == 9
+			if ((unsigned)*p<0x20 && *p!='\t' && *p!='\r' && *p!='\n')
+				*p = '?';
+#endif
+
+		ret += CDATA_END;
+
+		return ret;
+	} else {
+		std::string ret;
+
+		ret.reserve(l);
+
+#ifdef XS_STRING_UTF8
+		encode_xml_utf8(ret, s, l);
+#else
+		const std::string& utf8_str = get_utf8(s, l);
+		encode_xml_utf8(ret, utf8_str.c_str(), utf8_str.length());
+#endif
+
+		return ret;
+	}
+}
+
+ /// decode XML string literals
+XS_String DecodeXMLString(const std::string& str_utf8)
+{
+#ifdef XS_STRING_UTF8
+	const XS_String& str = str_utf8;
+#else
+	XS_String str;
+	assign_utf8(str, str_utf8.c_str(), str_utf8.length());
+#endif
+
+	LPCXSSTR s = str.c_str();
+	size_t l = XS_len(s);
+
+	TMP_ALLOC(XS_CHAR, buffer, heap, l);
+
+	LPXSSTR o = buffer;
+	for(LPCXSSTR p=s; *p; ++p)
+		if (*p == '&') {
+			if (!XS_nicmp(p+1, XS_TEXT("lt;"), 3)) {
+				*o++ = '<';
+				p += 3;
+			} else if (!XS_nicmp(p+1, XS_TEXT("gt;"), 3)) {
+				*o++ = '>';
+				p += 3;
+			} else if (!XS_nicmp(p+1, XS_TEXT("amp;"), 4)) {
+				*o++ = '&';
+				p += 4;
+			} else if (!XS_nicmp(p+1, XS_TEXT("quot;"), 5)) {
+				*o++ = '"';
+				p += 5;
+			} else if (!XS_nicmp(p+1, XS_TEXT("apos;"), 5)) {
+				*o++ = '\'';
+				p += 5;
+			} else	//@@ maybe decode "&#xx;" special characters
+				*o++ = *p;
+		} else if (*p=='<' && !XS_nicmp(p+1,XS_TEXT("![CDATA["),8)) {
+			LPCXSSTR e = XS_strstr(p+9, XS_TEXT(CDATA_END));
+			if (e) {
+				p += 9;
+				size_t l = e - p;
+				memcpy(o, p, l);
+				o += l;
+				p = e + 2;
+			} else
+				*o++ = *p;
+		} else
+			*o++ = *p;
+
+	return XS_String(buffer, o-buffer);
+}
+
+
+ /// write node with children tree to output stream using original white space
+void XMLNode::original_write_worker(std::ostream& out, XMLWriteCache* cache) const
+{
+	out << _leading << '<' << EncodeXMLString(*this);
+
+	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
+		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
+
+	const Children& children = get_children();
+
+	if (!children.empty() || !_content.empty()) {
+		out << '>';
+
+		if (_cdata_content)
+			out << CDATA_START << _content << CDATA_END;
+		else
+			out << _content;
+
+		for(Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+			if (cache)
+				cache->write_node(out, **it, 0);
+			else
+				(*it)->original_write_worker(out);
+
+		out << _end_leading << "</" << EncodeXMLString(*this) << '>';
+	} else
+		out << "/>";
+
+	out << _trailing;
+}
+
+
+ /// print node without any white space
+void XMLNode::plain_write_worker(std::ostream& out, XMLWriteCache* cache) const
+{
+	out << '<' << EncodeXMLString(*this);
+
+	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
+		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
+
+	 // strip leading white space from content
+	const char* content = _content.data();
+	const char* content_end = content + _content.length();
+	while(content<content_end && isspace((unsigned char)*content)) ++content;
+
+	const Children& children = get_children();
+
+	if (!children.empty() || content<content_end) {
+		out << '>';
+		out.write(content, content_end-content);
+
+		for(Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+			if (cache)
+				cache->write_node(out, **it, 0);
+			else
+				(*it)->plain_write_worker(out);
+
+		out << "</" << EncodeXMLString(*this) << ">";
+	} else
+		out << "/>";
+}
+
+
+ /// pretty print node with children tree to output stream
+void XMLNode::pretty_write_worker(std::ostream& out, const XMLFormat& format, int indent, XMLWriteCache* cache) const
+{
+	for(int i=indent; i--; )
+		out << XML_INDENT_SPACE;
+
+	out << '<' << EncodeXMLString(*this);
+
+	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
+		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
 
 	 // strip leading white space from content
-	const char* content = _content.c_str();
-	while(isspace((unsigned char)*content)) ++content;
+	const char* content = _content.data();
+	const char* content_end = content + _content.length();
+	while(content<content_end && isspace((unsigned char)*content)) ++content;
+
+	const Children& children = get_children();
+
+	if (!children.empty() || content<content_end) {
+		out << '>';
+		out.write(content, content_end-content);
+
+		if (!children.empty())
+			out << format._endl;
+
+		for(Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+			if (cache)
+				cache->write_node(out, **it, indent+1);
+			else
+				(*it)->pretty_write_worker(out, format, indent+1);
+
+		for(int i=indent; i--; )
+			out << XML_INDENT_SPACE;
+
+		out << "</" << EncodeXMLString(*this) << '>' << format._endl;
+	} else
+		out << "/>" << format._endl;
+}
+
+
+ /// write node with children tree to output stream using smart formating
+void XMLNode::smart_write_worker(std::ostream& out, const XMLFormat& format, int indent, XMLWriteCache* cache) const
+{
+	 // strip the first line feed from _leading
+	const char* leading = _leading.data();
+	const char* leading_end = leading + _leading.length();
+	if (leading<leading_end && *leading=='\n') ++leading;
+
+	if (leading == leading_end)
+		for(int i=indent; i--; )
+			out << XML_INDENT_SPACE;
+	else
+		out.write(leading, leading_end-leading);
+
+	out << '<' << EncodeXMLString(*this);
+
+	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
+		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
+
+	 // strip leading white space from content
+	const char* content = _content.data();
+	const char* content_end = content + _content.length();
+	while(content<content_end && isspace((unsigned char)*content)) ++content;
+
+	const Children& children = get_children();
+
+	if (children.empty() && content==content_end)
+		out << "/>";
+	else {
+		out << '>';
+
+		if (_cdata_content)
+			out << CDATA_START << _content << CDATA_END;
+		else if (content == content_end)
+			out << format._endl;
+		else
+			out.write(content, content_end-content);
+
+		Children::const_iterator it = children.begin();
+
+		if (it != children.end()) {
+			for(; it!=children.end(); ++it)
+				if (cache)
+					cache->write_node(out, **it, indent+1);
+				else
+					(*it)->smart_write_worker(out, format, indent+1);
+
+			 // strip the first line feed from _end_leading
+			const char* end_leading = _end_leading.data();
+			const char* end_leading_end = end_leading + _end_leading.length();
+			if (end_leading<end_leading_end && *end_leading=='\n') ++end_leading;
+
+			if (end_leading == end_leading_end)
+				for(int i=indent; i--; )
+					out << XML_INDENT_SPACE;
+			else
+				out.write(end_leading, end_leading_end-end_leading);
+		} else
+			out << _end_leading;
+
+		out << "</" << EncodeXMLString(*this) << '>';
+	}
+
+	if (_trailing.empty())
+		out << format._endl;
+	else
+		out << _trailing;
+}
+
+
+ /// write node with children tree to output stream reusing the unchanged parts of the previous write
+bool XMLWriteCache::write(std::ostream& out, const XMLNode& node, const XMLFormat& format, WRITE_MODE mode, int indent)
+{
+	if (mode!=_mode || _endl!=format._endl) {
+		_entries.clear();
+
+		_mode = mode;
+		_endl = format._endl;
+	}
+
+	scan(node, 0);
+
+	 // the top node itself is always encoded again, its descendants go through write_node()
+	_format = &format;
+	_level = 1;
+
+	if (!++_gen)
+		++_gen;
+
+	node.write_worker(out, format, mode, indent, this);
+
+	 // keep only the text of nodes written this time
+	for(Entries::iterator it=_entries.begin(); it!=_entries.end(); )
+		if (it->second._gen != _gen)
+			_entries.erase(it++);
+		else
+			++it;
+
+	_format = NULL;
+
+	return out.good();
+}
+
+ /// drop the text of modified subtrees and reset the modification flags
+bool XMLWriteCache::scan(const XMLNode& node, int level)
+{
+	bool modified = node._modified;
+
+	node._modified = false;
+
+	const XMLNode::Children& children = node.get_children();
+
+	for(XMLNode::Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+		if (scan(**it, level+1))
+			modified = true;
+
+	if (modified && level<=XS_WRITE_CACHE_DEPTH)
+		_entries.erase(&node);
+
+	return modified;
+}
+
+void XMLWriteCache::write_node(std::ostream& out, const XMLNode& node, int indent)
+{
+	if (_level > XS_WRITE_CACHE_DEPTH) {
+		node.write_worker(out, *_format, _mode, indent, NULL);
+		return;
+	}
+
+	Entry& entry = _entries[&node];
+
+	 // new entries start with _gen=0
+	if (!entry._gen || entry._indent!=indent) {
+		std::ostringstream buffer;
+
+		++_level;
+		node.write_worker(buffer, *_format, _mode, indent, this);
+		--_level;
+
+		entry._text = buffer.str();
+		entry._indent = indent;
+	}
+
+	entry._gen = _gen;
+
+	out << entry._text;
+}
+
+
+std::ostream& operator<<(std::ostream& out, const XMLError& err)
+{
+	out << err._systemId << "(" << err._line << ")";
+
+	if (err._column > 1)
+		out << " [column " << err._column << "]";
+
+	out << " : " << err._message;
+
+	return out;
+}
+
+
+#if defined(XS_NATIVE) || defined(XMLNODE_LOCATION)
+
+std::string XMLLocation::str() const
+{
+	std::ostringstream out;
+
+	if (_pdisplay_path)
+		out << _pdisplay_path;
+
+	out << "(" << _line << ")";
+
+	if (_column > 1)
+		out << " [column " << _column << "]";
+
+	out << " :";
+
+	return out.str();
+}
+
+#endif
+
+
+const char* get_xmlsym_end_utf8(const char* p)
+{
+	for(; *p; ++p) {
+		char c = *p;
+
+		// NameChar ::= Letter | Digit | '.' | '-' | '_' | ':' | CombiningChar | Extender
+		if (c == '\xC3')	// UTF-8 escape character
+			++p;	//TODO only continue on umlaut characters
+		else if (!isalnum(c) && c!='.' && c!='-' && c!='_' && c!=':')
+			break;
+	}
+
+	return p;
+}
+
+ /// end of an XML name in [p, end) like get_xmlsym_end_utf8()
+static const char* get_xmlsym_end_utf8(const char* p, const char* end)
+{
+	for(; p<end; ++p) {
+		char c = *p;
+
+		if (c == '\xC3') {	// UTF-8 escape character
+			if (++p == end)
+				break;
+		} else if (!isalnum((unsigned char)c) && c!='.' && c!='-' && c!='_' && c!=':')
+			break;
+	}
+
+	return p;
+}
+
+ /// scan the next attribute in [p, end) behind the tag name of a start tag
+bool scan_xml_attribute(const char*& p, const char* end, XMLAttrToken& attr, const char*& error)
+{
+	error = NULL;
+
+	while(p<end && isspace((unsigned char)*p))
+		++p;
+
+	if (p==end || *p=='>' || *p=='/' || *p=='?')
+		return false;
+
+	attr._name = p;
+	p = get_xmlsym_end_utf8(p, end);
+	attr._name_len = p - attr._name;
+
+	if (p==end || *p!='=') {
+		error = "missing attribute assignment";
+		return false;
+	}
+
+	if (++p==end || (*p!='"' && *p!='\'')) {
+		error = "missing attribute value quote";
+		return false;
+	}
+
+	char delim = *p;
+	attr._value = ++p;
+
+	p = (const char*) memchr(p, delim, end-p);
+
+	if (p)
+		attr._value_len = p++ - attr._value;	// '"' or '\''
+	else {
+		attr._value_len = end - attr._value;
+		p = end;
+		error = "unterminated attribute quote";
+	}
+
+	return true;
+}
+
+
+ /// order of attribute map nodes by their key
+struct XS_SMNodeLess
+{
+	bool operator()(const XS_SMNode* a, const XS_SMNode* b) const
+	{
+		return a->first.compare(b->first) < 0;
+	}
+};
+
+void XMLAttributeMapBase::decode_all() const
+{
+	if (xs_atomic_load(&_state) == RAW_DECODED)
+		return;
+
+	if (xs_atomic_cas(&_state, RAW_DECODING, RAW_PENDING) != RAW_PENDING) {
+		 // another thread is decoding the map
+		while(xs_atomic_load(&_state) != RAW_DECODED)
+			xs_yield();
+
+		return;
+	}
+
+	XMLAttributeMapBase& map = const_cast<XMLAttributeMapBase&>(*this);
+	std::vector<XS_SMNode*> nodes;
+	const char* p = _raw.data();
+	const char* end = p + _raw.length();
+	XMLAttrToken attr;
+	const char* error;
+
+	while(scan_xml_attribute(p, end, attr, error)) {
+		XS_SMNode* node = new XS_SMNode(from_utf8(attr._name, attr._name_len));
+
+		node->second = DecodeXMLString(std::string(attr._value, attr._value_len));
+		nodes.push_back(node);
+	}
+
+	std::stable_sort(nodes.begin(), nodes.end(), XS_SMNodeLess());
+
+	 // The last one of duplicate attributes wins, values already in the map are kept.
+	size_t cnt = 0;
+
+	for(size_t i=0; i<nodes.size(); ++i)
+		if ((i+1<nodes.size() && nodes[i+1]->first==nodes[i]->first) || map.XS_StringMap::find(nodes[i]->first)!=map.XS_StringMap::end())
+			delete nodes[i];
+		else
+			nodes[cnt++] = nodes[i];
+
+	if (cnt) {
+		map.merge_sorted(&nodes[0], cnt);
+		need_cleanup();
+	}
+
+	 // publish the map, the raw text stays for readers still scanning it in get_value()
+	xs_atomic_cas(&_state, RAW_DECODED, RAW_DECODING);
+}
+
+void XMLAttributeMapBase::copy(const XMLAttributeMapBase& other)
+{
+	if (xs_atomic_load(&other._state) == RAW_DECODED) {
+		super::operator=(other);
+		_raw.erase();
+		_state = RAW_DECODED;
+	} else {
+		super::clear();
+		_raw = other._raw;
+		_state = RAW_PENDING;
+	}
+}
+
+bool XMLAttributeMapBase::find_raw(const char* name, size_t len, XS_String& value) const
+{
+	const char* p = _raw.data();
+	const char* end = p + _raw.length();
+	XMLAttrToken attr, found;
+	const char* error;
+	bool ret = false;
+
+	 // the last one of duplicate attributes wins like in decode_all()
+	while(scan_xml_attribute(p, end, attr, error))
+		if (attr._name_len==len && !memcmp(attr._name, name, len)) {
+			found = attr;
+			ret = true;
+		}
+
+	if (ret)
+		value = DecodeXMLString(std::string(found._value, found._value_len));
+
+	return ret;
+}
+
+bool XMLAttributeMapBase::get_value(const key_type& key, XS_String& value) const
+{
+	if (xs_atomic_load(&_state) != RAW_DECODED) {
+#ifdef XS_STRING_UTF8
+		return find_raw(key.c_str(), key.length(), value);
+#else
+		std::string name = get_utf8(key);
+
+		return find_raw(name.c_str(), name.length(), value);
+#endif
+	}
+
+	const_iterator found = super::find(key);
+
+	if (found == super::end())
+		return false;
+
+	value = found->second;
+	return true;
+}
+
+#if defined(UNICODE) && !defined(XS_STRING_UTF8)
+bool XMLAttributeMapBase::get_value(const char* key, XS_String& value) const
+{
+	if (xs_atomic_load(&_state) != RAW_DECODED)
+		return find_raw(key, strlen(key), value);
+
+	if (super::size() > XS_SM_HASH_MIN)
+		return get_value(XS_String(key), value);	// use the hash index
+
+	for(const_iterator it=super::begin(); it!=super::end(); ++it)
+		if (it->first == key) {
+			value = it->second;
+			return true;
+		}
+
+	return false;
+}
+#endif
+
+void XMLAttributeMapBase::need_cleanup() const
+{
+	if (_node)
+		_node->need_cleanup();
+}
+
+
+void DocType::parse(const char* p)
+{
+	while(isspace((unsigned char)*p)) ++p;
+
+	const char* start = p;
+	p = get_xmlsym_end_utf8(p);
+	_name.assign(start, p-start);
+
+	while(isspace((unsigned char)*p)) ++p;
+
+	start = p;
+	p = get_xmlsym_end_utf8(p);
+	std::string keyword(p, p-start);	// "PUBLIC" or "SYSTEM"
+
+	while(isspace((unsigned char)*p)) ++p;
+
+	if (*p=='"' || *p=='\'') {
+		char delim = *p;
+
+		start = ++p;
+		while(*p && *p!=delim) ++p;
+
+		if (*p == delim)
+			_public.assign(start, p++-start);
+	} else
+		_public.erase();
+
+	while(isspace((unsigned char)*p)) ++p;
+
+	if (*p=='"' || *p=='\'') {
+		char delim = *p;
+
+		start = ++p;
+		while(*p && *p!=delim) ++p;
+
+		if (*p == delim)
+			_system.assign(start, p++-start);
+	} else
+		_system.erase();
+}
+
+
+void XMLFormat::print_header(std::ostream& out, bool lf) const
+{
+	if (_inhibit_header)
+		return;
+
+	if (_utf8_bom) {
+		 // write UTF-8 signature at file start
+		out.put('\xEF');
+		out.put('\xBB');
+		out.put('\xBF');
+		assert(!_stricmp(_encoding.c_str(), "utf-8"));
+	}
+
+	out << "<?xml version=\"" << _version << "\" encoding=\"" << _encoding << "\"";
+
+	if (_standalone != -1)
+		out << " standalone=\"yes\"";
+
+	out << "?>";
+
+	if (lf)
+		out << _endl;
+
+	if (!_doctype.empty()) {
+		out << "<!DOCTYPE " << _doctype._name;
+
+		if (!_doctype._public.empty()) {
+			out << " PUBLIC \"" << _doctype._public << '"';
 
-	if (!_children.empty() || *content) {
-		out << '>' << content;
+			if (lf)
+				out << _endl;
 
-		if (!_children.empty())
-			out << format._endl;
+			out << " \"" << _doctype._system << '"';
+		} else if (!_doctype._system.empty())
+			out << " SYSTEM \"" << _doctype._system << '"';
 
-		for(Children::const_iterator it=_children.begin(); it!=_children.end(); ++it)
-			(*it)->pretty_write_worker(out, format, indent+1);
+		out << "?>";
 
-		for(int i=indent; i--; )
-			out << XML_INDENT_SPACE;
+		if (lf)
+			out << _endl;
+	}
 
-		out << "</" << EncodeXMLString(*this) << '>' << format._endl;
-	} else
-		out << "/>" << format._endl;
+	for(StyleSheetList::const_iterator it=_stylesheets.begin(); it!=_stylesheets.end(); ++it) {
+		it->print(out);
+
+		if (lf)
+			out << _endl;
+	}
+
+/*	if (!_additional.empty()) {
+		out << _additional;
+
+		if (lf)
+			out << _endl;
+	} */
+}
+
+void StyleSheet::print(std::ostream& out) const
+{
+	out << "<?xml-stylesheet"
+			" href=\"" << _href << "\""
+			" type=\"" << _type << "\"";
+
+	if (!_title.empty())
+		out << " title=\"" << _title << "\"";
+
+	if (!_media.empty())
+		out << " media=\"" << _media << "\"";
+
+	if (!_charset.empty())
+		out << " charset=\"" << _charset << "\"";
+
+	if (_alternate)
+		out << " alternate=\"yes\"";
+
+	out << "?>";
 }
 
 
- /// write node with children tree to output stream using smart formating
-void XMLNode::smart_write_worker(std::ostream& out, const XMLFormat& format, int indent) const
+ /// return formated error message
+std::string XMLError::str() const
 {
-	 // strip the first line feed from _leading
-	const char* leading = _leading.c_str();
-	if (*leading == '\n') ++leading;
+	std::ostringstream out;
 
-	if (!*leading)
-		for(int i=indent; i--; )
-			out << XML_INDENT_SPACE;
-	else
-		out << leading;
+	out << *this;
 
-	out << '<' << EncodeXMLString(*this);
+	return out.str();
+}
 
-	for(AttributeMap::const_iterator it=_attributes.begin(); it!=_attributes.end(); ++it)
-		out << ' ' << EncodeXMLString(it->first) << "=\"" << EncodeXMLString(it->second) << "\"";
 
-	 // strip leading white space from content
-	const char* content = _content.c_str();
-	while(isspace((unsigned char)*content)) ++content;
+ /// return merged error strings
+XS_String XMLErrorList::str(const char* del) const
+{
+	std::ostringstream out;
 
-	if (_children.empty() && !*content)
-		out << "/>";
-	else {
-		out << '>';
+	for(const_iterator it=begin(); it!=end(); ++it)
+		out << *it << del;
 
-		if (_cdata_content)
-			out << CDATA_START << _content << CDATA_END;
-		else if (!*content)
-			out << format._endl;
-		else
-			out << content;
+	return out.str();
+}
 
-		Children::const_iterator it = _children.begin();
 
-		if (it != _children.end()) {
-			for(; it!=_children.end(); ++it)
-				(*it)->smart_write_worker(out, format, indent+1);
+ /// allocate a new chunk, big blocks get a chunk of their own
+void* XMLArena::alloc_chunk(size_t size)
+{
+	size_t hdr = (sizeof(Chunk) + ALIGN-1) & ~(size_t)(ALIGN-1);
+	bool big = size > XS_ARENA_CHUNK/4;
+	size_t chunk_size = big? hdr+size: XS_ARENA_CHUNK;
 
-			 // strip the first line feed from _end_leading
-			const char* end_leading = _end_leading.c_str();
-			if (*end_leading == '\n') ++end_leading;
+	Chunk* chunk = (Chunk*) malloc(chunk_size);
 
-			if (!*end_leading)
-				for(int i=indent; i--; )
-					out << XML_INDENT_SPACE;
-			else
-				out << end_leading;
-		} else
-			out << _end_leading;
+	if (!chunk)
+		throw std::bad_alloc();
 
-		out << "</" << EncodeXMLString(*this) << '>';
+	chunk->_next = _chunks;
+	_chunks = chunk;
+
+	char* p = (char*)chunk + hdr;
+
+	if (!big) {
+		_ptr = p + size;
+		_end = (char*)chunk + chunk_size;
 	}
 
-	if (_trailing.empty())
-		out << format._endl;
-	else
-		out << _trailing;
+	return p;
 }
 
+void XMLArena::add_cleanup(Cleanup* volatile* slot, void (*func)(void* obj, bool destroy), void* obj)
+{
+	Cleanup* cleanup = (Cleanup*) malloc(sizeof(Cleanup));
 
-std::ostream& operator<<(std::ostream& out, const XMLError& err)
+	if (!cleanup)
+		throw std::bad_alloc();
+
+	cleanup->_func = func;
+	cleanup->_obj = obj;
+
+	if (xs_atomic_cas_ptr((void* volatile*)slot, cleanup, NULL)) {
+		free(cleanup);	// registered by another thread
+		return;
+	}
+
+	Cleanup* head;
+
+	do {
+		head = _cleanup;
+		cleanup->_next = head;
+	} while(xs_atomic_cas_ptr((void* volatile*)&_cleanup, cleanup, head) != head);
+}
+
+void XMLArena::release()
 {
-	out << err._systemId << "(" << err._line << ")";
+	 // repeat for the objects registered while handing over memory
+	for(Cleanup* done=NULL; _cleanup!=done; ) {
+		Cleanup* top = _cleanup;
 
-	if (err._column > 1)
-		out << " [column " << err._column << "]";
+		for(Cleanup* cleanup=top; cleanup!=done; cleanup=cleanup->_next)
+			if (cleanup->_obj)
+				cleanup->_func(cleanup->_obj, false);
 
-	out << " : " << err._message;
+		done = top;
+	}
 
-	return out;
+	while(_cleanup) {
+		Cleanup* cleanup = _cleanup;
+		_cleanup = cleanup->_next;
+
+		if (cleanup->_obj)
+			cleanup->_func(cleanup->_obj, true);
+
+		free(cleanup);
+	}
+
+	while(_chunks) {
+		Chunk* next = _chunks->_next;
+		free(_chunks);
+		_chunks = next;
+	}
+
+	_ptr = _end = NULL;
 }
 
 
-#if defined(XS_NATIVE) || defined(XMLNODE_LOCATION)
+volatile long XMLAtomTable::s_next_id = 0;
 
-std::string XMLLocation::str() const
+XMLAtomTable::~XMLAtomTable()
 {
-	std::ostringstream out;
+	for(size_t i=0; i<_hash.size(); ++i)
+		delete _hash[i];
+}
 
-	if (_pdisplay_path)
-		out << _pdisplay_path;
+const XMLAtom* XMLAtomTable::find(const XS_String& name) const
+{
+	if (_hash.empty())
+		return NULL;
 
-	out << "(" << _line << ")";
+	size_t mask = _hash.size() - 1;
 
-	if (_column > 1)
-		out << " [column " << _column << "]";
+	for(size_t h=hash_xs_string(name)&mask; _hash[h]; h=(h+1)&mask)
+		if (_hash[h]->_name == name)
+			return _hash[h];
 
-	out << " :";
+	return NULL;
+}
 
-	return out.str();
+const XMLAtom* XMLAtomTable::intern(const XS_String& name)
+{
+	const XMLAtom* atom = find(name);
+
+	if (atom)
+		return atom;
+
+	 // keep the load factor below 1/2
+	if ((_count+1)*2 > _hash.size()) {
+		std::vector<XMLAtom*> old;
+		old.swap(_hash);
+
+		_hash.resize(old.empty()? 64: old.size()*2, NULL);
+
+		size_t mask = _hash.size() - 1;
+
+		for(size_t i=0; i<old.size(); ++i)
+			if (old[i]) {
+				size_t h = hash_xs_string(old[i]->_name) & mask;
+
+				while(_hash[h])
+					h = (h+1) & mask;
+
+				_hash[h] = old[i];
+			}
+	}
+
+	size_t mask = _hash.size() - 1;
+	size_t h = hash_xs_string(name) & mask;
+
+	while(_hash[h])
+		h = (h+1) & mask;
+
+	XMLAtom* new_atom = new XMLAtom(name, this);
+
+	_hash[h] = new_atom;
+	++_count;
+
+	return new_atom;
 }
 
+
+XMLFileMapping::XMLFileMapping()
+ :	_data(NULL),
+	_len(0)
+{
+#ifdef _WIN32
+	_hFile = INVALID_HANDLE_VALUE;
+	_hMapping = 0;
 #endif
+}
 
+XMLFileMapping::~XMLFileMapping()
+{
+	close();
+}
 
-const char* get_xmlsym_end_utf8(const char* p)
+ /// map the whole file read-only into memory
+bool XMLFileMapping::open(LPCTSTR path)
 {
-	for(; *p; ++p) {
-		char c = *p;
+	close();
 
-		// NameChar ::= Letter | Digit | '.' | '-' | '_' | ':' | CombiningChar | Extender
-		if (c == '\xC3')	// UTF-8 escape character
-			++p;	//TODO only continue on umlaut characters
-		else if (!isalnum(c) && c!='.' && c!='-' && c!='_' && c!=':')
-			break;
+#ifdef _WIN32
+	_hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+
+	if (_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD size_high;
+	DWORD size_low = GetFileSize(_hFile, &size_high);
+
+	if (size_high) {	// no mappings of 4 GB and more
+		close();
+		return false;
 	}
 
-	return p;
+	_len = size_low;
+
+	if (_len) {
+		_hMapping = CreateFileMapping(_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		if (_hMapping)
+			_data = (const char*) MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0);
+
+		if (!_data) {
+			close();
+			return false;
+		}
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+
+	if (fstat(fd, &st) == -1) {
+		::close(fd);
+		return false;
+	}
+
+	_len = (size_t)st.st_size;
+
+	if (_len) {
+		void* addr = mmap(NULL, _len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (addr == MAP_FAILED) {
+			::close(fd);
+			_len = 0;
+			return false;
+		}
+
+		_data = (const char*) addr;
+	}
+
+	::close(fd);
+#endif
+
+	return true;
+}
+
+void XMLFileMapping::close()
+{
+#ifdef _WIN32
+	if (_data)
+		UnmapViewOfFile(_data);
+
+	if (_hMapping)
+		CloseHandle(_hMapping);
+
+	if (_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(_hFile);
+
+	_hFile = INVALID_HANDLE_VALUE;
+	_hMapping = 0;
+#else
+	if (_data)
+		munmap((void*)_data, _len);
+#endif
+
+	_data = NULL;
+	_len = 0;
 }
 
 
-void DocType::parse(const char* p)
+bool XMLFileStamp::get(LPCTSTR path)
 {
-	while(isspace((unsigned char)*p)) ++p;
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
 
-	const char* start = p;
-	p = get_xmlsym_end_utf8(p);
-	_name.assign(start, p-start);
+	if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data))
+		return false;
+
+	_size = ((UINT64)data.nFileSizeHigh<<32) | data.nFileSizeLow;
+	_mtime = ((UINT64)data.ftLastWriteTime.dwHighDateTime<<32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+
+	if (stat(path, &st) == -1)
+		return false;
+
+	_size = (UINT64)st.st_size;
+#ifdef __linux__
+	_mtime = (UINT64)st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec;
+#else
+	_mtime = (UINT64)st.st_mtime;
+#endif
+#endif
+
+	return true;
+}
+
+
+ /// binary snapshot of an XMLDoc, see XMLDoc::write_snapshot()
+ // Layout: Header, string table entries, nodes in preorder starting with the document node,
+ // stylesheets and the zero terminated UTF-8 string data.
+ // Attributes are stored as entity encoded start tag text, which is referenced by the loaded
+ // nodes and decoded on demand like the attributes of parsed XML, see XMLAttributeMapBase.
+ // Numbers are stored in native byte order, as snapshots are only a local cache of XML files.
+struct XMLSnapshot
+{
+	enum {VERSION=2};
+
+	struct Header {
+		char	_magic[4];		// "XSB" VERSION
+		unsigned _byte_order;
+		UINT64	_source_size;	// XMLFileStamp of the XML file
+		UINT64	_source_mtime;
+		unsigned _strings;
+		unsigned _string_bytes;
+		unsigned _nodes;
+		unsigned _stylesheets;
+		unsigned _version;		// XMLFormat strings
+		unsigned _encoding;
+		unsigned _doctype[3];	// name, public, system
+		unsigned _flags;
+		int		_standalone;
+		int		_pretty;
+	};
+
+	struct String {
+		unsigned _offset;
+		unsigned _len;
+	};
+
+	struct Node {
+		unsigned _name;
+		unsigned _leading;
+		unsigned _content;
+		unsigned _end_leading;
+		unsigned _trailing;
+		unsigned _attributes;	// undecoded attribute text
+		unsigned _children;		// number of children
+		unsigned _flags;
+	};
+
+	struct StyleSheetEntry {
+		unsigned _href;
+		unsigned _type;
+		unsigned _title;
+		unsigned _media;
+		unsigned _charset;
+		unsigned _alternate;
+	};
+
+	 /// string table access while reading
+	struct StringTable {
+		const String* _strings;
+		unsigned	_count;
+		const char*	_data;
+
+		bool valid(unsigned i) const {return i < _count;}
+		const char* ptr(unsigned i) const {return _data + _strings[i]._offset;}
+		unsigned len(unsigned i) const {return _strings[i]._len;}
+
+		std::string str(unsigned i) const {return std::string(ptr(i), len(i));}
+		XS_String xs_str(unsigned i) const {return from_utf8(ptr(i), len(i));}
+	};
+
+	enum {BYTE_ORDER_MARK=0x01020304};
+	enum {FLAG_UTF8_BOM=1, FLAG_CRLF=2, FLAG_INHIBIT_HEADER=4};	// Header::_flags
+	enum {NODE_CDATA=1};	// Node::_flags
+
+	unsigned add_string(const char* s, size_t l)
+	{
+		std::string str(s, l);
+		std::map<std::string, unsigned>::const_iterator found = _string_ids.find(str);
+
+		if (found != _string_ids.end())
+			return found->second;
+
+		String entry;
+		entry._offset = (unsigned)_string_data.length();
+		entry._len = (unsigned)l;
+
+		_string_data.append(s, l);
+		_string_data += '\0';
+
+		unsigned id = (unsigned)_strings.size();
+		_strings.push_back(entry);
+		_string_ids[str] = id;
+
+		return id;
+	}
+
+	unsigned add_string(const std::string& s) {return add_string(s.data(), s.length());}
+	unsigned add_string(const XS_RefString& s) {return add_string(s.data(), s.length());}
+
+	unsigned add_xs_string(const XS_String& s)
+	{
+#ifdef XS_STRING_UTF8
+		return add_string(s.data(), s.length());
+#else
+		return add_string(get_utf8(s));
+#endif
+	}
+
+	void add_node(const XMLNode& node)
+	{
+		Node entry;
+
+		entry._name = add_xs_string(node);
+		entry._leading = add_string(node._leading);
+		entry._content = add_string(node._content);
+		entry._end_leading = add_string(node._end_leading);
+		entry._trailing = add_string(node._trailing);
+		entry._children = (unsigned)node.get_children().size();
+		entry._flags = node._cdata_content? NODE_CDATA: 0;
+
+		std::string attributes;
+
+		for(XMLNode::AttributeMap::const_iterator it=node._attributes.begin(); it!=node._attributes.end(); ++it)
+			attributes += ' ' + EncodeXMLString(it->first) + "=\"" + EncodeXMLString(it->second) + '"';
+
+		entry._attributes = add_string(attributes);
+
+		_nodes.push_back(entry);
+
+		const XMLNode::Children& children = node.get_children();
+
+		for(XMLNode::Children::const_iterator it=children.begin(); it!=children.end(); ++it)
+			add_node(**it);
+	}
+
+	bool write(std::ostream& out, const XMLNode& doc, const XMLFormat& format, const XMLFileStamp& source);
+
+	static bool read(const char* data, size_t len, const XMLFileStamp& source, XMLNode& doc, XMLFormat& format, XMLAtomTable* atoms, bool use_arena);
+
+protected:
+	std::map<std::string, unsigned> _string_ids;
+	std::vector<String> _strings;
+	std::string	_string_data;
+	std::vector<Node> _nodes;
+};
+
+bool XMLSnapshot::write(std::ostream& out, const XMLNode& doc, const XMLFormat& format, const XMLFileStamp& source)
+{
+	add_node(doc);
+
+	Header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+
+	hdr._magic[0] = 'X';
+	hdr._magic[1] = 'S';
+	hdr._magic[2] = 'B';
+	hdr._magic[3] = VERSION;
+	hdr._byte_order = BYTE_ORDER_MARK;
+	hdr._source_size = source._size;
+	hdr._source_mtime = source._mtime;
+
+	hdr._version = add_string(format._version);
+	hdr._encoding = add_string(format._encoding);
+	hdr._doctype[0] = add_string(format._doctype._name);
+	hdr._doctype[1] = add_string(format._doctype._public);
+	hdr._doctype[2] = add_string(format._doctype._system);
+	hdr._flags = (format._utf8_bom? FLAG_UTF8_BOM: 0) |
+				 (!strcmp(format._endl, "\r\n")? FLAG_CRLF: 0) |
+				 (format._inhibit_header? FLAG_INHIBIT_HEADER: 0);
+	hdr._standalone = format._standalone;
+	hdr._pretty = format._pretty;
+
+	std::vector<StyleSheetEntry> stylesheets;
+
+	for(StyleSheetList::const_iterator it=format._stylesheets.begin(); it!=format._stylesheets.end(); ++it) {
+		StyleSheetEntry entry;
+
+		entry._href = add_string(it->_href);
+		entry._type = add_string(it->_type);
+		entry._title = add_string(it->_title);
+		entry._media = add_string(it->_media);
+		entry._charset = add_string(it->_charset);
+		entry._alternate = it->_alternate;
+
+		stylesheets.push_back(entry);
+	}
+
+	hdr._strings = (unsigned)_strings.size();
+	hdr._string_bytes = (unsigned)_string_data.length();
+	hdr._nodes = (unsigned)_nodes.size();
+	hdr._stylesheets = (unsigned)stylesheets.size();
+
+	out.write((const char*)&hdr, sizeof(hdr));
+
+	if (!_strings.empty())
+		out.write((const char*)&_strings[0], _strings.size()*sizeof(String));
+
+	out.write((const char*)&_nodes[0], _nodes.size()*sizeof(Node));
+
+	if (!stylesheets.empty())
+		out.write((const char*)&stylesheets[0], stylesheets.size()*sizeof(StyleSheetEntry));
+
+	out.write(_string_data.data(), _string_data.length());
+
+	return out.good();
+}
+
+ /// build the nodes of a snapshot below 'doc' after validating the whole snapshot
+bool XMLSnapshot::read(const char* data, size_t len, const XMLFileStamp& source, XMLNode& doc, XMLFormat& format, XMLAtomTable* atoms, bool use_arena)
+{
+	if (len < sizeof(Header))
+		return false;
+
+	const Header& hdr = *(const Header*)data;
+
+	if (memcmp(hdr._magic, "XSB", 3) || hdr._magic[3]!=VERSION || hdr._byte_order!=BYTE_ORDER_MARK)
+		return false;
 
-	while(isspace((unsigned char)*p)) ++p;
+	if (!source.empty() && (hdr._source_size!=source._size || hdr._source_mtime!=source._mtime))
+		return false;
 
-	start = p;
-	p = get_xmlsym_end_utf8(p);
-	std::string keyword(p, p-start);	// "PUBLIC" or "SYSTEM"
+	UINT64 size = sizeof(Header) + (UINT64)hdr._strings*sizeof(String) + (UINT64)hdr._nodes*sizeof(Node)
+				+ (UINT64)hdr._stylesheets*sizeof(StyleSheetEntry) + hdr._string_bytes;
 
-	while(isspace((unsigned char)*p)) ++p;
+	if (size!=len || !hdr._nodes)
+		return false;
 
-	if (*p=='"' || *p=='\'') {
-		char delim = *p;
+	const String* strings = (const String*)(&hdr + 1);
+	const Node* nodes = (const Node*)(strings + hdr._strings);
+	const StyleSheetEntry* stylesheets = (const StyleSheetEntry*)(nodes + hdr._nodes);
 
-		start = ++p;
-		while(*p && *p!=delim) ++p;
+	StringTable table;
+	table._strings = strings;
+	table._count = hdr._strings;
+	table._data = (const char*)(stylesheets + hdr._stylesheets);
 
-		if (*p == delim)
-			_public.assign(start, p++-start);
-	} else
-		_public.erase();
+	 // validate string references and the preorder structure before creating any node
+	for(unsigned i=0; i<hdr._strings; ++i)
+		if (strings[i]._offset >= hdr._string_bytes || strings[i]._len >= hdr._string_bytes-strings[i]._offset)
+			return false;
 
-	while(isspace((unsigned char)*p)) ++p;
+	if (!table.valid(hdr._version) || !table.valid(hdr._encoding) ||
+		!table.valid(hdr._doctype[0]) || !table.valid(hdr._doctype[1]) || !table.valid(hdr._doctype[2]))
+		return false;
 
-	if (*p=='"' || *p=='\'') {
-		char delim = *p;
+	UINT64 need = 1;	// nodes still to come
 
-		start = ++p;
-		while(*p && *p!=delim) ++p;
+	for(unsigned i=0; i<hdr._nodes; ++i) {
+		const Node& node = nodes[i];
 
-		if (*p == delim)
-			_system.assign(start, p++-start);
-	} else
-		_system.erase();
-}
+		if (!need || !table.valid(node._name) || !table.valid(node._leading) || !table.valid(node._content) ||
+			!table.valid(node._end_leading) || !table.valid(node._trailing) || !table.valid(node._attributes))
+			return false;
 
+		need += node._children;
+		--need;
+	}
 
-void XMLFormat::print_header(std::ostream& out, bool lf) const
-{
-	if (_inhibit_header)
-		return;
+	if (need)
+		return false;
 
-	if (_utf8_bom) {
-		 // write UTF-8 signature at file start
-		out.put('\xEF');
-		out.put('\xBB');
-		out.put('\xBF');
-		assert(!_stricmp(_encoding.c_str(), "utf-8"));
+	for(unsigned i=0; i<hdr._stylesheets; ++i) {
+		const StyleSheetEntry& entry = stylesheets[i];
+
+		if (!table.valid(entry._href) || !table.valid(entry._type) || !table.valid(entry._title) ||
+			!table.valid(entry._media) || !table.valid(entry._charset))
+			return false;
 	}
 
-	out << "<?xml version=\"" << _version << "\" encoding=\"" << _encoding << "\"";
+	format._version = table.str(hdr._version);
+	format._encoding = table.str(hdr._encoding);
+	format._doctype._name = table.str(hdr._doctype[0]);
+	format._doctype._public = table.str(hdr._doctype[1]);
+	format._doctype._system = table.str(hdr._doctype[2]);
+	format._utf8_bom = (hdr._flags & FLAG_UTF8_BOM) != 0;
+	format._endl = hdr._flags&FLAG_CRLF? "\r\n": "\n";
+	format._inhibit_header = (hdr._flags & FLAG_INHIBIT_HEADER) != 0;
+	format._standalone = hdr._standalone;
+	format._pretty = (PRETTY_FLAGS)hdr._pretty;
+
+	format._stylesheets.clear();
+
+	for(unsigned i=0; i<hdr._stylesheets; ++i) {
+		const StyleSheetEntry& entry = stylesheets[i];
+		StyleSheet stylesheet;
+
+		stylesheet._href = table.str(entry._href);
+		stylesheet._type = table.str(entry._type);
+		stylesheet._title = table.str(entry._title);
+		stylesheet._media = table.str(entry._media);
+		stylesheet._charset = table.str(entry._charset);
+		stylesheet._alternate = entry._alternate != 0;
+
+		format._stylesheets.push_back(stylesheet);
+	}
 
-	if (_standalone != -1)
-		out << " standalone=\"yes\"";
+	 // intern each name of the string table only once
+	std::vector<const XMLAtom*> name_atoms(atoms? hdr._strings: 0, (const XMLAtom*)NULL);
 
-	out << "?>";
+	std::vector<std::pair<XMLNode*, unsigned> > stack;	// parent nodes with the number of missing children
 
-	if (lf)
-		out << _endl;
+	for(unsigned i=0; i<hdr._nodes; ++i) {
+		const Node& entry = nodes[i];
+		XMLNode* node;
 
-	if (!_doctype.empty()) {
-		out << "<!DOCTYPE " << _doctype._name;
+		if (!i)
+			node = &doc;	// the document node itself only contributes its children
+		else {
+			while(!stack.back().second)
+				stack.pop_back();
 
-		if (!_doctype._public.empty()) {
-			out << " PUBLIC \"" << _doctype._public << '"';
+			if (atoms) {
+				const XMLAtom*& atom = name_atoms[entry._name];
 
-			if (lf)
-				out << _endl;
+				if (!atom)
+					atom = atoms->intern(table.xs_str(entry._name));
 
-			out << " \"" << _doctype._system << '"';
-		} else if (!_doctype._system.empty())
-			out << " SYSTEM \"" << _doctype._system << '"';
+				node = XMLNode::create(atom, doc._arena, use_arena);
+			} else
+				node = XMLNode::create(table.xs_str(entry._name), doc._arena, use_arena);
 
-		out << "?>";
+			stack.back().first->add_child(node);
+			--stack.back().second;
 
-		if (lf)
-			out << _endl;
-	}
+			 // white space and content reference the mapped snapshot
+			node->_leading.append_ref(table.ptr(entry._leading), table.len(entry._leading));
+			node->_content.append_ref(table.ptr(entry._content), table.len(entry._content));
+			node->_end_leading.append_ref(table.ptr(entry._end_leading), table.len(entry._end_leading));
+			node->_trailing.append_ref(table.ptr(entry._trailing), table.len(entry._trailing));
+			node->_cdata_content = (entry._flags & NODE_CDATA) != 0;
+		}
 
-	for(StyleSheetList::const_iterator it=_stylesheets.begin(); it!=_stylesheets.end(); ++it) {
-		it->print(out);
+		if (table.len(entry._attributes))
+			node->_attributes.set_raw_ref(table.ptr(entry._attributes), table.len(entry._attributes));
 
-		if (lf)
-			out << _endl;
+		if (entry._children)
+			stack.push_back(std::make_pair(node, entry._children));
 	}
 
-/*	if (!_additional.empty()) {
-		out << _additional;
-
-		if (lf)
-			out << _endl;
-	} */
+	return true;
 }
 
-void StyleSheet::print(std::ostream& out) const
+bool XMLDoc::write_snapshot(LPCTSTR path, const XMLFileStamp& source) const
 {
-	out << "<?xml-stylesheet"
-			" href=\"" << _href << "\""
-			" type=\"" << _type << "\"";
-
-	if (!_title.empty())
-		out << " title=\"" << _title << "\"";
+	tofstream out(path);
 
-	if (!_media.empty())
-		out << " media=\"" << _media << "\"";
+	XMLSnapshot snapshot;
 
-	if (!_charset.empty())
-		out << " charset=\"" << _charset << "\"";
+	return snapshot.write(out, *this, _format, source);
+}
 
-	if (_alternate)
-		out << " alternate=\"yes\"";
+bool XMLDoc::read_snapshot(LPCTSTR path, const XMLFileStamp& source)
+{
+	XMLFileMapping* mapping = new XMLFileMapping;
 
-	out << "?>";
-}
+	if (!mapping->open(path)) {
+		delete mapping;
+		return false;
+	}
 
+	release_unused();
 
- /// return formated error message
-std::string XMLError::str() const
-{
-	std::ostringstream out;
+	 // the nodes are collected below a node of this document to refer to its arena and mappings
+	XMLNode* doc = XMLNode::create(XS_String(), &_doc_arena, false);
+	XMLFormat format;
 
-	out << *this;
+	bool ok = XMLSnapshot::read(mapping->data(), mapping->length(), source, *doc, format, _atoms.get(), _use_arena);
 
-	return out.str();
-}
+	if (ok) {
+		_mappings.push_back(mapping);
 
+		move_children(*doc);
+		_format = format;
+	}
 
- /// return merged error strings
-XS_String XMLErrorList::str(const char* del) const
-{
-	std::ostringstream out;
+	delete doc;
 
-	for(const_iterator it=begin(); it!=end(); ++it)
-		out << *it << del;
+	if (!ok)
+		delete mapping;
 
-	return out.str();
+	return ok;
 }
 
 
 void XMLReaderBase::finish_read()
 {
 	if (_pos != NULL) {
-		if (_pos->_children.empty())
-			_pos->_trailing.append(_content);
-		else
-			_pos->_children.back()->_trailing.append(_content);
+		if (_pos->get_children().empty())
+			_pos->_trailing.append(_content, text_arena());
+		else {
+			_pos->get_children().back()->_trailing.append(_content, text_arena());
+			_pos->get_children().back()->_modified = true;
+		}
 	}
 
 	_content.erase();
@@ -935,7 +2796,7 @@ void XMLReaderBase::XmlDeclHandler(const char* version, const char* encoding, in
  /// notifications about XML start tag
 void XMLReaderBase::StartElementHandler(const XS_String& name, const XMLNode::AttributeMap& attributes)
 {
-	const char* s = _content.c_str();
+	const char* s = _content.data();
 	const char* e = s + _content.length();
 	const char* p = s;
 
@@ -945,23 +2806,23 @@ void XMLReaderBase::StartElementHandler(const XS_String& name, const XMLNode::At
 			break;
 
 	if (p != s) {
-		if (_pos->_children.empty()) {	// no children in last node?
+		if (_pos->get_children().empty()) {	// no children in last node?
 			if (_last_tag == TAG_START)
-				_pos->_content.append(s, p-s);
+				_pos->_content.append(_content, s, p-s, text_arena());
 			else if (_last_tag == TAG_END)
-				_pos->_trailing.append(s, p-s);
+				_pos->_trailing.append(_content, s, p-s, text_arena());
 			else // TAG_NONE at root node
 				p = s;
-		} else
-			_pos->_children.back()->_trailing.append(s, p-s);
+		} else {
+			_pos->get_children().back()->_trailing.append(_content, s, p-s, text_arena());
+			_pos->get_children().back()->_modified = true;
+		}
 	}
 
-	std::string leading;
+	XMLNode* node = _atoms? XMLNode::create(_atoms->intern(name), _arena, _use_arena): XMLNode::create(name, _arena, _use_arena);
 
 	if (p != e)
-		leading.assign(p, e-p);
-
-	XMLNode* node = new XMLNode(name, leading);
+		node->_leading.append(_content, p, e-p, text_arena());
 
 	_pos.add_down(node);
 
@@ -969,7 +2830,12 @@ void XMLReaderBase::StartElementHandler(const XS_String& name, const XMLNode::At
 	node->_location = get_location();
 #endif
 
-	node->_attributes = attributes;
+	node->_attributes.assign_parsed(attributes, text_arena());
+
+	 // share the attribute name strings with the atom table, lazily decoded names are not interned
+	if (_atoms && !attributes.has_raw())
+		for(XMLNode::AttributeMap::iterator it=node->_attributes.begin(); it!=node->_attributes.end(); ++it)
+			it->first = _atoms->intern(it->first)->_name;
 
 	_last_tag = TAG_START;
 	_content.erase();
@@ -978,11 +2844,11 @@ void XMLReaderBase::StartElementHandler(const XS_String& name, const XMLNode::At
  /// notifications about XML end tag
 void XMLReaderBase::EndElementHandler()
 {
-	const char* s = _content.c_str();
+	const char* s = _content.data();
 	const char* e = s + _content.length();
 	const char* p;
 
-	if (!strncmp(s,CDATA_START,9) && !strncmp(e-3,CDATA_END,3)) {
+	if (e-s>=12 && !strncmp(s,CDATA_START,9) && !strncmp(e-3,CDATA_END,3)) {
 		s += 9;
 		p = (e-=3);
 
@@ -997,16 +2863,18 @@ void XMLReaderBase::EndElementHandler()
 	}
 
 	if (p != s) {
-		if (_pos->_children.empty())	// no children in current node?
-			_pos->_content.append(s, p-s);
+		if (_pos->get_children().empty())	// no children in current node?
+			_pos->_content.append(_content, s, p-s, text_arena());
 		else if (_last_tag == TAG_START)
-			_pos->_content.append(s, p-s);
+			_pos->_content.append(_content, s, p-s, text_arena());
 		else
-			_pos->_children.back()->_trailing.append(s, p-s);
+			_pos->get_children().back()->_trailing.append(_content, s, p-s, text_arena());
 	}
 
-	if (p != e)
-		_pos->_end_leading.assign(p, e-p);
+	if (p != e) {
+		_pos->_end_leading.erase();
+		_pos->_end_leading.append(_content, p, e-p, text_arena());
+	}
 
 	_pos.back();
 
@@ -1016,10 +2884,24 @@ void XMLReaderBase::EndElementHandler()
 
 #if defined(XS_USE_XERCES) || defined(XS_USE_EXPAT)
  /// store content, white space and comments
+ // The parser slices are appended directly, UTF-16 text is converted through a stack buffer.
 void XMLReaderBase::DefaultHandler(const XML_Char* s, int len)
 {
 #if defined(XML_UNICODE) || defined(XS_USE_XERCES)
-	_content.append(String_from_XML_Char(s, len));
+	char buffer[3*1024];
+
+	while(len > 0) {
+		int l = len>1024? 1024: len;
+
+		 // don't split surrogate pairs
+		if (l<len && (s[l-1]&0xFC00)==0xD800)
+			--l;
+
+		_content.append(buffer, utf16_to_utf8((const XS_UTF16*)s, l, buffer));
+
+		s += l;
+		len -= l;
+	}
 #else
 	_content.append(s, len);
 #endif
@@ -1134,6 +3016,241 @@ void XMLWriter::write(const std::string& s)
 }
 
 
+XMLWriteBuffer::XMLWriteBuffer(std::ostream& out, size_t size)
+ :	_out(&out),
+	_fd(-1),
+	_good(true)
+{
+	_buffer = _ptr = new char[size];
+	_end = _buffer + size;
+}
+
+XMLWriteBuffer::XMLWriteBuffer(int fd, size_t size)
+ :	_out(NULL),
+	_fd(fd),
+	_good(fd != -1)
+{
+	_buffer = _ptr = new char[size];
+	_end = _buffer + size;
+}
+
+XMLWriteBuffer::~XMLWriteBuffer()
+{
+	flush();
+
+	delete [] _buffer;
+}
+
+bool XMLWriteBuffer::flush()
+{
+	size_t l = _ptr - _buffer;
+
+	_ptr = _buffer;
+
+	return write_out(_buffer, l);
+}
+
+bool XMLWriteBuffer::write_out(const char* p, size_t l)
+{
+	if (!l || !_good)
+		return _good;
+
+	if (_out) {
+		_out->write(p, l);
+
+		if (!_out->good())
+			_good = false;
+	} else {
+		while(l) {
+#ifdef _WIN32
+			int n = _write(_fd, p, (unsigned)l);
+#else
+			ssize_t n = ::write(_fd, p, l);
+
+			if (n==-1 && errno==EINTR)
+				continue;
+#endif
+
+			if (n <= 0) {
+				_good = false;
+				break;
+			}
+
+			p += n;
+			l -= n;
+		}
+	}
+
+	return _good;
+}
+
+ /// append a string not fitting into the remaining buffer space
+void XMLWriteBuffer::append_long(const char* s, size_t l)
+{
+	 // fill up the buffer to flush it in full chunks
+	size_t n = _end - _ptr;
+
+	memcpy(_ptr, s, n);
+	_ptr += n;
+	s += n;
+	l -= n;
+
+	flush();
+
+	if (l >= (size_t)(_end-_buffer))
+		write_out(s, l);	// pass big blocks through without copying them
+	else {
+		memcpy(_ptr, s, l);
+		_ptr += l;
+	}
+}
+
+
+void XMLStreamWriter::write_header()
+{
+	std::ostringstream out;
+
+	_format.print_header(out, false);	// _format._endl is printed in create()
+
+	_buffer.append(out.str());
+}
+
+void XMLStreamWriter::write_indent(size_t level)
+{
+	if (_format._pretty >= PRETTY_LINEFEED)
+		_buffer.append(_format._endl);
+
+	if (_format._pretty == PRETTY_INDENT)
+		while(level--)
+			_buffer.append(XML_INDENT_SPACE);
+}
+
+void XMLStreamWriter::write_encoded(const XS_String& s)
+{
+#ifdef XS_STRING_UTF8
+	encode_xml_utf8(_buffer, s.c_str(), s.length());
+#else
+	const std::string& utf8_str = get_utf8(s);
+	encode_xml_utf8(_buffer, utf8_str.c_str(), utf8_str.length());
+#endif
+}
+
+void XMLStreamWriter::close_pre()
+{
+	StackEntry& entry = _stack.back();
+
+	if (!entry._closed) {
+		_buffer.append('>');
+		entry._closed = true;
+	}
+}
+
+void XMLStreamWriter::create(const XS_String& name)
+{
+	if (!_stack.empty()) {
+		close_pre();
+		_stack.back()._children = true;
+	}
+
+	write_indent(_stack.size());
+
+	size_t pos = _names.length();
+
+	_buffer.append('<');
+	write_encoded(name);
+
+	 // remember the encoded name for the end tag
+#ifdef XS_STRING_UTF8
+	encode_xml_utf8(_names, name.c_str(), name.length());
+#else
+	_names += EncodeXMLString(name);
+#endif
+
+	StackEntry entry;
+	entry._name_pos = pos;
+	entry._closed = false;
+	entry._children = false;
+	entry._content = false;
+	_stack.push_back(entry);
+}
+
+bool XMLStreamWriter::back()
+{
+	if (_stack.empty()) {
+		assert(!_stack.empty());
+		return false;
+	}
+
+	StackEntry& entry = _stack.back();
+
+	if (entry._children || entry._content) {
+		if (!entry._content)
+			write_indent(_stack.size()-1);
+
+		_buffer.append("</", 2);
+		_buffer.append(_names.data()+entry._name_pos, _names.length()-entry._name_pos);
+		_buffer.append('>');
+	} else
+		_buffer.append("/>", 2);
+
+	_names.resize(entry._name_pos);
+	_stack.pop_back();
+
+	return true;
+}
+
+void XMLStreamWriter::put(const XS_String& attr_name, const XS_String& value)
+{
+	if (_stack.empty() || _stack.back()._closed) {
+		assert(!"XMLStreamWriter::put() after content or child nodes");
+		return;
+	}
+
+	_buffer.append(' ');
+	write_encoded(attr_name);
+	_buffer.append("=\"", 2);
+	write_encoded(value);
+	_buffer.append('"');
+}
+
+void XMLStreamWriter::set_content(const XS_String& s, bool cdata)
+{
+	if (_stack.empty() || s.empty())
+		return;
+
+	close_pre();
+	_stack.back()._content = true;
+
+	if (cdata)
+		_buffer.append(EncodeXMLString(s, true));
+	else
+		write_encoded(s);
+}
+
+void XMLStreamWriter::set_encoded_content(const std::string& s)
+{
+	if (_stack.empty() || s.empty())
+		return;
+
+	close_pre();
+	_stack.back()._content = true;
+
+	_buffer.append(s);
+}
+
+void XMLStreamWriter::write(const std::string& s)
+{
+	if (!_stack.empty()) {
+		close_pre();
+		_stack.back()._content = true;
+	}
+
+	_buffer.append(s);
+}
+
+
+#ifdef XS_NATIVE
+
  /// XPath find function
 bool XMLStreamReader::find_relative(const XPath& xpath)
 {
@@ -1151,6 +3268,12 @@ bool XMLStreamReader::find_node(LPCXSSTR target_tag, int target_level, int min_l
 {
 	bool found = false;
 
+	 // let the parser skip elements which can't contain the target node
+	_skip = true;
+	_skip_tag = target_tag;
+	_skip_level = target_level;
+	_skip_stop_on_others = stop_on_others;
+
 	for(; _state_rdr.has_next(); _state_rdr.next()) {
 		switch(_state_rdr._state) {
 			case XMLStateReader::XSS_START_ELEMENT: {
@@ -1160,9 +3283,10 @@ bool XMLStreamReader::find_node(LPCXSSTR target_tag, int target_level, int min_l
 
 				 // check for match in target level and eventually node name
 				if (_level+1 == target_level) {
-					if (target_tag==NULL || _state_rdr._node_name==target_tag)
+					if (target_tag==NULL || _state_rdr._node_name==target_tag) {
 						found = true;
-					else if (stop_on_others)
+						_skip = false;	// keep the children of the found node
+					} else if (stop_on_others)
 						return false;
 				}
 
@@ -1176,9 +3300,10 @@ bool XMLStreamReader::find_node(LPCXSSTR target_tag, int target_level, int min_l
 
 				 // check for match in target level and eventually node name
 				if (_level+1 == target_level) {
-					if (target_tag==NULL || _state_rdr._node_name==target_tag)
+					if (target_tag==NULL || _state_rdr._node_name==target_tag) {
 						found = true;
-					else if (stop_on_others)
+						_skip = false;	// keep the children of the found node
+					} else if (stop_on_others)
 						return false;
 				}
 
@@ -1198,6 +3323,7 @@ bool XMLStreamReader::find_node(LPCXSSTR target_tag, int target_level, int min_l
 
 				 // stop searching if the current level leaves the target range; used by back()
 				if (_level < min_level) {
+					_skip = false;
 					_state_rdr.next();
 					return false;
 				}
@@ -1216,6 +3342,8 @@ bool XMLStreamReader::find_node(LPCXSSTR target_tag, int target_level, int min_l
 		}
 	} break_parsingLoop:
 
+	_skip = false;
+
 	if (found) {
 		_node.set_encoded_content(_content);
 		_content.erase();
@@ -1224,9 +3352,26 @@ bool XMLStreamReader::find_node(LPCXSSTR target_tag, int target_level, int min_l
 		return false;
 }
 
+ /// return true if the element 'name' starting at level _level+1 can't be or contain the node searched by find_node()
+bool XMLStreamReader::skip_element(const XS_String& name) const
+{
+	if (!_skip)
+		return false;
+
+	int level = _level + 1;
+
+	if (_skip_level<0 || level>_skip_level)
+		return true;	// deeper than the target level
+
+	if (level==_skip_level && _skip_tag && name!=_skip_tag && !_skip_stop_on_others)
+		return true;	// sibling with other name
+
+	return false;
+}
+
 void XMLStreamReader::StartElementHandler(const XS_String& name, const XMLNode::AttributeMap& attr)
 {
-	_node.assign(name);
+	_node.set_name(name);
 	_node.get_attributes() = attr;
 	_content.erase();
 
@@ -1274,6 +3419,17 @@ void XMLStateReader::StartElementHandler(const XS_String& name, const XMLNode::A
 	_state = XSS_START_ELEMENT;
 }
 
+bool XMLStateReader::SkipElementHandler(const XS_String& name)
+{
+	return _stream && _stream->skip_element(name);
+}
+
+bool XMLStateReader::SkipTextHandler()
+{
+	 // text is only needed as content of the found node
+	return _stream && _stream->_skip;
+}
+
 void XMLStateReader::EndElementHandler()
 {
 //	_node_name.erase();
@@ -1304,5 +3460,7 @@ void XMLStateReader::XmlDeclHandler(const char* version, const char* encoding, i
 }
 */
 
+#endif // XS_NATIVE
+
 
 }	// namespace XMLStorage
@@ -95,7 +95,15 @@ typedef XMLCh XML_Char;
 
 #elif defined(XS_USE_EXPAT)
 
+#ifdef XS_EXPAT_H
+#include XS_EXPAT_H	// e.g. <expat.h> for system wide installations
+#else
 #include <expat/expat.h>
+#endif
+
+#ifndef XS_EXPAT_CHUNK_SIZE
+#define XS_EXPAT_CHUNK_SIZE 0x40000	// default number of bytes passed to Expat per parse call
+#endif
 
 #else
 #define XS_NATIVE
@@ -178,8 +186,11 @@ typedef XMLCh XML_Char;
 
 #include <wchar.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>	// strcasecmp()
 #include <stdarg.h>
+#include <ctype.h>
+#include <sched.h>	// sched_yield()
 
 typedef char CHAR;
 #ifdef _WCHAR_T_DEFINED
@@ -214,11 +225,27 @@ typedef const CHAR* LPCTSTR;
 #define _tcsicmp strcasecmp
 #define strnicmp strncasecmp
 #define _tcsnicmp strncasecmp
+
+#define _T(x) x
+#define _istspace isspace
+#define _tcschr strchr
+#define _tcsrchr strrchr
+#define _tcscmp strcmp
+#define _tcsncmp strncmp
+#define _tcscpy strcpy
+#define _tcsncpy strncpy
+#define _tcstol strtol
+#define _ttoi64 atoll
+#define _atoi64 atoll
 #endif // UNICODE
 
+typedef long long INT64;
+typedef unsigned long long UINT64;
+
 #endif // _WIN32
 
 #include <assert.h>
+#include <stddef.h>
 
 #ifdef __BORLANDC__
 #define _stricmp stricmp
@@ -230,7 +257,9 @@ typedef const CHAR* LPCTSTR;
 #include <string>
 #include <stack>
 #include <list>
+#include <vector>
 #include <map>
+#include <new>
 
 
 #ifndef BUFFER_LEN
@@ -243,6 +272,22 @@ typedef const CHAR* LPCTSTR;
 #define ALLOCA_MAX 0x10000
 #endif
 
+#ifndef READ_BLOCK_LEN
+#define READ_BLOCK_LEN 0x10000	// input window size for block reads in the XS-native parser
+#endif
+
+#ifndef XS_PARALLEL_CHUNK_MIN
+#define XS_PARALLEL_CHUNK_MIN 0x40000	// minimal chunk size of XMLDoc::read_file_parallel()
+#endif
+
+#ifndef XS_WRITE_CACHE_DEPTH
+#define XS_WRITE_CACHE_DEPTH 3	// deepest node level whose text is kept by XMLWriteCache
+#endif
+
+#ifndef XS_ARENA_CHUNK
+#define XS_ARENA_CHUNK 0x10000	// chunk size of XMLArena
+#endif
+
 
 namespace XMLStorage {
 
@@ -326,6 +371,55 @@ else h = b = (T*)malloc(sizeof(T)*l)
 
 extern const char* get_xmlsym_end_utf8(const char* p);
 
+ /// find first occurrence of character c in [p, end), return end if not found
+extern const char* find_xml_char(const char* p, const char* end, char c);
+
+ /// find the closing bracket of the markup whose name starts at s behind '<', return end if not found
+ // Comments and CDATA sections end behind "--" resp. "]]", all other markup at the first '>'.
+extern const char* find_markup_end(const char* s, const char* end);
+
+ /// find first character in [p, end) to be escaped by EncodeXMLString(), return end if not found
+extern const char* find_xml_special(const char* p, const char* end);
+
+
+#ifdef _WIN32
+typedef WCHAR XS_UTF16;
+#else
+typedef unsigned short XS_UTF16;
+#endif
+
+ /// convert UTF-8 to UTF-16, 'out' needs room for 'l' code units; returns the number of code units written
+ // Invalid sequences are replaced by U+FFFD. ASCII runs are widened in SIMD blocks.
+extern size_t utf8_to_utf16(const char* s, size_t l, XS_UTF16* out);
+
+ /// convert UTF-16 to UTF-8, 'out' needs room for 3*l bytes; returns the number of bytes written
+ // Unpaired surrogates are replaced by U+FFFD. ASCII runs are narrowed in SIMD blocks.
+extern size_t utf16_to_utf8(const XS_UTF16* s, size_t l, char* out);
+
+ /// append UTF-16 string 's' converted to UTF-8 to 'out'
+inline void append_utf8(std::string& out, const XS_UTF16* s, size_t l)
+{
+	if (l) {
+		size_t pos = out.length();
+
+		out.resize(pos + 3*l);
+		out.resize(pos + utf16_to_utf8(s, l, &out[pos]));
+	}
+}
+
+#ifdef _WIN32
+ /// append UTF-8 string 's' converted to UTF-16 to 'out'
+inline void append_utf16(std::wstring& out, const char* s, size_t l)
+{
+	if (l) {
+		size_t pos = out.length();
+
+		out.resize(pos + l);
+		out.resize(pos + utf8_to_utf16(s, l, &out[pos]));
+	}
+}
+#endif
+
 
 #if defined(_STRING_DEFINED) && !defined(XS_STRING_UTF8)
 
@@ -370,8 +464,8 @@ struct XS_String
 	XS_String(const std::wstring& ws) {assign(ws.c_str());}
 	XS_String& operator=(LPCWSTR s) {assign(s); return *this;}
 #ifdef XS_STRING_UTF8
-	void assign(LPCWSTR s) {if (s) {size_t bl=4*wcslen(s); TMP_ALLOC(char, b, h, bl); super::assign(b, WideCharToMultiByte(CP_UTF8, 0, s, (int)bl, b, (int)bl, 0, 0));} else erase();}
-	void assign(LPCWSTR s, size_t l) {if (s) {size_t bl=4*l; TMP_ALLOC(char, b, h, bl); super::assign(b, WideCharToMultiByte(CP_UTF8, 0, s, (int)l, b, (int)bl, 0, 0));} else erase();}
+	void assign(LPCWSTR s) {erase(); if (s) append_utf8(*this, s, wcslen(s));}
+	void assign(LPCWSTR s, size_t l) {erase(); if (s) append_utf8(*this, s, l);}
 #else // if !UNICODE && !XS_STRING_UTF8
 	void assign(LPCWSTR s) {if (s) {size_t bl=wcslen(s); TMP_ALLOC(char, b, h, bl); super::assign(b, WideCharToMultiByte(CP_ACP, 0, s, (int)bl, b, (int)bl, 0, 0));} else erase();}
 	void assign(LPCWSTR s, size_t l) {if (s) {size_t bl=l; TMP_ALLOC(char, b, h, bl); super::assign(b, WideCharToMultiByte(CP_ACP, 0, s, (int)l, b, (int)bl, 0, 0));} else erase();}
@@ -398,7 +492,7 @@ struct XS_String
 
 #ifdef _WIN32
 #ifdef XS_STRING_UTF8
-	operator std::wstring() const {size_t bl=length(); TMP_ALLOC(WCHAR, b, h, bl); return std::wstring(b, MultiByteToWideChar(CP_UTF8, 0, c_str(), bl, b, bl));}
+	operator std::wstring() const {std::wstring ret; append_utf16(ret, c_str(), length()); return ret;}
 #elif defined(UNICODE)
 	operator std::string() const {size_t bl=length(); TMP_ALLOC(char, b, h, bl); return std::string(b, WideCharToMultiByte(CP_ACP, 0, c_str(), (int)bl, b, (int)bl, 0, 0));}
 #else
@@ -554,20 +648,21 @@ inline XS_String from_utf8(const char* s, size_t l)
  // from UTF-8 to XS internal string encoding
 inline void assign_utf8(XS_String& s, const char* str, size_t lutf8)
 {
-	// Benutzung von malloc() fr Strings grer als BUFFER_LEN
 #ifdef UNICODE
-	TMP_ALLOC(TCHAR, buffer, h, lutf8);
-	int l = MultiByteToWideChar(CP_UTF8, 0, str, (int)lutf8, buffer, (int)lutf8);
+	 // convert directly into the string buffer
+	s.erase();
+	append_utf16(s, str, lutf8);
 #else
+	// Benutzung von malloc() fr Strings grer als BUFFER_LEN
 	TMP_ALLOC(WCHAR, wbuffer, hw, lutf8);
-	int l = MultiByteToWideChar(CP_UTF8, 0, str, (int)lutf8, wbuffer, (int)lutf8);
+	int l = (int)utf8_to_utf16(str, lutf8, wbuffer);
 
 	int bl = 2*l;
 	TMP_ALLOC(char, buffer, h, bl);
 	l = WideCharToMultiByte(CP_ACP, 0, wbuffer, l, buffer, bl, 0, 0);
-#endif
 
 	s.assign(buffer, l);
+#endif
 }
 
  // from UTF-8 to XS internal string encoding
@@ -579,34 +674,32 @@ inline void assign_utf8(XS_String& s, const char* str)
  // from XS internal string encoding to UTF-8
 inline std::string get_utf8(LPCTSTR s, size_t l)
 {
+	std::string ret;
+
 #ifdef UNICODE
-	size_t bl = 4*l;
-	TMP_ALLOC(char, buffer, h, bl);
-	l = WideCharToMultiByte(CP_UTF8, 0, s, (int)l, buffer, (int)bl, 0, 0);
+	append_utf8(ret, s, l);
 #else
 	TMP_ALLOC(WCHAR, wbuffer, hw, l);
 	l = MultiByteToWideChar(CP_ACP, 0, s, (int)l, wbuffer, (int)l);
 
-	size_t bl = 4*l;
-	TMP_ALLOC(char, buffer, h, bl);
-	l = WideCharToMultiByte(CP_UTF8, 0, wbuffer, (int)l, buffer, (int)bl, 0, 0);
+	append_utf8(ret, wbuffer, l);
 #endif
 
-	return std::string(buffer, l);
+	return ret;
 }
 
 #ifdef UNICODE
  // from XS internal string encoding to UTF-8
 inline std::string get_utf8(const char* s, size_t l)
 {
+	std::string ret;
+
 	TMP_ALLOC(WCHAR, wbuffer, wh, l);
 	l = MultiByteToWideChar(CP_ACP, 0, s, (int)l, wbuffer, (int)l);
 
-	size_t bl = 4*l;
-	TMP_ALLOC(char, buffer, h, bl);
-	l = WideCharToMultiByte(CP_UTF8, 0, wbuffer, (int)l, buffer, (int)bl, 0, 0);
+	append_utf8(ret, wbuffer, l);
 
-	return std::string(buffer, l);
+	return ret;
 }
 #endif
 
@@ -858,6 +951,7 @@ protected:
 	int	_line;
 	int	_column;
 
+	friend struct XMLReaderBase;
 	friend struct XMLReader;
 };
 #endif
@@ -881,6 +975,7 @@ struct XMLError
 	{
 	}
 
+#if defined(XS_NATIVE) || defined(XMLNODE_LOCATION)
 	XMLError(const XMLLocation& location, const char* msg)
 	 :	_systemId(location.get_path()),
 		_line(location.get_line()),
@@ -889,6 +984,7 @@ struct XMLError
 		_message(msg)
 	{
 	}
+#endif
 
 	std::string str() const;
 
@@ -1036,136 +1132,467 @@ enum WRITE_MODE {
 };
 
 
+ /// bump allocator for document nodes and text releasing all its memory at once, see XMLDoc::use_arena()
+ // Memory is always taken from an explicitly passed arena. Arena objects holding memory outside
+ // of the arena register for cleanup, all others are released without calling their destructors.
+struct XMLArena
+{
+	 /// registration of an arena object to be destroyed when releasing the arena, see add_cleanup()
+	struct Cleanup
+	{
+		Cleanup* _next;
+		void	(*_func)(void* obj, bool destroy);
+		void*	_obj;	// reset by objects deleted before releasing the arena
+	};
+
+	XMLArena()
+	 :	_chunks(NULL),
+		_ptr(NULL),
+		_end(NULL),
+		_cleanup(NULL)
+	{
+	}
+
+	 // arenas are never shared between documents
+	XMLArena(const XMLArena&)
+	 :	_chunks(NULL),
+		_ptr(NULL),
+		_end(NULL),
+		_cleanup(NULL)
+	{
+	}
+
+	~XMLArena()
+	{
+		release();
+	}
+
+	XMLArena& operator=(const XMLArena&) {return *this;}
+
+	void* alloc(size_t size)
+	{
+		size = (size + ALIGN-1) & ~(size_t)(ALIGN-1);
+
+		if ((size_t)(_end-_ptr) < size)
+			return alloc_chunk(size);
+
+		void* p = _ptr;
+		_ptr += size;
+
+		return p;
+	}
+
+	 /// copy text into the arena
+	const char* copy(const char* s, size_t l)
+	{
+		char* p = (char*) alloc(l);
+
+		memcpy(p, s, l);
+
+		return p;
+	}
+
+	 /// register 'obj' once, storing the registration in 'slot'
+	 // This is thread-safe, as const objects register when lazily allocating memory.
+	 // func(obj, true) has to reset 'slot' before destroying the object.
+	void	add_cleanup(Cleanup* volatile* slot, void (*func)(void* obj, bool destroy), void* obj);
+
+	 /// destroy the registered objects and free all chunks
+	 // First func(obj, false) lets the registered objects hand over memory to objects outside
+	 // of the arena, which may register more objects, then func(obj, true) destroys them.
+	void	release();
+
+	static void* alloc_object(XMLArena* arena, size_t size);
+	static void free_object(void* p);
+
+protected:
+	struct Chunk {
+		Chunk*	_next;
+	};
+
+	enum {ALIGN=8};
+
+	Chunk*	_chunks;
+	char*	_ptr;
+	char*	_end;
+	Cleanup* volatile _cleanup;	// stack of registrations
+
+	void*	alloc_chunk(size_t size);
+};
+
+ // object header storing the owning arena, NULL for heap allocations
+union XMLArenaHeader
+{
+	XMLArena* _arena;
+	double	_align;
+};
+
+ /// allocate an object in 'arena' or on the heap if NULL
+inline void* XMLArena::alloc_object(XMLArena* arena, size_t size)
+{
+	XMLArenaHeader* hdr;
+
+	if (arena)
+		hdr = (XMLArenaHeader*) arena->alloc(sizeof(XMLArenaHeader)+size);
+	else {
+		hdr = (XMLArenaHeader*) malloc(sizeof(XMLArenaHeader)+size);
+
+		if (!hdr)
+			throw std::bad_alloc();
+	}
+
+	hdr->_arena = arena;
+
+	return hdr + 1;
+}
+
+ /// free heap objects, arena objects are released together with their arena
+inline void XMLArena::free_object(void* p)
+{
+	if (p) {
+		XMLArenaHeader* hdr = (XMLArenaHeader*)p - 1;
+
+		if (!hdr->_arena)
+			free(hdr);
+	}
+}
+
+ /// STL allocator taking the memory of containers from an XMLArena, or from the heap without arena
+ // Deallocation is a no-op for arena memory, so containers of arena objects need no destruction.
+template<typename T> struct XMLArenaAllocator
+{
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<typename U> struct rebind {typedef XMLArenaAllocator<U> other;};
+
+	XMLArenaAllocator(XMLArena* arena=NULL) : _arena(arena) {}
+	template<typename U> XMLArenaAllocator(const XMLArenaAllocator<U>& other) : _arena(other._arena) {}
+
+	pointer address(reference x) const {return &x;}
+	const_pointer address(const_reference x) const {return &x;}
+	size_type max_size() const {return (size_t)-1 / sizeof(T);}
+
+	pointer allocate(size_type n, const void* =0)
+	{
+		if (_arena)
+			return (pointer) _arena->alloc(n*sizeof(T));
+		else
+			return (pointer) ::operator new(n*sizeof(T));
+	}
+
+	void deallocate(pointer p, size_type)
+	{
+		if (!_arena)
+			::operator delete(p);
+	}
+
+	void construct(pointer p, const T& x) {new(p) T(x);}
+	void destroy(pointer p) {p->~T();}
+
+	bool operator==(const XMLArenaAllocator& other) const {return _arena == other._arena;}
+	bool operator!=(const XMLArenaAllocator& other) const {return _arena != other._arena;}
+
+	XMLArena* _arena;
+};
+
+
+ /// atomic increment and decrement of reference counters, returning the new value
+inline long xs_atomic_inc(volatile long* p)
+{
+#ifdef _WIN32
+	return InterlockedIncrement(p);
+#else
+	return __sync_add_and_fetch(p, 1);
+#endif
+}
+
+inline long xs_atomic_dec(volatile long* p)
+{
+#ifdef _WIN32
+	return InterlockedDecrement(p);
+#else
+	return __sync_sub_and_fetch(p, 1);
+#endif
+}
+
+ /// read a reference counter with a full memory barrier, seeing all changes made before the last increment or decrement
+inline long xs_atomic_get(volatile long* p)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange(p, 0, 0);
+#else
+	return __sync_add_and_fetch(p, 0);
+#endif
+}
+
+ /// read a value published by xs_atomic_cas(), seeing all changes made before
+inline long xs_atomic_load(volatile long* p)
+{
+#ifdef __GNUC__
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+	return *p;	// volatile reads have acquire semantics with MSVC
+#endif
+}
+
+ /// atomically store 'value' into '*p' if it equals 'comparand', returning the previous value
+inline long xs_atomic_cas(volatile long* p, long value, long comparand)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange(p, value, comparand);
+#else
+	return __sync_val_compare_and_swap(p, comparand, value);
+#endif
+}
+
+ /// let other threads run while waiting for them
+inline void xs_yield()
+{
+#ifdef _WIN32
+	Sleep(0);
+#else
+	sched_yield();
+#endif
+}
+
+ /// atomically store 'value' into '*p' if it equals 'comparand', returning the previous pointer value
+inline void* xs_atomic_cas_ptr(void* volatile* p, void* value, void* comparand)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchangePointer(p, value, comparand);
+#else
+	return __sync_val_compare_and_swap(p, comparand, value);
+#endif
+}
+
+
+ /// FNV-1a hash of a string, used for XS_StringMap and XMLAtomTable lookups
+inline size_t hash_xs_string(const XS_String& s)
+{
+	size_t h = 2166136261u;
+
+	for(size_t i=0; i<s.length(); ++i)
+		h = (h ^ (size_t)s[i]) * 16777619u;
+
+	return h;
+}
+
+
 #if 1
 
+#ifndef XS_SM_HASH_MIN
+#define XS_SM_HASH_MIN 16	// XS_StringMap uses a hash index for more entries
+#endif
+
  // XS_StringMap node
+ // The value parsed by the typed accessors XMLBool, XMLInt, ... is cached in the node. Write access
+ // through XS_StringMap::operator[], entry() or non-const iterators invalidates the cached value.
 struct XS_SMNode
 {
 	XS_SMNode(const XS_String& key)
-	 :	first(key)
+	 :	first(key),
+		_cache_type(CACHE_NONE)
 	{
 	}
 
 	XS_SMNode(const XS_SMNode& other)
 	 :	first(other.first),
-		second(other.second)
+		second(other.second),
+		_cache_type(CACHE_NONE)
 	{
-		if (other._pNext)
-			_pNext = new XS_SMNode(*other._pNext);
-		else
-			_pNext = NULL;
 	}
 
 	XS_String	first;
 	XS_String	second;
 
-	XS_SMNode*	_pNext;
+	bool get_bool() const
+	{
+		if (_cache_type != CACHE_BOOL) {
+			_cache._bool = !XS_icmp(second.c_str(), XS_TRUE);
+			_cache_type = CACHE_BOOL;
+		}
+
+		return _cache._bool;
+	}
+
+	int get_int() const
+	{
+		if (_cache_type != CACHE_INT) {
+			_cache._int = XS_toi(second.c_str());
+			_cache_type = CACHE_INT;
+		}
+
+		return _cache._int;
+	}
+
+	INT64 get_int64() const
+	{
+		if (_cache_type != CACHE_INT64) {
+			_cache._int64 = XS_toi64(second.c_str());
+			_cache_type = CACHE_INT64;
+		}
+
+		return _cache._int64;
+	}
+
+	double get_double() const
+	{
+		if (_cache_type != CACHE_DOUBLE) {
+			XS_CHAR* end;
+			_cache._double = XS_tod(second.c_str(), &end);
+			_cache_type = CACHE_DOUBLE;
+		}
+
+		return _cache._double;
+	}
+
+	 /// drop the cached value, to be called after changing 'second'
+	void invalidate()
+	{
+		_cache_type = CACHE_NONE;
+	}
 
 private:
+	enum CACHE_TYPE {CACHE_NONE, CACHE_BOOL, CACHE_INT, CACHE_INT64, CACHE_DOUBLE};
+
+	mutable union {
+		bool	_bool;
+		int		_int;
+		INT64	_int64;
+		double	_double;
+	} _cache;
+	mutable unsigned char _cache_type;	// CACHE_TYPE of the value in _cache
+
 	 // disallow overwritung
 	void operator=(const XS_SMNode&)
 	{
 	}
 };
 
- // optimized string map for small numbers of values implemented as sorted linked list
+ // optimized string map for small numbers of values implemented as sorted array of node pointers
+ // Maps with more than XS_SM_HASH_MIN entries additionally get a hash index for key lookups.
+ // The index is maintained while inserting, so concurrent readers of a const map don't modify it.
+ // Node addresses stay stable, so references to values remain valid while inserting other keys.
 struct XS_StringMap
 {
 	typedef XS_String key_type;
 	typedef XS_String value_type;
 
+	struct const_iterator;
+
 	struct iterator
 	{
-		iterator(XS_SMNode* ptr)
-		 :	_ptr(ptr)
+		iterator(XS_SMNode** pos=NULL, XS_SMNode** end=NULL)
+		 :	_pos(pos),
+			_end(end)
 		{
 		}
 
 		operator bool() const
 		{
-			return _ptr != NULL;
+			return _pos != _end;
 		}
 
+		 // write access to the node drops its cached typed value
 		XS_SMNode* operator->()
 		{
-			return _ptr;
+			(*_pos)->invalidate();
+			return *_pos;
 		}
 
 		const XS_SMNode* operator->() const
 		{
-			return _ptr;
+			return *_pos;
 		}
 
 		void operator++()
 		{
-			_ptr = _ptr->_pNext;
+			++_pos;
 		}
 
 		XS_SMNode* ptr()
 		{
-			return _ptr;
+			if (_pos == _end)
+				return NULL;
+
+			(*_pos)->invalidate();
+			return *_pos;
 		}
 
 		const XS_SMNode* ptr() const
 		{
-			return _ptr;
+			return _pos!=_end? *_pos: NULL;
 		}
 
 	private:
-		XS_SMNode*	_ptr;
+		XS_SMNode**	_pos;
+		XS_SMNode**	_end;
+
+		friend struct XS_StringMap::const_iterator;
 	};
 
 	struct const_iterator
 	{
-		const_iterator(const XS_SMNode* ptr)
-		 :	_ptr(ptr)
+		const_iterator(XS_SMNode* const* pos=NULL, XS_SMNode* const* end=NULL)
+		 :	_pos(pos),
+			_end(end)
 		{
 		}
 
 		const_iterator(const iterator& it)
-		 :	_ptr(it.ptr())
+		 :	_pos(it._pos),
+			_end(it._end)
 		{
 		}
 
 		operator bool() const
 		{
-			return _ptr != NULL;
+			return _pos != _end;
 		}
 
 		const XS_SMNode* operator->() const
 		{
-			return _ptr;
+			return *_pos;
 		}
 
 		void operator++()
 		{
-			_ptr = _ptr->_pNext;
+			++_pos;
 		}
 
 		const XS_SMNode* ptr() const
 		{
-			return _ptr;
+			return _pos!=_end? *_pos: NULL;
 		}
 
 	private:
-		const XS_SMNode*	_ptr;
+		XS_SMNode* const*	_pos;
+		XS_SMNode* const*	_end;
 	};
 
 	XS_StringMap()
-	 :	_firstNode(NULL)
+	 :	_block(NULL)
 	{
 	}
 
 	XS_StringMap(const XS_StringMap& other)
-	 :	_firstNode(NULL)
+	 :	_block(NULL)
 	{
 		assign(other);
 	}
 
 	void operator=(const XS_StringMap& other)
 	{
-		clear();
-		assign(other);
+		if (&other != this) {
+			clear();
+			assign(other);
+		}
 	}
 
 	~XS_StringMap()
@@ -1175,130 +1602,113 @@ struct XS_StringMap
 
 	void clear()
 	{
-		XS_SMNode* node = _firstNode;
-		_firstNode = NULL;
+		Block* block = _block;
+		_block = NULL;
 
-		while(node) {
-			XS_SMNode* pNext = node->_pNext;
-			delete node;
-			node = pNext;
+		if (block) {
+			for(size_t i=0; i<block->_count; ++i)
+				delete block->_nodes[i];
+
+			free_block(block);
 		}
 	}
 
+	size_t size() const
+	{
+		return _block? _block->_count: 0;
+	}
+
+	bool empty() const
+	{
+		return !size();
+	}
+
 	iterator begin()
 	{
-		return _firstNode;
+		return _block? iterator(_block->_nodes, _block->_nodes+_block->_count): iterator();
 	}
 
 	const_iterator begin() const
 	{
-		return _firstNode;
+		return _block? const_iterator(_block->_nodes, _block->_nodes+_block->_count): const_iterator();
 	}
 
 	iterator end()
 	{
-		return NULL;
+		return _block? iterator(_block->_nodes+_block->_count, _block->_nodes+_block->_count): iterator();
 	}
 
 	const_iterator end() const
 	{
-		return NULL;
+		return _block? const_iterator(_block->_nodes+_block->_count, _block->_nodes+_block->_count): const_iterator();
 	}
 
 	iterator find(const key_type& key)
 	{
-		for(iterator node=_firstNode; node; node=node->_pNext) {
-			int c = node->first.compare(key);
-
-			if (c == 0)
-				return node;
-			else if (c > 0)
-				break;
-		}
+		size_t idx;
 
-		return NULL;
+		if (lookup(key, idx))
+			return iterator(_block->_nodes+idx, _block->_nodes+_block->_count);
+		else
+			return end();
 	}
 
 	const_iterator find(const key_type& key) const
 	{
-		for(const_iterator node=_firstNode; node; node=node->_pNext) {
-			int c = node->first.compare(key);
-
-			if (c == 0)
-				return node;
-			else if (c > 0)
-				break;
-		}
+		size_t idx;
 
-		return NULL;
+		if (lookup(key, idx))
+			return const_iterator(_block->_nodes+idx, _block->_nodes+_block->_count);
+		else
+			return end();
 	}
 
 	value_type& operator[](const key_type& key)
 	{
-		iterator last = NULL;
-		iterator node = _firstNode;
-
-		for(; node; node=(last=node)->_pNext) {
-			int c = node->first.compare(key);
-
-			if (c == 0)
-				break; // key matched
-			else if (c > 0) {
-				node = NULL;
-				break;
-			}
-		}
+		return entry(key).second;
+	}
 
-		if (!node) {
-			 // insert a new node into the linked list
-			node = new XS_SMNode(key);
+	 /// write access to the node of 'key', inserted if not yet present
+	XS_SMNode& entry(const key_type& key)
+	{
+		size_t idx;
 
-			if (last) {
-				node->_pNext = last->_pNext;
-				last->_pNext = node.ptr();
-			} else {
-				node->_pNext = _firstNode;
-				_firstNode = node.ptr();
-			}
+		if (lookup(key, idx)) {
+			XS_SMNode* node = _block->_nodes[idx];
+			node->invalidate();
+			return *node;
 		}
 
-		return node->second;
+		 // insert a new node at its sorted position
+		return *insert(idx, new XS_SMNode(key));
 	}
 
 	bool erase(const key_type& key)
 	{
-		iterator last = NULL;
-		iterator node = _firstNode;
+		size_t idx;
 
-		for(; node; node=(last=node)->_pNext) {
-			int c = node->first.compare(key);
+		if (!lookup(key, idx))
+			return false;	// key not found
 
-			if (c == 0) {
-				 // remove the node from linked list
-				if (last)
-					last->_pNext = node->_pNext;
-				else
-					_firstNode = NULL;
+		delete _block->_nodes[idx];
 
-				delete node.ptr();
+		memmove(_block->_nodes+idx, _block->_nodes+idx+1, (_block->_count-idx-1)*sizeof(XS_SMNode*));
+		--_block->_count;
 
-				return true;
-			} else if (c > 0)
-				break;
-		}
+		drop_hash();
+
+		if (_block->_count > XS_SM_HASH_MIN)
+			build_hash();
 
-		return false;	// key not found
+		return true;
 	}
 
 	bool operator==(const XS_StringMap& other) const
 	{
-		const_iterator it1 = _firstNode;
-		const_iterator it2 = other._firstNode;
-
-		while(it1 || it2) {
-			if (!it1 || !it2)
-				return false;
+		if (size() != other.size())
+			return false;
 
+		for(const_iterator it1=begin(),it2=other.begin(); it1; ++it1,++it2) {
 			if (it1->first != it2->first)
 				return false;
 
@@ -1306,7 +1716,7 @@ struct XS_StringMap
 				return false;
 		}
 
-		return !it1 && !it2;
+		return true;
 	}
 
 	bool operator!=(const XS_StringMap& other) const
@@ -1314,83 +1724,861 @@ struct XS_StringMap
 		return !operator==(other);
 	}
 
-private:
-	XS_SMNode*	_firstNode;
+protected:
+	 /// add nodes with new keys at once, 'nodes' has to be sorted by key
+	void merge_sorted(XS_SMNode* const* nodes, size_t cnt)
+	{
+		size_t old_cnt = size();
+		Block* block = alloc_block(old_cnt+cnt>4? old_cnt+cnt: 4);
+		XS_SMNode** dst = block->_nodes;
+		XS_SMNode* const* src = old_cnt? _block->_nodes: NULL;
+		XS_SMNode* const* src_end = src + old_cnt;
+		XS_SMNode* const* end = nodes + cnt;
+
+		while(src<src_end && nodes<end)
+			if ((*nodes)->first.compare((*src)->first) < 0)
+				*dst++ = *nodes++;
+			else
+				*dst++ = *src++;
 
-	void assign(const XS_StringMap& other)
-	{
-		if (other._firstNode)
-			_firstNode = new XS_SMNode(*other._firstNode);
-	}
-};
+		while(src < src_end)
+			*dst++ = *src++;
 
-#else
+		while(nodes < end)
+			*dst++ = *nodes++;
 
-typedef std::map<XS_String, XS_String> XS_StringMap;
+		block->_count = old_cnt + cnt;
 
+		if (_block)
+			free_block(_block);
+
+		_block = block;
+
+		if (_block->_count > XS_SM_HASH_MIN)
+			build_hash();
+	}
+
+private:
+	 // node array with header, allocated in one block
+	struct Block
+	{
+		size_t	_count;
+		size_t	_capacity;
+		size_t*	_hash;		// open addressing hash index storing node index+1, NULL if not yet built
+		size_t	_hash_size;	// power of two
+		XS_SMNode* _nodes[1];	// sorted by key
+	};
+
+	Block*	_block;
+
+	static Block* alloc_block(size_t capacity)
+	{
+		Block* block = (Block*) malloc(sizeof(Block) + (capacity-1)*sizeof(XS_SMNode*));
+
+		if (!block)
+			throw std::bad_alloc();
+
+		block->_count = 0;
+		block->_capacity = capacity;
+		block->_hash = NULL;
+		block->_hash_size = 0;
+
+		return block;
+	}
+
+	static size_t* alloc_hash(size_t size)
+	{
+		size_t* hash = (size_t*) malloc(size*sizeof(size_t));
+
+		if (!hash)
+			throw std::bad_alloc();
+
+		return hash;
+	}
+
+	static void free_block(Block* block)
+	{
+		free(block->_hash);
+		free(block);
+	}
+
+	void assign(const XS_StringMap& other)
+	{
+		if (other._block && other._block->_count) {
+			size_t cnt = other._block->_count;
+
+			_block = alloc_block(cnt);
+
+			for(size_t i=0; i<cnt; ++i)
+				_block->_nodes[i] = new XS_SMNode(*other._block->_nodes[i]);
+
+			_block->_count = cnt;
+
+			 // The node indices are the same, so the hash index can be copied.
+			if (other._block->_hash) {
+				size_t size = other._block->_hash_size;
+
+				_block->_hash = alloc_hash(size);
+				_block->_hash_size = size;
+				memcpy(_block->_hash, other._block->_hash, size*sizeof(size_t));
+			}
+		}
+	}
+
+	 /// search for 'key', return its index or the index to insert it
+	bool lookup(const key_type& key, size_t& idx) const
+	{
+		if (!_block) {
+			idx = 0;
+			return false;
+		}
+
+		XS_SMNode* const* nodes = _block->_nodes;
+		size_t cnt = _block->_count;
+
+		if (cnt <= XS_SM_HASH_MIN) {
+			 // linear search in small maps
+			for(idx=0; idx<cnt; ++idx) {
+				int c = nodes[idx]->first.compare(key);
+
+				if (c == 0)
+					return true;
+				else if (c > 0)
+					break;
+			}
+
+			return false;
+		}
+
+		if (_block->_hash) {
+			size_t mask = _block->_hash_size - 1;
+
+			for(size_t h=hash_xs_string(key)&mask; _block->_hash[h]; h=(h+1)&mask)
+				if (nodes[_block->_hash[h]-1]->first == key) {
+					idx = _block->_hash[h] - 1;
+					return true;
+				}
+		}
+
+		 // binary search for the key or its insert position
+		size_t lo = 0, hi = cnt;
+
+		while(lo < hi) {
+			size_t mid = (lo+hi) / 2;
+			int c = nodes[mid]->first.compare(key);
+
+			if (c < 0)
+				lo = mid + 1;
+			else if (c > 0)
+				hi = mid;
+			else {
+				idx = mid;
+				return true;
+			}
+		}
+
+		idx = lo;
+
+		return false;
+	}
+
+	XS_SMNode* insert(size_t idx, XS_SMNode* node)
+	{
+		if (!_block)
+			_block = alloc_block(4);
+		else if (_block->_count == _block->_capacity) {
+			Block* block = alloc_block(_block->_capacity*2);
+
+			memcpy(block->_nodes, _block->_nodes, _block->_count*sizeof(XS_SMNode*));
+			block->_count = _block->_count;
+
+			 // take over the hash index
+			block->_hash = _block->_hash;
+			block->_hash_size = _block->_hash_size;
+			_block->_hash = NULL;
+
+			free_block(_block);
+			_block = block;
+		}
+
+		memmove(_block->_nodes+idx+1, _block->_nodes+idx, (_block->_count-idx)*sizeof(XS_SMNode*));
+		_block->_nodes[idx] = node;
+		++_block->_count;
+
+		if (_block->_hash && _block->_count*2<=_block->_hash_size) {
+			 // Move the indices of the nodes behind the new one, probing only their own chains.
+			 // Going backwards no other slot holds the index being searched.
+			for(size_t i=_block->_count-1; i>idx; --i)
+				*hash_slot(i, i) = i + 1;
+
+			hash_insert(idx);
+		} else if (_block->_count > XS_SM_HASH_MIN) {
+			drop_hash();
+			build_hash();	// with a bigger size
+		}
+
+		return node;
+	}
+
+	void build_hash()
+	{
+		size_t size = 32;
+
+		while(size < _block->_count*4)
+			size <<= 1;
+
+		_block->_hash = alloc_hash(size);
+		_block->_hash_size = size;
+		memset(_block->_hash, 0, size*sizeof(size_t));
+
+		for(size_t i=0; i<_block->_count; ++i)
+			hash_insert(i);
+	}
+
+	void hash_insert(size_t idx)
+	{
+		size_t mask = _block->_hash_size - 1;
+		size_t h = hash_xs_string(_block->_nodes[idx]->first) & mask;
+
+		while(_block->_hash[h])
+			h = (h+1) & mask;
+
+		_block->_hash[h] = idx + 1;
+	}
+
+	 /// return the hash slot of the node at position 'idx', which currently stores 'value'
+	size_t* hash_slot(size_t idx, size_t value)
+	{
+		size_t mask = _block->_hash_size - 1;
+		size_t h = hash_xs_string(_block->_nodes[idx]->first) & mask;
+
+		while(_block->_hash[h] != value)
+			h = (h+1) & mask;
+
+		return &_block->_hash[h];
+	}
+
+	void drop_hash()
+	{
+		if (_block->_hash) {
+			free(_block->_hash);
+			_block->_hash = NULL;
+			_block->_hash_size = 0;
+		}
+	}
+};
+
+#else
+
+typedef std::map<XS_String, XS_String> XS_StringMap;
+
+#endif
+
+
+ /// UTF-8 string owning its characters or referencing a slice of a memory mapped document or its arena
+ // Copies always own their characters and stay valid after the mapping has been released.
+ // Const access never changes the string, so it may be read concurrently. Nodes moved into
+ // another document are copied for this reason, see XMLNode::add_child().
+struct XS_RefString
+{
+	XS_RefString()
+	 :	_ref(NULL),
+		_ref_len(0)
+	{
+	}
+
+	XS_RefString(const std::string& s)
+	 :	_str(s),
+		_ref(NULL),
+		_ref_len(0)
+	{
+	}
+
+	XS_RefString(const XS_RefString& other)
+	 :	_str(other.data(), other.length()),
+		_ref(NULL),
+		_ref_len(0)
+	{
+	}
+
+	XS_RefString& operator=(const XS_RefString& other)
+	{
+		if (&other != this)
+			assign(other.data(), other.length());
+
+		return *this;
+	}
+
+	XS_RefString& operator=(const std::string& s)
+	{
+		assign(s);
+
+		return *this;
+	}
+
+	bool	is_ref() const {return _ref != NULL;}
+	const char* data() const {return _ref? _ref: _str.data();}
+	size_t	length() const {return _ref? _ref_len: _str.length();}
+	bool	empty() const {return !length();}
+
+	std::string str() const {return std::string(data(), length());}
+
+	void erase()
+	{
+		_str.erase();
+		_ref = NULL;
+		_ref_len = 0;
+	}
+
+	void assign(const std::string& s)
+	{
+		_str.assign(s);
+		_ref = NULL;
+		_ref_len = 0;
+	}
+
+	void assign(const char* s, size_t l)
+	{
+		_str.assign(s, l);
+		_ref = NULL;
+		_ref_len = 0;
+	}
+
+	XS_RefString& append(const std::string& s)
+	{
+		own();
+		_str.append(s);
+
+		return *this;
+	}
+
+	XS_RefString& append(const char* s, size_t l)
+	{
+		own();
+		_str.append(s, l);
+
+		return *this;
+	}
+
+	 /// append characters of mapped input, keeping a reference if possible
+	XS_RefString& append_ref(const char* s, size_t l)
+	{
+		if (!l)
+			return *this;
+
+		if (empty()) {
+			_str.erase();
+			_ref = s;
+			_ref_len = l;
+		} else if (_ref && _ref+_ref_len==s)
+			_ref_len += l;
+		else
+			append(s, l);
+
+		return *this;
+	}
+
+	 /// append part [s, s+l) of 'src', keeping references to mapped input
+	 // and storing the text in 'arena' if not NULL
+	XS_RefString& append(const XS_RefString& src, const char* s, size_t l, XMLArena* arena)
+	{
+		if (!l)
+			return *this;
+
+		if (src.is_ref() && (empty() || _ref+_ref_len==s))
+			return append_ref(s, l);
+
+		if (arena && (empty() || _ref)) {
+			size_t len = length();
+			char* p = (char*) arena->alloc(len + l);
+
+			memcpy(p, data(), len);
+			memcpy(p+len, s, l);
+
+			_str.erase();
+			_ref = p;
+			_ref_len = len + l;
+
+			return *this;
+		}
+
+		return append(s, l);
+	}
+
+	XS_RefString& append(const XS_RefString& src, XMLArena* arena)
+	{
+		return append(src, src.data(), src.length(), arena);
+	}
+
+protected:
+	std::string _str;
+	const char* _ref;	// slice of mapped input or arena memory, NULL if _str is used
+	size_t	_ref_len;
+
+	void own()
+	{
+		if (_ref) {
+			_str.assign(_ref, _ref_len);
+			_ref = NULL;
+			_ref_len = 0;
+		}
+	}
+};
+
+inline std::ostream& operator<<(std::ostream& out, const XS_RefString& s)
+{
+	return out.write(s.data(), s.length());
+}
+
+
+struct XMLNode;
+struct XMLAtomTable;
+struct XMLWriteCache;
+
+ /// interned element or attribute name
+struct XMLAtom
+{
+	XMLAtom(const XS_String& name, XMLAtomTable* table)
+	 :	_name(name),
+		_table(table)
+	{
+	}
+
+	XS_String	_name;
+	XMLAtomTable* _table;
+};
+
+ /// per document table of interned element and attribute names
+ // Nodes created by XMLReaderBase share the name strings of the table and store their atom,
+ // so name comparisons against cached atoms need only a pointer compare.
+ // The table is reference counted and lives as long as any node using it.
+struct XMLAtomTable
+{
+	XMLAtomTable()
+	 :	_refs(1),
+		_count(0),
+		_id(xs_atomic_inc(&s_next_id))
+	{
+	}
+
+	 /// return the atom for 'name', create it if not yet present
+	const XMLAtom* intern(const XS_String& name);
+
+	 /// return the atom for 'name' or NULL if there is none
+	const XMLAtom* find(const XS_String& name) const;
+
+	size_t size() const {return _count;}
+
+	 /// unique number of the table, never reused for another one
+	long id() const {return _id;}
+
+	 // Copies of nodes holding the table may be released by other threads.
+	void add_ref() {xs_atomic_inc(&_refs);}
+	void release() {if (!xs_atomic_dec(&_refs)) delete this;}
+
+protected:
+	~XMLAtomTable();
+
+	volatile long _refs;
+	size_t	_count;
+	long	_id;
+	std::vector<XMLAtom*> _hash;	// open addressing, power of two size
+
+	static volatile long s_next_id;
+
+private:
+	 // disallow copying
+	XMLAtomTable(const XMLAtomTable&);
+	void operator=(const XMLAtomTable&);
+};
+
+ /// XMLDoc member holding a reference to its atom table
+struct XMLAtomTableRef
+{
+	XMLAtomTableRef() : _table(NULL) {}
+	XMLAtomTableRef(const XMLAtomTableRef&) : _table(NULL) {}	// copied documents create their own table
+	~XMLAtomTableRef() {reset();}
+
+	XMLAtomTableRef& operator=(const XMLAtomTableRef&) {return *this;}
+
+	XMLAtomTable* get()
+	{
+		if (!_table)
+			_table = new XMLAtomTable;
+
+		return _table;
+	}
+
+	void reset()
+	{
+		if (_table) {
+			_table->release();
+			_table = NULL;
+		}
+	}
+
+protected:
+	XMLAtomTable* _table;
+};
+
+ /// name comparison with a cached lookup in the atom table of the compared nodes
+ // Only the id of the table is stored, so cached XPath expressions don't keep the tables of released
+ // documents alive. A compared node holds its table, so a matching id guarantees a valid _atom.
+struct XMLAtomCache
+{
+	XMLAtomCache()
+	 :	_table_id(0),
+		_atom(NULL),
+		_table_size(0)
+	{
+	}
+
+	 /// compare the name of 'node' with 'name'
+	bool matches(const XMLNode& node, const XS_String& name) const;
+
+protected:
+	mutable long _table_id;
+	mutable const XMLAtom* _atom;
+	mutable size_t _table_size;
+};
+
+
+struct XPathElement
+{
+	XPathElement() : _child_idx(-1) {}
+
+	XPathElement(const XS_String& child_name, int child_idx=-1)
+	 :	_child_name(child_name), _child_idx(child_idx)
+	{
+	}
+
+	XPathElement(const XS_String& child_name, int child_idx, const XS_String& attr_name, const XS_String& attr_value)
+	 :	_child_name(child_name), _child_idx(child_idx)
+	{
+		_mAttrAndAttr[attr_name] = attr_value;
+	}
+
+	XS_String	_child_name;
+	int			_child_idx;
+
+	typedef XS_StringMap MAPATTR; // maps attribute names to its value
+	MAPATTR		_mAttrAndAttr;	// map to handle AND conditions
+
+	XMLAtomCache _name_atom;	// fast path for comparing _child_name
+
+	LPCXSSTR parse(LPCXSSTR path);
+
+	XMLNode* find(XMLNode* node) const;
+	const XMLNode* const_find(const XMLNode* node) const;
+
+	bool	matches(const XMLNode& node, int& n) const;
+};
+
+struct XPath : std::list<XPathElement>
+{
+	XPath() : _absolute(false) {}
+	XPath(LPCXSSTR path) {init(path);}
+	XPath(const XS_String& path) {init(path.c_str());}
+
+	void	init(LPCXSSTR path);
+
+	bool	_absolute;
+};
+
+
+#ifndef XS_XPATH_CACHE_SIZE
+#define XS_XPATH_CACHE_SIZE 64
+#endif
+
+ /// LRU cache of parsed XPath expressions for repeatedly used path strings
+struct XPathCache
+{
+	XPathCache(size_t capacity=XS_XPATH_CACHE_SIZE)
+	 :	_capacity(capacity)
+	{
+	}
+
+	 /// return the parsed expression, the reference stays valid until the next call
+	const XPath& get(const XS_String& path);
+
+	void clear()
+	{
+		_map.clear();
+		_entries.clear();
+	}
+
+protected:
+	typedef std::list<std::pair<XS_String, XPath> > Entries;	// most recently used first
+
+	Entries	_entries;
+	std::map<XS_String, Entries::iterator> _map;
+	size_t	_capacity;
+};
+
+
+#ifndef XS_CHILD_INDEX_MIN
+#define XS_CHILD_INDEX_MIN 32	// minimum number of children to build a XMLChildIndex
 #endif
 
+ /// index of children by node name, built on demand for nodes with many children
+struct XMLChildIndex
+{
+	typedef std::vector<XMLNode*> NodeList;
+
+	 /// children named 'name' in document order, NULL if there are none
+	const NodeList* find(const XS_String& name) const
+	{
+		std::map<XS_String, NodeList>::const_iterator found = _map.find(name);
+
+		if (found != _map.end())
+			return &found->second;
+		else
+			return NULL;
+	}
+
+protected:
+	std::map<XS_String, NodeList> _map;
+	const void* _list;	// the indexed Children list
+	size_t	_gen;	// Children::_gen of the indexed list
+	size_t	_count;	// number of indexed children
+
+	friend struct XMLNode;
+};
+
+
+ /// slices of an attribute in the undecoded text of a start tag
+struct XMLAttrToken
+{
+	const char* _name;
+	size_t	_name_len;
+	const char* _value;		// entity encoded
+	size_t	_value_len;
+};
+
+ /// scan the next attribute in [p, end) behind the tag name of a start tag
+ // Returns false at the end of the tag and for malformed input, which sets 'error'.
+ // An unterminated value quote returns the attribute up to 'end' and sets 'error' as well.
+extern bool scan_xml_attribute(const char*& p, const char* end, XMLAttrToken& attr, const char*& error);
+
+
+ /// attribute map decoding the attributes of a start tag on demand
+ // The native parser only stores the undecoded attribute text. Lookups through get_value()
+ // decode just the requested attribute, iterating decodes all of them once. So an element
+ // pays nothing for attributes never read.
+ // The raw text isn't changed by const access, decoding the map is guarded by _state.
+struct XMLAttributeMapBase : public XS_StringMap
+{
+	typedef XS_StringMap super;
+
+	enum RAW_STATE {RAW_DECODED, RAW_PENDING, RAW_DECODING};
+
+	XMLAttributeMapBase()
+	 :	_state(RAW_DECODED),
+		_node(NULL)
+	{
+	}
+
+	XMLAttributeMapBase(const XMLAttributeMapBase& other)
+	 :	super(),
+		_state(RAW_DECODED),
+		_node(NULL)
+	{
+		copy(other);
+	}
+
+	XMLAttributeMapBase& operator=(const XMLAttributeMapBase& other)
+	{
+		if (&other != this)
+			copy(other);
+
+		return *this;
+	}
+
+	 /// store the undecoded attribute text of a start tag, replacing the current content
+	void set_raw(const char* s, size_t l)
+	{
+		super::clear();
+		_raw.assign(s, l);
+		_state = RAW_PENDING;
+	}
+
+	 /// store the undecoded attribute text referencing memory mapped input
+	void set_raw_ref(const char* s, size_t l)
+	{
+		super::clear();
+		_raw.erase();
+		_raw.append_ref(s, l);
+		_state = RAW_PENDING;
+	}
+
+	 /// take over the attributes passed by a parser, keeping references into mapped input
+	 // and storing the undecoded text in 'arena' if not NULL
+	void assign_parsed(const XMLAttributeMapBase& other, XMLArena* arena)
+	{
+		if (other.has_raw()) {
+			super::clear();
+			_raw.erase();
+			_raw.append(other._raw, arena);
+			_state = RAW_PENDING;
+		} else {
+			copy(other);
+
+			if (!super::empty())
+				need_cleanup();
+		}
+	}
+
+	 /// true if there are attributes not yet decoded
+	bool has_raw() const
+	{
+		return xs_atomic_load(&_state) != RAW_DECODED;
+	}
+
+	void clear()
+	{
+		super::clear();
+		_raw.erase();
+		_state = RAW_DECODED;
+	}
+
+	size_t size() const
+	{
+		decode_all();
+		return super::size();
+	}
+
+	bool empty() const
+	{
+		if (xs_atomic_load(&_state) == RAW_DECODED)
+			return super::empty();
+		else
+			return false;	// the raw text starts with an attribute
+	}
+
+	 /// look up the value of 'key', decoding only this attribute while the map isn't decoded
+	bool get_value(const key_type& key, XS_String& value) const;
+
+#if defined(UNICODE) && !defined(XS_STRING_UTF8)
+	bool get_value(const char* key, XS_String& value) const;
+#endif
+
+	iterator begin()
+	{
+		decode();
+		return super::begin();
+	}
+
+	const_iterator begin() const
+	{
+		decode_all();
+		return super::begin();
+	}
+
+	iterator end()
+	{
+		return super::end();
+	}
+
+	const_iterator end() const
+	{
+		return super::end();
+	}
+
+	iterator find(const key_type& key)
+	{
+		decode();
+		return super::find(key);
+	}
+
+	const_iterator find(const key_type& key) const
+	{
+		decode_all();
+		return super::find(key);
+	}
 
-struct XMLNode;
+	XS_String& operator[](const key_type& key)
+	{
+		decode();
+		return super::operator[](key);
+	}
 
-struct XPathElement
-{
-	XPathElement() : _child_idx(-1) {}
+	XS_SMNode& entry(const key_type& key)
+	{
+		decode();
+		return super::entry(key);
+	}
 
-	XPathElement(const XS_String& child_name, int child_idx=-1)
-	 :	_child_name(child_name), _child_idx(child_idx)
+	bool erase(const key_type& key)
 	{
+		decode();
+		return super::erase(key) != 0;
 	}
 
-	XPathElement(const XS_String& child_name, int child_idx, const XS_String& attr_name, const XS_String& attr_value)
-	 :	_child_name(child_name), _child_idx(child_idx)
+	bool operator==(const XMLAttributeMapBase& other) const
 	{
-		_mAttrAndAttr[attr_name] = attr_value;
+		decode_all();
+		other.decode_all();
+
+		return super::operator==(other);
 	}
 
-	XS_String	_child_name;
-	int			_child_idx;
+	bool operator!=(const XMLAttributeMapBase& other) const
+	{
+		return !operator==(other);
+	}
 
-	typedef XS_StringMap MAPATTR; // maps attribute names to its value
-	MAPATTR		_mAttrAndAttr;	// map to handle AND conditions
+protected:
+	XS_RefString _raw;	// undecoded attribute text behind the tag name including the closing bracket
+	mutable volatile long _state;	// RAW_STATE, changed with xs_atomic_cas() by decode_all()
+	XMLNode* _node;		// node owning the map, NULL for maps outside of nodes
 
-	LPCXSSTR parse(LPCXSSTR path);
+	friend struct XMLNode;
 
-	XMLNode* find(XMLNode* node) const;
-	const XMLNode* const_find(const XMLNode* node) const;
+	 /// decode all attributes into the map once, concurrent callers wait for the first one
+	 // Later accesses don't change the map any more, so iterators stay valid for read access.
+	void	decode_all() const;
 
-	bool	matches(const XMLNode& node, int& n) const;
-};
+	 /// decode for write access, releasing the raw text
+	void decode()
+	{
+		decode_all();
+		_raw.erase();
+	}
 
-struct XPath : std::list<XPathElement>
-{
-	XPath() : _absolute(false) {}
-	XPath(LPCXSSTR path) {init(path);}
-	XPath(const XS_String& path) {init(path.c_str());}
+	 /// take over the decoded map or the raw text of 'other', which may be decoded concurrently
+	void	copy(const XMLAttributeMapBase& other);
 
-	void	init(LPCXSSTR path);
+	 /// scan the raw text for the attribute 'name' given in UTF-8 and decode its value
+	bool	find_raw(const char* name, size_t len, XS_String& value) const;
 
-	bool	_absolute;
+	 /// let an arena node release the map content, see XMLNode::need_cleanup()
+	void	need_cleanup() const;
 };
 
 
  /// in memory representation of an XML node
+ // Copies of a node share the children list until one of them or a node below changes, see prepare_write().
 struct XMLNode : public XS_String
 {
 #if defined(UNICODE) && !defined(XS_STRING_UTF8)
 	 /// map of XML node attributes
 	 // optimized read access without temporary A/U conversion when using ASCII attribute names
-	struct AttributeMap : public XS_StringMap
+	struct AttributeMap : public XMLAttributeMapBase
 	{
-		typedef XS_StringMap super;
+		typedef XMLAttributeMapBase super;
 
 		const_iterator find(const char* x) const
 		{
-			for(const_iterator it=begin(); it!=end(); ++it)
+			decode_all();
+
+			if (XS_StringMap::size() > XS_SM_HASH_MIN)
+				return XS_StringMap::find(XS_String(x));	// use the hash index
+
+			for(const_iterator it=XS_StringMap::begin(); it!=XS_StringMap::end(); ++it)
 				if (it->first == x)
 					return it;
 
-			return end();
+			return XS_StringMap::end();
 		}
 
 		const_iterator find(const key_type& x) const
@@ -1405,41 +2593,65 @@ struct XMLNode : public XS_String
 
 		XS_String get(const char* x, LPCXSSTR def=XS_EMPTY_STR) const
 		{
-			const_iterator found = find(x);
+			XS_String value;
 
-			if (found != end())
-				return found->second;
+			if (get_value(x, value))
+				return value;
 			else
 				return def;
 		}
 	};
 #else
 	 /// map of XML node attributes
-	struct AttributeMap : public XS_StringMap
+	struct AttributeMap : public XMLAttributeMapBase
 	{
 		XS_String get(const char* x, LPCXSSTR def=XS_EMPTY_STR) const
 		{
-			const_iterator found = find(x);
+			XS_String value;
 
-			if (found != end())
-				return found->second;
+			if (get_value(x, value))
+				return value;
 			else
 				return def;
 		}
 	};
 #endif
 
+#ifdef XS_LIST_CHILDREN
+	typedef std::list<XMLNode*, XMLArenaAllocator<XMLNode*> > ChildrenBase;
+#else
+	typedef std::vector<XMLNode*, XMLArenaAllocator<XMLNode*> > ChildrenBase;	// contiguous storage for fast traversal
+#endif
+
 	 /// internal children node list
-	struct Children : public std::list<XMLNode*>
+	 // Define XS_LIST_CHILDREN to use std::list, which keeps iterators valid while adding children.
+	 // Nodes added to the list of a node get it as parent, see XMLNode::prepare_write().
+	 // Nodes referring to the memory of another document have to be copied first, see XMLNode::add_child().
+	struct Children : public ChildrenBase
 	{
-		typedef std::list<XMLNode*> super;
+		typedef ChildrenBase super;
 
 		Children()
+		 :	_gen(0),
+			_node(NULL)
+		{
+		}
+
+		 /// list of an arena node, storing the list in the arena as well
+		explicit Children(XMLArena* arena)
+		 :	super(XMLArenaAllocator<XMLNode*>(arena)),
+			_gen(0),
+			_node(NULL)
 		{
 		}
 
 		Children(Children& other)
+		 :	super(),
+			_gen(0),
+			_node(NULL)
 		{
+			reserve_for(other.size());
+
 			for(Children::const_iterator it=other.begin(); it!=other.end(); ++it)
 				push_back(*it);
 		}
@@ -1452,6 +2664,8 @@ struct XMLNode : public XS_String
 
 		void move(Children& other)
 		{
+			reserve_for(size() + other.size());
+
 			for(Children::const_iterator it=other.begin(); it!=other.end(); ++it)
 				push_back(*it);
 
@@ -1466,6 +2680,8 @@ struct XMLNode : public XS_String
 
 		void copy(const Children& other)
 		{
+			reserve_for(size() + other.size());
+
 			for(Children::const_iterator it=other.begin(); it!=other.end(); ++it)
 				push_back(new XMLNode(**it));
 		}
@@ -1476,11 +2692,18 @@ struct XMLNode : public XS_String
 				XMLNode* node = back();
 				pop_back();
 
+				node->_parent = NULL;
 				node->clear();
 				delete node;
 			}
 		}
 
+		void push_back(XMLNode* node)
+		{
+			adopt(node);
+			super::push_back(node);
+		}
+
 		bool remove(XMLNode* node)
 		{
 			for(iterator it=begin(); it!=end(); ++it)
@@ -1492,11 +2715,119 @@ struct XMLNode : public XS_String
 			return false;
 		}
 
-	private:
+		 // modifications other than appending invalidate XMLChildIndex
+		void pop_back()
+		{
+			++_gen;
+			super::pop_back();
+		}
+
+		iterator erase(iterator it)
+		{
+			++_gen;
+			(*it)->_parent = NULL;
+			return super::erase(it);
+		}
+
+		iterator erase(iterator from, iterator to)
+		{
+			++_gen;
+
+			for(iterator it=from; it!=to; ++it)
+				(*it)->_parent = NULL;
+
+			return super::erase(from, to);
+		}
+
+		iterator insert(iterator it, XMLNode* node)
+		{
+			++_gen;
+			adopt(node);
+			return super::insert(it, node);
+		}
+
+		 /// refer to the nodes of 'other' without taking them over, see SharedChildren
+		void share(const Children& other)
+		{
+			++_gen;
+			super::operator=(other);
+		}
+
+		 /// forget the nodes without deleting them
 		void reset()
 		{
+			++_gen;
 			super::clear();
 		}
+
+		size_t	_gen;
+		XMLNode* _node;	// parent of the listed nodes, NULL for lists shared by copies
+
+	private:
+
+		void reserve_for(size_t n)
+		{
+#ifndef XS_LIST_CHILDREN
+			reserve(n);
+#endif
+		}
+
+		 /// take 'node' into the document of the list owner
+		 // Arena nodes release other nodes they list when releasing the arena, see XMLNode::cleanup().
+		void adopt(XMLNode* node)
+		{
+			node->_parent = _node;
+
+			if (_node) {
+				assert(!node->_arena || node->_arena==_node->_arena);
+
+				if (!node->_arena)
+					node->_arena = _node->_arena;
+
+				if (!node->_arena_alloc)
+					_node->need_cleanup();
+			}
+		}
+	};
+
+	 /// children list shared by copies of a node
+	 // The node the list has been taken from keeps it as its own children. Before it or one of the nodes
+	 // below it is changed, it publishes clones in a new list, each clone in turn sharing the children of
+	 // its original. So writes through pointers obtained before copying never show up in the copies.
+	 // No list is freed before the last user releases it, so copies can be read on other threads. Those
+	 // reads have to be finished before the original changes its nodes, though.
+	 // Listed nodes keep the original as parent, clones have none; so _parent is invalid for shared nodes.
+	struct SharedChildren
+	{
+		SharedChildren(const XMLNode* owner)
+		 :	_refs(1),
+			_owner(owner),
+			_clones(NULL)
+		{
+		}
+
+		~SharedChildren()
+		{
+			if (_clones) {
+				_clones->clear();
+				delete _clones;
+			}
+
+			_nodes.reset();	// the originals belong to the owner
+		}
+
+		 /// the nodes seen by the copies
+		const Children& get_nodes() const
+		{
+			Children* clones = _clones;
+
+			return clones? *clones: _nodes;
+		}
+
+		volatile long _refs;	// changed with xs_atomic_inc() and xs_atomic_dec(), read with xs_atomic_get()
+		const XMLNode* volatile _owner;	// node the list has been taken from, keeps the original nodes on detaching
+		Children _nodes;		// the children of _owner, not changed while the list is shared
+		Children* volatile _clones;	// clones of _nodes published by the owner on detaching
 	};
 
 	 // access to protected class members for XMLPos and XMLReader
@@ -1504,22 +2835,51 @@ struct XMLNode : public XS_String
 	friend struct const_XMLPos;
 	friend struct XMLReaderBase;
 	friend struct XPathElement;
+	friend struct XMLSnapshot;
+	friend struct XMLWriteCache;
+	friend struct XMLAttributeMapBase;
+	friend struct XMLDoc;
 
 	XMLNode(const XS_String& name)
 	 :	XS_String(name),
-		_cdata_content(false)
+		_atom(NULL),
+		_parent(NULL),
+		_shared(NULL),
+		_cdata_content(false),
+		_modified(true),
+		_arena_alloc(false),
+		_arena(NULL),
+		_cleanup(NULL),
+		_child_index(NULL)
 	{
+		_children._node = this;
+		_attributes._node = this;
 	}
 
 	XMLNode(const XS_String& name, const std::string& leading)
 	 :	XS_String(name),
+		_atom(NULL),
+		_parent(NULL),
+		_shared(NULL),
 		_leading(leading),
-		_cdata_content(false)
+		_cdata_content(false),
+		_modified(true),
+		_arena_alloc(false),
+		_arena(NULL),
+		_cleanup(NULL),
+		_child_index(NULL)
 	{
+		_children._node = this;
+		_attributes._node = this;
 	}
 
+	 /// copy the node sharing the children with 'other' until one of both changes them
+	 // The copy owns all its text, so it doesn't depend on the document of 'other'.
 	XMLNode(const XMLNode& other)
 	 :	XS_String(other),
+		_atom(other._atom),
+		_parent(NULL),
+		_shared(other.share_children()),
 		_attributes(other._attributes),
 		_leading(other._leading),
 		_content(other._content),
@@ -1528,10 +2888,18 @@ struct XMLNode : public XS_String
 #ifdef XMLNODE_LOCATION
 		_location(other._location),
 #endif
-		_cdata_content(false)
+		_cdata_content(other._cdata_content),
+		_modified(true),
+		_arena_alloc(false),
+		_arena(NULL),
+		_cleanup(NULL),
+		_child_index(NULL)
 	{
-		for(Children::const_iterator it=other._children.begin(); it!=other._children.end(); ++it)
-			_children.push_back(new XMLNode(**it));
+		_children._node = this;
+		_attributes._node = this;
+
+		if (_atom)
+			_atom->_table->add_ref();
 	}
 
 	enum COPY_FLAGS {COPY_NOCHILDREN};
@@ -1541,6 +2909,9 @@ struct XMLNode : public XS_String
 #endif
 	XMLNode(const XMLNode& other, COPY_FLAGS copy_no_children)
 	 :	XS_String(other),
+		_atom(other._atom),
+		_parent(NULL),
+		_shared(NULL),
 		_attributes(other._attributes),
 		_leading(other._leading),
 		_content(other._content),
@@ -1549,36 +2920,95 @@ struct XMLNode : public XS_String
 #ifdef XMLNODE_LOCATION
 		_location(other._location),
 #endif
-		_cdata_content(false)
+		_cdata_content(other._cdata_content),
+		_modified(true),
+		_arena_alloc(false),
+		_arena(NULL),
+		_cleanup(NULL),
+		_child_index(NULL)
 	{
 		assert(copy_no_children==COPY_NOCHILDREN);
+
+		_children._node = this;
+		_attributes._node = this;
+
+		if (_atom)
+			_atom->_table->add_ref();
 	}
 
 	virtual ~XMLNode()
 	{
+		detach_children(false);
+
 		while(!_children.empty()) {
 			delete _children.back();
 			_children.pop_back();
 		}
+
+		if (_atom && !_arena_alloc)
+			_atom->_table->release();
+
+		delete _child_index;
+
+		if (_cleanup)
+			_cleanup->_obj = NULL;
+	}
+
+	 /// create a node named by an interned atom for the document identified by 'arena'
+	 // The node is allocated in the arena if 'alloc' is set, see XMLDoc::use_arena().
+	static XMLNode* create(const XMLAtom* atom, XMLArena* arena, bool alloc)
+	{
+		if (alloc)
+			return new(arena) XMLNode(atom, arena, true);
+		else
+			return new XMLNode(atom, arena, false);
 	}
 
+	static XMLNode* create(const XS_String& name, XMLArena* arena, bool alloc)
+	{
+		if (alloc)
+			return new(arena) XMLNode(name, arena, true);
+		else
+			return new XMLNode(name, arena, false);
+	}
+
+	static void* operator new(size_t size) {return XMLArena::alloc_object(NULL, size);}
+	static void* operator new(size_t size, XMLArena* arena) {return XMLArena::alloc_object(arena, size);}
+	static void operator delete(void* p) {XMLArena::free_object(p);}
+	static void operator delete(void* p, XMLArena*) {XMLArena::free_object(p);}
+
 	void clear()
 	{
+		prepare_write();
+
 		_leading.erase();
 		_content.erase();
 		_end_leading.erase();
 		_trailing.erase();
 
 		_attributes.clear();
+		detach_children(false);
 		_children.clear();
 
 		XS_String::erase();
+
+		release_atom();
+
+		_modified = true;
 	}
 
+	 /// assign the content of 'other' sharing its children until one of both changes them
 	XMLNode& operator=(const XMLNode& other)
 	{
+		SharedChildren* shared = other.share_children();
+
+		prepare_write();
+		need_cleanup();
+		detach_children(false);
 		_children.clear();
-		_children.copy(other._children);
+		_shared = shared;
+		delete _child_index;
+		_child_index = NULL;
 
 		_attributes = other._attributes;
 
@@ -1587,37 +3017,71 @@ struct XMLNode : public XS_String
 		_end_leading = other._end_leading;
 		_trailing = other._trailing;
 
+		_modified = true;
+
 		return *this;
 	}
 
-	 /// add a new child node
-	void add_child(XMLNode* child)
+	 /// add a new child node, returning the node actually added
+	 // A node of another document is replaced by a copy, which doesn't depend on the memory of that
+	 // document like its arena or its memory mapped input. The original node is deleted then.
+	XMLNode* add_child(XMLNode* child)
 	{
+		prepare_write();
+		detach_children();
+		child = import(child);
 		_children.push_back(child);
+		_modified = true;
+
+		return child;
+	}
+
+	 /// move all children of 'other' to the end of the own children list, copying them if they belong to another document
+	void move_children(XMLNode& other)
+	{
+		prepare_write();
+		detach_children();
+		other.prepare_write();
+		other.detach_children();
+
+		for(Children::iterator it=other._children.begin(); it!=other._children.end(); ++it)
+			_children.push_back(import(*it));
+
+		other._children.reset();
+		_modified = true;
+		other._modified = true;
 	}
 
 	 /// remove all children named 'name'
 	void remove_children(const XS_String& name)
 	{
-		Children::iterator it, next=_children.begin();
+		prepare_write();
+		detach_children();
 
-		while((it=next) != _children.end()) {
-			++next;
-
-			if (**it == name)
-				_children.erase(it);
-		}
+		for(Children::iterator it=_children.begin(); it!=_children.end(); )
+			if (**it == name) {
+				it = _children.erase(it);
+				_modified = true;
+			} else
+				++it;
 	}
 
 	 /// write access to an attribute
 	void put(const XS_String& attr_name, const XS_String& value)
 	{
+		prepare_write();
+		need_cleanup();
 		_attributes[attr_name] = value;
+		_modified = true;
 	}
 
 	 /// index operator write access to an attribute
 	XS_String& operator[](const XS_String& attr_name)
 	{
+		prepare_write();
+		need_cleanup();
+		_modified = true;
+
 		return _attributes[attr_name];
 	}
 
@@ -1633,19 +3097,43 @@ struct XMLNode : public XS_String
 
 	 /// read only access to an attribute
 	template<typename T> XS_String get(const T& attr_name, LPCXSSTR def=XS_EMPTY_STR) const
+	{
+		XS_String value;
+
+		if (_attributes.get_value(attr_name, value))
+			return value;
+		else
+			return def;
+	}
+
+	 /// read only access to the map node of an attribute including its cached typed value, NULL if not present
+	template<typename T> const XS_SMNode* get_entry(const T& attr_name) const
 	{
 		AttributeMap::const_iterator found = _attributes.find(attr_name);
 
 		if (found != _attributes.end())
-			return found->second;
+			return found.ptr();
 		else
-			return def;
+			return NULL;
+	}
+
+	 /// write access to the map node of an attribute, see XMLBoolRef
+	XS_SMNode& entry(const XS_String& attr_name)
+	{
+		prepare_write();
+		need_cleanup();
+		_modified = true;
+
+		return _attributes.entry(attr_name);
 	}
 
 	 /// remove the attribute 'attr_name'
 	void erase(const XS_String& attr_name)
 	{
-		_attributes.erase(attr_name);
+		prepare_write();
+
+		if (_attributes.erase(attr_name))
+			_modified = true;
 	}
 
 	 /// convenient value access in children node
@@ -1672,6 +3160,19 @@ struct XMLNode : public XS_String
 		return (*node)[attr_name];
 	}
 
+	 /// write access to the map node of an attribute in a children node, see XMLStringRef
+	XS_SMNode& subentry(const XS_String& child_name, const XS_String& attr_name, int n=0)
+	{
+		XMLNode* node = XPathElement(child_name, n).find(this);
+
+		if (!node) {
+			node = new XMLNode(child_name);
+			add_child(node);
+		}
+
+		return node->entry(attr_name);
+	}
+
 #if defined(UNICODE) && !defined(XS_STRING_UTF8)
 	 /// convenient value access in children node
 	XS_String subvalue(const char* child_name, const char* attr_name, int n=0) const
@@ -1700,11 +3201,18 @@ struct XMLNode : public XS_String
 
 	const Children& get_children() const
 	{
-		return _children;
+		SharedChildren* shared = _shared;
+
+		return shared && shared->_owner!=this? shared->get_nodes(): _children;
 	}
 
+	 // call set_modified() after changing the children list through this reference
+	 // Write access clones children shared with copies of the node. Pointers to the previous
+	 // children of copies stay valid, but refer to nodes only seen by the copy from then on.
 	Children& get_children()
 	{
+		prepare_write();
+		detach_children();
 		return _children;
 	}
 
@@ -1713,21 +3221,35 @@ struct XMLNode : public XS_String
 		return _attributes;
 	}
 
+	 // call set_modified() after changing the attributes through this reference
 	AttributeMap& get_attributes()
 	{
+		prepare_write();
+		need_cleanup();
 		return _attributes;
 	}
 
+	 /// true if the node itself has been changed since it has been written through an XMLWriteCache
+	bool is_modified() const
+	{
+		return _modified;
+	}
+
+	void set_modified()
+	{
+		_modified = true;
+	}
+
 	 /// read element node content
 	XS_String get_content() const
 	{
-		return DecodeXMLString(_content);
+		return DecodeXMLString(_content.str());
 	}
 
 	 /// read element node content as encoded string
 	std::string get_encoded_content() const
 	{
-		return _content;
+		return _content.str();
 	}
 
 	 /// read content of a subnode specified by an XPath expression
@@ -1744,13 +3266,19 @@ struct XMLNode : public XS_String
 	 /// set element node content
 	void set_content(const XS_String& s, bool cdata=false)
 	{
+		prepare_write();
+		need_cleanup();
 		_content.assign(EncodeXMLString(s.c_str(), cdata));
+		_modified = true;
 	}
 
 	 /// set element node content from encoded string
 	void set_encoded_content(const std::string& s)
 	{
+		prepare_write();
+		need_cleanup();
 		_content.assign(s);
+		_modified = true;
 	}
 
 	 /// set content of a subnode specified by an XPath expression
@@ -1771,79 +3299,316 @@ struct XMLNode : public XS_String
 
 	 /// write node with children tree to output stream
 	bool write(std::ostream& out, const XMLFormat& format, WRITE_MODE mode=FORMAT_SMART, int indent=0) const
+	{
+		write_worker(out, format, mode, indent, NULL);
+
+		return out.good();
+	}
+
+	 /// count the nodes matching the given relative XPath expression
+	int count(const XPath& xpath) const
+	{
+		return count(xpath.begin(), xpath.end());
+	}
+
+	 /// count the nodes matching the given relative XPath expression
+	int count(XPath::const_iterator from, const XPath::const_iterator& to) const;
+
+	 /// copy matching tree nodes using the given XPath filter expression
+	bool filter(const XPath& xpath, XMLNode& target) const;
+
+	 /// XPath find function (const)
+	const XMLNode* find_relative(const XPath& xpath) const;
+
+	 /// XPath find function
+	XMLNode* find_relative(const XPath& xpath);
+
+	XMLNode* get_first_child()
+	{
+		const Children& children = get_children();
+
+		if (!children.empty())
+			return children.front();
+		else
+			return NULL;
+	}
+
+	const XMLNode* get_first_child() const
+	{
+		const Children& children = get_children();
+
+		if (!children.empty())
+			return children.front();
+		else
+			return NULL;
+	}
+
+	 /// name index of the children, NULL for nodes with less than XS_CHILD_INDEX_MIN children
+	 // The index is updated for appended children and rebuilt after other modifications.
+	 // Names of indexed children must not be changed through their XS_String base.
+	const XMLChildIndex* get_child_index();
+
+	 /// the index built by the last non-const call, NULL if the children changed since then
+	 // Const access never builds the index, so concurrent readers don't change the node.
+	const XMLChildIndex* get_child_index() const;
+
+	 /// interned name of nodes created by XMLReaderBase, NULL for other nodes
+	const XMLAtom* get_atom() const
+	{
+		return _atom;
+	}
+
+	 /// rename the node, interning the new name in the table of the old one
+	void set_name(const XS_String& name)
+	{
+		prepare_write();
+		need_cleanup();
+
+		if (_atom)
+			_atom = _atom->_table->intern(name);
+
+		XS_String::assign(name);
+		_modified = true;
+	}
+
+	 /// drop the interned name before handing out write access to the name string, see XMLPos::str()
+	void release_atom()
+	{
+		if (_atom) {
+			if (!_arena_alloc)	// the document keeps the atom table of arena nodes
+				_atom->_table->release();
+
+			_atom = NULL;
+		}
+	}
+
+	 /// prepare a change of the node, cloning the nodes on its path shared by copies of an ancestor
+	 // All modifying members call this, so nodes reached through pointers obtained before copying
+	 // their document can be changed without affecting the copy.
+	void prepare_write()
+	{
+		if (_parent)
+			unshare_ancestors();
+	}
+
+protected:
+	const XMLAtom* _atom;	// next to the name string for fast name comparisons
+
+private:
+	 // The name is changed by set_name() only to keep it in sync with _atom.
+	using XS_String::assign;
+	using XS_String::append;
+	using XS_String::insert;
+	using XS_String::replace;
+	using XS_String::resize;
+	using XS_String::swap;
+	using XS_String::push_back;
+	using XS_String::operator+=;
+
+protected:
+
+	Children _children;		// empty while sharing the list of another node
+	XMLNode* _parent;		// node listing this one in its _children
+	mutable SharedChildren* volatile _shared;	// set by share_children() on const nodes, so readers can copy concurrently
+	AttributeMap _attributes;
+
+	XS_RefString _leading;		// UTF-8 encoded
+	XS_RefString _content;		// UTF-8 and entity encoded, may contain CDATA sections; decode with DecodeXMLString()
+	XS_RefString _end_leading;	// UTF-8 encoded
+	XS_RefString _trailing;		// UTF-8 encoded
+
+#ifdef XMLNODE_LOCATION
+	XMLLocation	_location;
+#endif
+
+	bool	_cdata_content;
+	mutable bool _modified;	// changed since the last write through an XMLWriteCache
+	bool	_arena_alloc;	// allocated in _arena, see create()
+
+	XMLArena* _arena;	// identifies the document whose memory the node may refer to, NULL for independent nodes
+	mutable XMLArena::Cleanup* volatile _cleanup;	// registration of arena nodes holding other memory
+
+	XMLChildIndex* _child_index;
+
+	 /// create a node for the document identified by 'arena'
+	XMLNode(const XMLAtom* atom, XMLArena* arena, bool arena_alloc)
+	 :	XS_String(atom->_name),
+		_atom(atom),
+		_children(arena_alloc? arena: NULL),
+		_parent(NULL),
+		_shared(NULL),
+		_cdata_content(false),
+		_modified(true),
+		_arena_alloc(arena_alloc),
+		_arena(arena),
+		_cleanup(NULL),
+		_child_index(NULL)
+	{
+		_children._node = this;
+		_attributes._node = this;
+
+		if (!arena_alloc)
+			atom->_table->add_ref();
+		else if (name_allocated())
+			need_cleanup();
+	}
+
+	XMLNode(const XS_String& name, XMLArena* arena, bool arena_alloc)
+	 :	XS_String(name),
+		_atom(NULL),
+		_children(arena_alloc? arena: NULL),
+		_parent(NULL),
+		_shared(NULL),
+		_cdata_content(false),
+		_modified(true),
+		_arena_alloc(arena_alloc),
+		_arena(arena),
+		_cleanup(NULL),
+		_child_index(NULL)
+	{
+		_children._node = this;
+		_attributes._node = this;
+
+		if (arena_alloc && name_allocated())
+			need_cleanup();
+	}
+
+	 /// true if the name string keeps its characters outside of the node
+	bool name_allocated() const
+	{
+		const char* p = (const char*) XS_String::data();
+
+		return p<(const char*)this || p>=(const char*)(this+1);
+	}
+
+	 /// register arena nodes holding memory outside of the arena to release it together with the arena
+	 // Members allocating memory for arena nodes call this, so other arena nodes are just forgotten.
+	void need_cleanup() const
+	{
+		if (_arena_alloc && !_cleanup)
+			_arena->add_cleanup(&_cleanup, cleanup, const_cast<XMLNode*>(this));
+	}
+
+	static void cleanup(void* obj, bool destroy);
+	void	detach_arena_children();
+	void	release_children();
+
+	 /// return 'node' or a copy of it if it belongs to another document, see add_child()
+	XMLNode* import(XMLNode* node) const
+	{
+		if (node->_arena && node->_arena!=_arena) {
+			XMLNode* copy = new XMLNode(*node);
+			delete node;
+			return copy;
+		}
+
+		return node;
+	}
+
+	SharedChildren* share_children() const;
+	void	detach_children(bool keep=true);
+	void	unshare_ancestors();
+
+	 /// relative XPath create function
+	XMLNode* create_relative(const XPath& xpath);
+
+	 /// create a new node tree using the given XPath filter expression
+	XMLNode* filter(XPath::const_iterator from, const XPath::const_iterator& to) const;
+
+	void write_worker(std::ostream& out, const XMLFormat& format, WRITE_MODE mode, int indent, XMLWriteCache* cache) const
 	{
 		switch(mode) {
 		  case FORMAT_PLAIN:
-			plain_write_worker(out);
+			plain_write_worker(out, cache);
 			break;
 
 		  case FORMAT_PRETTY:
-			pretty_write_worker(out, format, indent);
+			pretty_write_worker(out, format, indent, cache);
 			break;
 
 		  case FORMAT_ORIGINAL:
-			original_write_worker(out);
+			original_write_worker(out, cache);
 			break;
 
 		  default:	// FORMAT_SMART
-			smart_write_worker(out, format, indent);
+			smart_write_worker(out, format, indent, cache);
 		}
-
-		return out.good();
 	}
 
-	 /// count the nodes matching the given relative XPath expression
-	int count(const XPath& xpath) const
+	 // children are written through 'cache' if not NULL
+	void	original_write_worker(std::ostream& out, XMLWriteCache* cache=NULL) const;
+	void	plain_write_worker(std::ostream& out, XMLWriteCache* cache=NULL) const;
+	void	pretty_write_worker(std::ostream& out, const XMLFormat& format, int indent, XMLWriteCache* cache=NULL) const;
+	void	smart_write_worker(std::ostream& out, const XMLFormat& format, int indent, XMLWriteCache* cache=NULL) const;
+};
+
+
+ /// cache of serialized subtrees for repeated writes of a changing document
+ // The text of nodes up to XS_WRITE_CACHE_DEPTH levels below the written node is kept from one write to the next.
+ // Subtrees without modified nodes are copied from there instead of being encoded again.
+ // Writing resets the modification flags of the nodes, so use only one cache per document.
+struct XMLWriteCache
+{
+	XMLWriteCache()
+	 :	_format(NULL),
+		_mode(FORMAT_SMART),
+		_level(0),
+		_gen(0)
 	{
-		return count(xpath.begin(), xpath.end());
 	}
 
-	 /// count the nodes matching the given relative XPath expression
-	int count(XPath::const_iterator from, const XPath::const_iterator& to) const;
-
-	 /// copy matching tree nodes using the given XPath filter expression
-	bool filter(const XPath& xpath, XMLNode& target) const;
+	 /// write node with children tree to output stream reusing the unchanged parts of the previous write
+	bool	write(std::ostream& out, const XMLNode& node, const XMLFormat& format, WRITE_MODE mode=FORMAT_SMART, int indent=0);
 
-	 /// XPath find function (const)
-	const XMLNode* find_relative(const XPath& xpath) const;
+	void	clear() {_entries.clear();}
 
-	 /// XPath find function
-	XMLNode* find_relative(const XPath& xpath);
+protected:
+	friend struct XMLNode;
 
-	XMLNode* get_first_child() const
+	struct Entry
 	{
-		if (!_children.empty())
-			return _children.front();
-		else
-			return NULL;
-	}
+		Entry() : _indent(0), _gen(0) {}
 
-protected:
-	Children _children;
-	AttributeMap _attributes;
+		int			_indent;
+		unsigned	_gen;	// number of the write producing or using the text
+		std::string	_text;
+	};
 
-	std::string _leading;		// UTF-8 encoded
-	std::string _content;		// UTF-8 and entity encoded, may contain CDATA sections; decode with DecodeXMLString()
-	std::string _end_leading;	// UTF-8 encoded
-	std::string _trailing;		// UTF-8 encoded
+	typedef std::map<const XMLNode*, Entry> Entries;
 
-#ifdef XMLNODE_LOCATION
-	XMLLocation	_location;
-#endif
+	Entries	_entries;
 
-	bool	_cdata_content;
+	const XMLFormat* _format;
+	WRITE_MODE	_mode;
+	std::string	_endl;
+	int			_level;
+	unsigned	_gen;
 
-	 /// relative XPath create function
-	XMLNode* create_relative(const XPath& xpath);
+	bool	scan(const XMLNode& node, int level);
+	void	write_node(std::ostream& out, const XMLNode& node, int indent);
+};
 
-	 /// create a new node tree using the given XPath filter expression
-	XMLNode* filter(XPath::const_iterator from, const XPath::const_iterator& to) const;
 
-	void	original_write_worker(std::ostream& out) const;
-	void	plain_write_worker(std::ostream& out) const;
-	void	pretty_write_worker(std::ostream& out, const XMLFormat& format, int indent) const;
-	void	smart_write_worker(std::ostream& out, const XMLFormat& format, int indent) const;
-};
+inline bool XMLAtomCache::matches(const XMLNode& node, const XS_String& name) const
+{
+	const XMLAtom* atom = node.get_atom();
+
+	if (!atom)
+		return node == name;
+
+	assert(atom->_name == node);
+
+	 // look up 'name' again when switching tables or when a missing name may have been added meanwhile
+	const XMLAtomTable* table = atom->_table;
+
+	if (table->id()!=_table_id || (!_atom && table->size()!=_table_size)) {
+		_table_id = table->id();
+		_atom = table->find(name);
+		_table_size = table->size();
+	}
+
+	return atom == _atom;
+}
 
 
  /// iterator access to children nodes with name filtering
@@ -1922,10 +3687,11 @@ struct XMLChildrenFilter
 		BaseIterator	_cur;
 		BaseIterator	_end;
 		XS_String	_filter_name;
+		XMLAtomCache _filter_atom;
 
 		void search_next()
 		{
-			while(_cur!=_end && **_cur!=_filter_name)
+			while(_cur!=_end && !_filter_atom.matches(**_cur, _filter_name))
 				++_cur;
 		}
 	};
@@ -2022,10 +3788,11 @@ struct const_XMLChildrenFilter
 		BaseIterator	_cur;
 		BaseIterator	_end;
 		XS_String	_filter_name;
+		XMLAtomCache _filter_atom;
 
 		void search_next()
 		{
-			while(_cur!=_end && **_cur!=_filter_name)
+			while(_cur!=_end && !_filter_atom.matches(**_cur, _filter_name))
 				++_cur;
 		}
 	};
@@ -2130,8 +3897,7 @@ struct XMLPos
 	 /// insert children when building tree
 	void add_down(XMLNode* child)
 	{
-		_cur->add_child(child);
-		go_to(child);
+		go_to(_cur->add_child(child));
 	}
 
 	 /// go back to previous position
@@ -2301,7 +4067,8 @@ struct XMLPos
 		if (!_stack.empty()) {
 			XMLNode* pLast = _stack.top();
 
-			if (pLast->_children.remove(_cur)) {
+			if (pLast->get_children().remove(_cur)) {
+				pLast->set_modified();
 				_cur = _stack.top();
 				return true;
 			}
@@ -2322,7 +4089,7 @@ struct XMLPos
 		_cur->erase(attr_name);
 	}
 
-	XS_String& str() {return *_cur;}
+	XS_String& str() {_cur->prepare_write(); _cur->need_cleanup(); _cur->release_atom(); _cur->set_modified(); return *_cur;}	// prefer XMLNode::set_name() to keep the atom
 	const XS_String& str() const {return *_cur;}
 
 	 // property (key/value pair) setter functions
@@ -2520,8 +4287,12 @@ protected:
 	XMLReaderBase(XMLNode* node);
 	virtual ~XMLReaderBase();
 
+	 /// number of bytes passed to Expat per parse call, see XS_EXPAT_CHUNK_SIZE
+	void set_chunk_size(int chunk_size) {_chunk_size = chunk_size>0? chunk_size: XS_EXPAT_CHUNK_SIZE;}
+
 protected:
 	XML_Parser	_parser;
+	int		_chunk_size;
 
 	static void XMLCALL XML_XmlDeclHandler(void* userData, const XML_Char* version, const XML_Char* encoding, int standalone=-1);
 	static void XMLCALL XML_StartElementHandler(void* userData, const XML_Char* name, const XML_Char** atts);
@@ -2537,6 +4308,13 @@ protected:
 		_endl_defined(false)
 	{
 		_last_tag = TAG_NONE;
+		_atoms = NULL;
+		_arena = NULL;
+		_use_arena = false;
+#ifdef XS_NATIVE
+		_last_crlf = 0;
+		_utf8 = false;
+#endif
 	}
 
 	virtual ~XMLReaderBase();
@@ -2549,7 +4327,11 @@ public:
 #ifndef XS_USE_XERCES
 	void read();
 
+#ifdef XS_NATIVE
 	std::string	get_position() const {return _location.str();}
+#else
+	std::string	get_position() const;
+#endif
 #endif
 	const XMLFormat& get_format() const {return _format;}
 	const char* get_endl() const {return _endl_defined? _format._endl: "\n";}
@@ -2573,12 +4355,16 @@ public:
 	void setSystemId(const char* systemId) {_display_path = systemId;}
 #endif
 
-	std::string	get_encoded_content() const {return _content;}
+	std::string	get_encoded_content() const {return _content.str();}
+
+	XMLAtomTable* _atoms;	// table to intern element and attribute names, set by XMLDoc::read()
+	XMLArena* _arena;		// identifies the document of the new nodes, set by XMLDoc::read()
+	bool	_use_arena;		// allocate the new nodes and their text in _arena
 
 protected:
 	XMLPos		_pos;
 
-	std::string _content;		// UTF-8 encoded
+	XS_RefString _content;		// UTF-8 encoded
 	enum {TAG_NONE, TAG_START, TAG_END} _last_tag;
 
 	XMLErrorList _errors;
@@ -2589,17 +4375,59 @@ protected:
 
 #ifdef XS_NATIVE
 	XMLLocation	_location;
+	int		_last_crlf;
+	bool	_utf8;		// UTF-8 input, initial and final encoding state of the parser
 
 	virtual int get() = 0;
 	int		eat_endl();
+
+	 /// read a block of characters, return 0 at end of input and -1 if block reading is not supported
+	virtual int read_block(char*, int) {return -1;}
+
+	 /// return the remaining input if it is memory mapped and stays valid while the document exists
+	virtual bool get_mapped_input(const char*&, const char*&) {return false;}
+
+	 /// store content referencing the mapped input
+	virtual void MappedDefaultHandler(const char* s, size_t l);
+
+	 /// return true to skip an element including its content without decoding its attributes
+	virtual bool SkipElementHandler(const XS_String&) {return false;}
+
+	 /// return true to skip the following character data
+	virtual bool SkipTextHandler() {return false;}
+
+	 /// increment line counter on LF, CR, CR/LF or LF/CR line endings
+	void count_location(int c)
+	{
+		if (c=='\n' || c=='\r') {
+			if (!_last_crlf || c==_last_crlf) {
+				_location._column = 1;
+				++_location._line;
+				_last_crlf = c;
+			} else
+				_last_crlf = 0;
+		} else {
+			++_location._column;
+			_last_crlf = 0;
+		}
+	}
+
+	void	count_location(const char* s, size_t l);
 #elif defined(XS_USE_XERCES)
 	//TODO
 #elif defined(XS_USE_EXPAT)
+	 /// read a block of input into the parser buffer, return 0 or -1 at end of input
 	virtual int read_buffer(char* buffer, int len) = 0;
+
+	 /// return the input if it is already in memory to parse it without reading it into a buffer first
+	virtual bool get_mapped_input(const char*&, const char*&) {return false;}
 #endif
 
 	void	finish_read();
 
+	 /// arena for the text of new nodes, NULL to allocate it on the heap
+	XMLArena* text_arena() const {return _use_arena? _arena: NULL;}
+
 	virtual void XmlDeclHandler(const char* version, const char* encoding, int standalone);
 	virtual void StartElementHandler(const XS_String& name, const XMLNode::AttributeMap& attributes);
 	virtual void EndElementHandler();
@@ -2650,7 +4478,7 @@ struct ExpatXMLReader : public XMLReaderBase
 
 		_in.read(buffer, len);
 
-		return _in.gcount();
+		return (int)_in.gcount();
 	}
 
 protected:
@@ -2659,14 +4487,54 @@ protected:
 
 #define XMLReader ExpatXMLReader
 
+ /// Expat reader for input already in memory, see XMLDoc::read_buffer() and XMLDoc::read_file_mapped()
+ // Expat copies the parsed text into its own buffer, so 'data' only has to stay valid while reading.
+struct XMLMappedReader : public XMLReaderBase
+{
+	XMLMappedReader(XMLNode* node, const char* data, size_t len)
+	 :	XMLReaderBase(node),
+		_ptr(data),
+		_end(data+len)
+	{
+	}
+
+	int read_buffer(char* buffer, int len)
+	{
+		if ((size_t)len > (size_t)(_end-_ptr))
+			len = (int)(_end - _ptr);
+
+		memcpy(buffer, _ptr, len);
+		_ptr += len;
+
+		return len;
+	}
+
+	 /// hand over the remaining input to the parser
+	bool get_mapped_input(const char*& begin, const char*& end)
+	{
+		begin = _ptr;
+		end = _end;
+
+		_ptr = _end;
+
+		return true;
+	}
+
+protected:
+	const char*	_ptr;
+	const char*	_end;
+};
+
 #else // XS_USE_XERCES, XS_USE_EXPAT
 
 struct XMLReader : public XMLReaderBase
 {
-	XMLReader(XMLNode* node, std::istream& in)
+	 // Block reads consume input past the end of the document,
+	 // so they are only enabled for streams opened by XMLStorage itself, see XMLDoc::read_file().
+	XMLReader(XMLNode* node, std::istream& in, bool block_read=false)
 	 :	XMLReaderBase(node),
 		_in(in),
-		_last_crlf(0)
+		_block_read(block_read)
 	{
 	}
 
@@ -2675,29 +4543,83 @@ struct XMLReader : public XMLReaderBase
 	{
 		int c = _in.get();
 
-//		 // increment line counter on LF
-//		if (c == '\n') {
-//			_location._column = 1;
-//			++_location._line;
-		 // increment line counter on LF, CR, CR/LF or LF/CR line endings
-		if (c=='\n' || c=='\r') {
-			if (!_last_crlf || c==_last_crlf) {
-				_location._column = 1;
-				++_location._line;
-				_last_crlf = c;
-			} else
-				_last_crlf = 0;
-		} else {
-			++_location._column;
-			_last_crlf = 0;
-		}
+		count_location(c);
 
 		return c;
 	}
 
+	 /// read a block of characters from XML stream
+	int read_block(char* buffer, int len)
+	{
+		if (!_block_read)
+			return -1;
+
+		_in.read(buffer, len);
+
+		return (int)_in.gcount();
+	}
+
 protected:
 	std::istream&	_in;
-	int	_last_crlf;
+	bool	_block_read;
+};
+
+ /// XML reader for memory mapped input, see XMLDoc::read_file_mapped()
+struct XMLMappedReader : public XMLReaderBase
+{
+	XMLMappedReader(XMLNode* node, const char* data, size_t len)
+	 :	XMLReaderBase(node),
+		_ptr(data),
+		_end(data+len)
+	{
+	}
+
+	 /// read one character from the mapped input
+	int get()
+	{
+		if (_ptr == _end)
+			return EOF;
+
+		int c = (unsigned char)*_ptr++;
+
+		count_location(c);
+
+		return c;
+	}
+
+	 /// hand over the remaining input to the parser
+	bool get_mapped_input(const char*& begin, const char*& end)
+	{
+		begin = _ptr;
+		end = _end;
+
+		_ptr = _end;
+
+		return true;
+	}
+
+protected:
+	const char*	_ptr;
+	const char*	_end;
+};
+
+ /// reader for a part of a mapped document, see XMLDoc::read_file_parallel()
+struct XMLChunkReader : public XMLMappedReader
+{
+	 // 'open_root' continues parsing inside the already open root element of the document 'node'
+	XMLChunkReader(XMLNode* node, const char* data, size_t len, bool utf8, bool open_root=false)
+	 :	XMLMappedReader(node, data, len)
+	{
+		_utf8 = utf8;
+
+		if (open_root) {
+			_pos.go_down();
+			_last_tag = TAG_END;
+		}
+	}
+
+	bool	is_utf8() const {return _utf8;}
+	bool	endl_defined() const {return _endl_defined;}
 };
 
 struct ReadBuffer
@@ -2708,11 +4630,13 @@ struct ReadBuffer
 	void	reset();
 	bool	empty() const {return _wptr==_buffer;}
 	void	append(int c);
+	void	append(const char* s, size_t l);
 	const std::string& str(bool utf8);
 	size_t	len() const;
 	bool	has_CDEnd() const;
 	XS_String get_tag() const;
 	void	get_attributes(XMLNode::AttributeMap& attributes) const;
+	void	get_lazy_attributes(XMLNode::AttributeMap& attributes, const char* mapped) const;
 	XMLLocation& get_location() const {return _location;}
 
 protected:
@@ -2722,21 +4646,66 @@ protected:
 	char*	_wptr;
 	size_t	_len;
 	std::string	_buffer_str;	// UTF-8 encoded
+
+	const char* get_attributes_start() const;
 };
 
 struct ParseContext
 {
 	ParseContext(XMLReaderBase& reader);
+	~ParseContext();
 
 	void	read_bom();
 	bool	proceed();
 	int		process_next(int c);
 
+	 /// read one character from the input window
+	int get()
+	{
+		if (_rptr==_rend && !fill_window())
+			return _block_read? EOF: _reader.get();
+
+		int c = (unsigned char)*_rptr++;
+
+		_reader.count_location(c);
+
+		return c;
+	}
+
+	int		eat_endl();
+	bool	read_until(int delim);
+	int		read_text(bool copy=true);
+	bool	skip_until(int delim);
+	void	skip_past(const char* end_str);
+	void	skip_element();
+
 	XMLReaderBase& _reader;
 	ReadBuffer	_buffer;
 	int			_next;
 	bool		_in_comment;
 	bool		_utf8;
+
+protected:
+	char*		_window;	// input window for block reads
+	const char*	_rptr;
+	const char*	_rend;
+	bool		_block_read;
+	bool		_mapped;	// _rptr points into memory mapped input
+
+	bool	fill_window();
+	void	check_endl(const char* s, size_t l);
+
+	 /// return true if content can reference the mapped input without encoding conversion
+	bool ref_input() const
+	{
+#if defined(_WIN32) && !defined(XS_STRING_UTF8)
+		return _mapped && _utf8;
+#else
+		return _mapped;
+#endif
+	}
+
+	void	content_handler(const char* start, size_t len);
 };
 
 #endif // XS_USE_XERCES
@@ -2838,20 +4807,129 @@ typedef std::ostringstream fast_ostringstream;
 #endif
 
 
+ /// read-only memory mapping of a file
+struct XMLFileMapping
+{
+	XMLFileMapping();
+	~XMLFileMapping();
+
+	bool	open(LPCTSTR path);
+	void	close();
+
+	const char* data() const {return _data;}
+	size_t	length() const {return _len;}
+
+protected:
+	const char*	_data;
+	size_t	_len;
+
+#ifdef _WIN32
+	HANDLE	_hFile;
+	HANDLE	_hMapping;
+#endif
+
+private:
+	XMLFileMapping(const XMLFileMapping&);
+	XMLFileMapping& operator=(const XMLFileMapping&);
+};
+
+ /// size and modification time of a file, see XMLDoc::read_file_cached()
+struct XMLFileStamp
+{
+	XMLFileStamp() : _size(0), _mtime(0) {}
+
+	bool	get(LPCTSTR path);
+
+	bool	empty() const {return !_size && !_mtime;}
+
+	bool operator==(const XMLFileStamp& other) const {return _size==other._size && _mtime==other._mtime;}
+
+	UINT64	_size;
+	UINT64	_mtime;
+};
+
+ /// file mappings owned by a XMLDoc, not copied along with the document
+struct XMLMappingList : public std::list<XMLFileMapping*>
+{
+	XMLMappingList() {}
+	XMLMappingList(const XMLMappingList&) : std::list<XMLFileMapping*>() {}
+
+	~XMLMappingList()
+	{
+		release();
+	}
+
+	XMLMappingList& operator=(const XMLMappingList&) {return *this;}
+
+	void release()
+	{
+		while(!empty()) {
+			delete back();
+			pop_back();
+		}
+	}
+};
+
+
  /// XML document holder
+ // The document owns the memory mapped input and the arena its nodes refer to.
+ // Nodes added from other documents are copied, see XMLNode::add_child(). Nodes taken out
+ // of the document through Children::erase() must not outlive the document.
 struct XMLDoc : public XMLNode
 {
 	XMLDoc()
-	 :	XMLNode("")
+	 :	XMLNode(""),
+		_use_arena(false)
 	{
+		_arena = &_doc_arena;
 	}
 
 	XMLDoc(LPCTSTR path)
-	 :	XMLNode("")
+	 :	XMLNode(""),
+		_use_arena(false)
 	{
+		_arena = &_doc_arena;
+
 		read_file(path);
 	}
 
+	XMLDoc(const XMLDoc& other)
+	 :	XMLNode(other),
+		_format(other._format),
+		_errors(other._errors),
+#ifdef XMLNODE_LOCATION
+		_display_path(other._display_path),
+#endif
+		_use_arena(other._use_arena)
+	{
+		_arena = &_doc_arena;
+	}
+
+	~XMLDoc()
+	{
+		clear();
+	}
+
+	 /// allocate nodes, attributes and text of documents read from now on in a private arena
+	 // The arena memory is released at once together with the document, not when nodes are deleted.
+	void use_arena(bool arena=true)
+	{
+		_use_arena = arena;
+	}
+
+	 /// delete all nodes, releasing the arena and the memory mappings
+	 // Arena nodes without memory outside of the arena are not visited.
+	void clear()
+	{
+		prepare_write();
+		detach_children(false);
+		release_children();
+
+		XMLNode::clear();
+
+		release_unused();
+	}
+
 #ifdef XS_USE_XERCES
 	bool read_file(LPCTSTR path)
 	{
@@ -2884,46 +4962,135 @@ struct XMLDoc : public XMLNode
 		if (!in.good())
 			return false;
 
+		XMLReader reader(this, in, true);
+
+#if defined(_STRING_DEFINED) && !defined(XS_STRING_UTF8)
+		return read(reader, std::string(ANS(path)));
+#else
+		return read(reader, XS_String(path));
+#endif
+	}
+
+#ifdef XS_USE_EXPAT
+	 /// parse the buffer directly without copying it into a stream
+	bool read_buffer(const char* buffer, size_t len, const std::string& system_id=std::string())
+	{
+		XMLMappedReader reader(this, buffer, len);
+
+		return read(reader, system_id);
+	}
+
+	bool read_buffer(const std::string& buffer, const std::string& system_id=std::string())
+	{
+		return read_buffer(buffer.data(), buffer.length(), system_id);
+	}
+#else
+	bool read_buffer(const char* buffer, size_t len, const std::string& system_id=std::string())
+	{
+		return read_buffer(std::string(buffer, len), system_id);
+	}
+
+	bool read_buffer(const std::string& buffer, const std::string& system_id=std::string())
+	{
+		std::istringstream istr(buffer);
+		XMLReader reader(this, istr, true);
+
+		return read(reader, system_id);
+	}
+#endif
+
+	bool read_stream(std::istream& in, const std::string& system_id=std::string())
+	{
 		XMLReader reader(this, in);
 
+		return read(reader, system_id);
+	}
+
+#if defined(XS_NATIVE) || defined(XS_USE_EXPAT)
+	 /// read XML file through a read-only memory mapping
+#ifdef XS_USE_EXPAT
+	 // Expat copies all content into the new nodes, so the mapping is released after parsing.
+#else
+	 // Unmodified content and white space of the new nodes reference the mapping, which is released
+	 // together with the document, by clear() or by reading into the document after removing all nodes.
+#endif
+	bool read_file_mapped(LPCTSTR path)
+	{
+		XMLFileMapping* mapping = new XMLFileMapping;
+
+		if (!mapping->open(path)) {
+			delete mapping;
+			return false;
+		}
+
+		XMLMappedReader reader(this, mapping->data(), mapping->length());
+
 #if defined(_STRING_DEFINED) && !defined(XS_STRING_UTF8)
-		return read(reader, std::string(ANS(path)));
+		bool ret = read(reader, std::string(ANS(path)));
 #else
-		return read(reader, XS_String(path));
+		bool ret = read(reader, XS_String(path));
 #endif
-	}
 
-	bool read_buffer(const char* buffer, size_t len, const std::string& system_id=std::string())
-	{
-		return read_buffer(std::string(buffer, len), system_id);
+#ifdef XS_USE_EXPAT
+		delete mapping;
+#else
+		_mappings.push_back(mapping);	// after read(), which releases the mappings of previous reads
+#endif
+
+		return ret;
 	}
+#endif
 
-	bool read_buffer(const std::string& buffer, const std::string& system_id=std::string())
-	{
-		std::istringstream istr(buffer);
+#ifdef XS_NATIVE
+	 /// read a big XML file through a memory mapping, parsing chunks of root children on worker threads
+	 // Input which can't be split safely is parsed serially. threads=0 uses one thread per processor.
+	bool	read_file_parallel(LPCTSTR path, int threads=0);
+#endif
+#endif // XS_USE_XERCES
 
-		return read_stream(istr, system_id);
-	}
+	 /// write the document as binary snapshot of string table and preorder node array, see XMLSnapshot
+	 // 'source' records the XML file the snapshot is created from.
+	bool	write_snapshot(LPCTSTR path, const XMLFileStamp& source=XMLFileStamp()) const;
 
-	bool read_stream(std::istream& in, const std::string& system_id=std::string())
+	 /// load a binary snapshot through a memory mapping without parsing XML text
+	 // A non-empty 'source' only accepts snapshots written for the same XML file stamp.
+	bool	read_snapshot(LPCTSTR path, const XMLFileStamp& source=XMLFileStamp());
+
+	 /// read an XML file using the binary snapshot cache 'cache_path', which is rewritten when the XML file changed
+	 // The XML file stays the source of truth, the cache only speeds up reading unchanged files.
+	bool read_file_cached(LPCTSTR path, LPCTSTR cache_path)
 	{
-		XMLReader reader(this, in);
+		XMLFileStamp stamp;
 
-		return read(reader, system_id);
+		if (stamp.get(path) && read_snapshot(cache_path, stamp))
+			return true;
+
+		if (!read_file(path))
+			return false;
+
+		if (!stamp.empty())
+			write_snapshot(cache_path, stamp);
+
+		return true;
 	}
-#endif // XS_USE_XERCES
 
 	bool read(XMLReaderBase& reader, const std::string& display_path)
 	{
 #ifdef XS_NATIVE
 		reader.setSystemId(display_path.c_str());
-#elif defiend(XMLNODE_LOCATION)
+#elif defined(XMLNODE_LOCATION)
 		 // make a string copy to handle temporary string objects
 		_display_path = display_path;
 		reader._display_path = _display_path.c_str();
 #endif
 
+		release_unused();
+
 		reader.clear_errors();
+		reader._atoms = _atoms.get();
+		reader._arena = &_doc_arena;
+		reader._use_arena = _use_arena;
+
 		reader.read();
 
 		_format = reader.get_format();
@@ -2943,9 +5110,11 @@ struct XMLDoc : public XMLNode
 	{
 		_format.print_header(out, mode!=FORMAT_PLAIN);
 
-		if (_children.size() == 1)
-			_children.front()->write(out, _format, mode);
-		else if (!_children.empty()) {
+		const Children& children = get_children();
+
+		if (children.size() == 1)
+			children.front()->write(out, _format, mode);
+		else if (!children.empty()) {
 			//throw Exception("more than one XML root!");
 			return false;
 		}
@@ -2953,6 +5122,21 @@ struct XMLDoc : public XMLNode
 		return out.good();
 	}
 
+	 /// write XML stream reusing the unchanged subtrees of the previous write through 'cache'
+	bool write(std::ostream& out, XMLWriteCache& cache, WRITE_MODE mode=FORMAT_SMART) const
+	{
+		_format.print_header(out, mode!=FORMAT_PLAIN);
+
+		const Children& children = get_children();
+
+		if (children.size() == 1)
+			cache.write(out, *children.front(), _format, mode);
+		else if (!children.empty())
+			return false;
+
+		return out.good();
+	}
+
 	 /// write XML stream with formating
 	bool write_formating(std::ostream& out) const
 	{
@@ -2979,9 +5163,294 @@ struct XMLDoc : public XMLNode
 #ifdef XMLNODE_LOCATION
 	std::string		_display_path;
 #endif
+
+protected:
+	XMLMappingList	_mappings;
+	XMLAtomTableRef	_atoms;
+	XMLArena		_doc_arena;	// the root node refers to it as _arena
+	bool			_use_arena;
+
+	 /// release the arena and the mappings of previous reads if there are no nodes left referring to them
+	void release_unused()
+	{
+		if (static_cast<const XMLNode*>(this)->get_children().empty()) {
+			_doc_arena.release();
+			_mappings.release();
+		}
+	}
+};
+
+
+#ifdef XS_NATIVE
+
+ /// character range borrowed from the input of XMLSaxParser, valid as long as the input buffer
+struct XMLSlice
+{
+	XMLSlice() : _str(NULL), _len(0) {}
+	XMLSlice(const char* s, size_t l) : _str(s), _len(l) {}
+
+	bool	empty() const {return !_len;}
+
+	bool operator==(const char* s) const
+	{
+		size_t l = strlen(s);
+
+		return l==_len && !memcmp(_str, s, l);
+	}
+
+	bool operator!=(const char* s) const {return !operator==(s);}
+
+	 /// UTF-8 and still entity encoded
+	std::string str() const {return std::string(_str, _len);}
+
+	XS_String decode() const {return DecodeXMLString(str());}
+
+	const char*	_str;
+	size_t		_len;
+};
+
+ /// attribute of a start tag, the value excludes the quotes
+struct XMLSaxAttribute
+{
+	XMLSlice	_name;
+	XMLSlice	_value;
+};
+
+ /// attributes of a start tag, reused for all elements of a document
+struct XMLSaxAttributes : public std::vector<XMLSaxAttribute>
+{
+	 /// return the raw attribute value or NULL if not present
+	const XMLSlice* find(const char* name) const
+	{
+		for(const_iterator it=begin(); it!=end(); ++it)
+			if (it->_name == name)
+				return &it->_value;
+
+		return NULL;
+	}
+
+	XS_String get(const char* name, LPCXSSTR def=XS_EMPTY_STR) const
+	{
+		const XMLSlice* value = find(name);
+
+		return value? value->decode(): XS_String(def);
+	}
+};
+
+ /// empty default event handlers for XMLSaxParser
+ // Derived handlers hide the functions they are interested in, there are no virtual calls.
+struct XMLSaxHandler
+{
+	void	StartElementHandler(const XMLSlice&, const XMLSaxAttributes&) {}
+	void	EndElementHandler(const XMLSlice&) {}
+	void	TextHandler(const XMLSlice&) {}		// character data between tags, entity encoded
+	void	CDataHandler(const XMLSlice&) {}	// content of a CDATA section
+	void	CommentHandler(const XMLSlice&) {}
+};
+
+ /// tree-free SAX parser of the XS_NATIVE implementation
+ // The events are passed to HANDLER by direct calls with slices borrowed from the input buffer,
+ // so data can be aggregated without allocating XMLNode objects or strings.
+ // Markup boundaries and attributes are scanned by the helpers of the native parser,
+ // find_markup_end() and scan_xml_attribute(), so both split the input the same way.
+ // XML declaration, processing instructions and DOCTYPE are skipped.
+template<typename HANDLER> struct XMLSaxParser
+{
+	XMLSaxParser(HANDLER& handler)
+	 :	_handler(handler),
+		_error(NULL)
+	{
+	}
+
+	 /// parse the document in [p, end), return false on truncated or malformed markup
+	bool parse(const char* p, const char* end)
+	{
+		_error = NULL;
+
+		if (end-p>=3 && !memcmp(p, "\xEF\xBB\xBF", 3))	// UTF-8 byte order mark
+			p += 3;
+
+		while(p < end) {
+			if (*p != '<') {
+				const char* q = find_xml_char(p, end, '<');
+
+				_handler.TextHandler(XMLSlice(p, q-p));
+				p = q;
+				continue;
+			}
+
+			const char* s = p + 1;
+			const char* q;
+
+			if (s == end)
+				return fail(p);
+
+			if (*s == '/') {
+				q = find_xml_char(s, end, '>');
+
+				if (q == end)
+					return fail(p);
+
+				const char* e = q;
+				while(e>s+1 && is_space(e[-1]))
+					--e;
+
+				_handler.EndElementHandler(XMLSlice(s+1, e-s-1));
+				p = q + 1;
+			} else if (*s == '!') {
+				if (end-s>=3 && s[1]=='-' && s[2]=='-') {
+					q = find_markup_end(s, end);
+
+					if (q==end || q-s<5)
+						return fail(p);
+
+					_handler.CommentHandler(XMLSlice(s+3, q-s-5));
+					p = q + 1;
+				} else if (end-s>=8 && !memcmp(s, "![CDATA[", 8)) {
+					q = find_markup_end(s, end);
+
+					if (q == end)
+						return fail(p);
+
+					_handler.CDataHandler(XMLSlice(s+8, q-s-10));
+					p = q + 1;
+				} else {
+					 // DOCTYPE including an internal subset in brackets
+					q = find_xml_char(s, end, '>');
+
+					const char* b = find_xml_char(s, q, '[');
+
+					if (b != q) {
+						q = find_xml_char(b, end, ']');
+						q = find_xml_char(q, end, '>');
+					}
+
+					if (q == end)
+						return fail(p);
+
+					p = q + 1;
+				}
+			} else if (*s == '?') {
+				q = find_str(s+1, end, "?>", 2);
+
+				if (q == end)
+					return fail(p);
+
+				p = q + 2;
+			} else {
+				q = parse_start_tag(s, end);
+
+				if (!q)
+					return fail(p);
+
+				p = q;
+			}
+		}
+
+		return true;
+	}
+
+	bool parse(const std::string& buffer)
+	{
+		return parse(buffer.data(), buffer.data()+buffer.length());
+	}
+
+	 /// parse a file through a read-only memory mapping
+	bool parse_file(LPCTSTR path)
+	{
+		XMLFileMapping mapping;
+
+		if (!mapping.open(path))
+			return false;
+
+		return parse(mapping.data(), mapping.data()+mapping.length());
+	}
+
+	 /// start of the malformed markup after parse() failed
+	const char* get_error_pos() const {return _error;}
+
+protected:
+	HANDLER&	_handler;
+	XMLSaxAttributes _attributes;
+	const char*	_error;
+
+	bool fail(const char* p)
+	{
+		_error = p;
+
+		return false;
+	}
+
+	static bool is_space(char c) {return c==' ' || c=='\t' || c=='\n' || c=='\r';}
+
+	 /// find str of length len in [p, end), scanning for its last character
+	static const char* find_str(const char* p, const char* end, const char* str, size_t len)
+	{
+		if ((size_t)(end-p) < len)
+			return end;
+
+		for(p+=len-1; p<end; ++p) {
+			p = find_xml_char(p, end, str[len-1]);
+
+			if (p == end)
+				break;
+
+			if (!memcmp(p-len+1, str, len))
+				return p-len+1;
+		}
+
+		return end;
+	}
+
+	 /// parse name and attributes of a start tag beginning at p, return the position after the tag or NULL on error
+	const char* parse_start_tag(const char* p, const char* end)
+	{
+		const char* name = p;
+
+		while(p<end && !is_space(*p) && *p!='>' && *p!='/')
+			++p;
+
+		XMLSlice tag(name, p-name);
+
+		if (tag.empty())
+			return NULL;
+
+		_attributes.clear();
+
+		XMLAttrToken token;
+		const char* error;
+
+		while(scan_xml_attribute(p, end, token, error)) {
+			if (error || !token._name_len)
+				return NULL;
+
+			XMLSaxAttribute attr;
+
+			attr._name = XMLSlice(token._name, token._name_len);
+			attr._value = XMLSlice(token._value, token._value_len);
+			_attributes.push_back(attr);
+		}
+
+		if (error || p==end)
+			return NULL;
+
+		if (*p == '>') {
+			_handler.StartElementHandler(tag, _attributes);
+			return p + 1;
+		}
+
+		if (*p!='/' || ++p==end || *p!='>')
+			return NULL;
+
+		_handler.StartElementHandler(tag, _attributes);
+		_handler.EndElementHandler(tag);
+		return p + 1;
+	}
 };
 
 
+struct XMLStreamReader;
+
 struct XMLStateReader : public XMLReader
 {
 	enum XML_STATE {
@@ -2996,10 +5465,11 @@ struct XMLStateReader : public XMLReader
 	//	XSS_PROCESSING_INSTRUCTION
 	};
 
-	XMLStateReader(XMLNode* node, std::istream& in)
-	 :	XMLReader(node, in),
+	XMLStateReader(XMLNode* node, std::istream& in, bool block_read=false)
+	 :	XMLReader(node, in, block_read),
 		_parse_ctx(*this),
-		_state(XSS_NONE)
+		_state(XSS_NONE),
+		_stream(NULL)
 	{
 	}
 
@@ -3010,12 +5480,16 @@ struct XMLStateReader : public XMLReader
 	virtual void StartElementHandler(const XS_String& name, const XMLNode::AttributeMap& attr);
 	virtual void EndElementHandler();
 	virtual void DefaultHandler(const std::string& s);
+	virtual bool SkipElementHandler(const XS_String& name);
+	virtual bool SkipTextHandler();
 
 	ParseContext	_parse_ctx;
 
 	enum XML_STATE	_state;
 	XS_String		_node_name;
 	XMLNode::AttributeMap _attrs;
+
+	XMLStreamReader* _stream;	// decides about skipping elements while searching
 };
 
 
@@ -3027,16 +5501,21 @@ struct XMLStreamReader
 	 :	_pInFile(NULL),
 		_state_rdr(NULL, in),
 		_level(0),
-		_node(XS_EMPTY_STR)
+		_node(XS_EMPTY_STR),
+		_skip(false)
 	{
+		_state_rdr._stream = this;
 	}
 
 	XMLStreamReader(LPCTSTR path)
 	 :	_pInFile(new tifstream(path)),
-		_state_rdr(NULL, *_pInFile),
+		_state_rdr(NULL, *_pInFile, true),
 		_level(0),
-		_node(XS_EMPTY_STR)
+		_node(XS_EMPTY_STR),
+		_skip(false)
 	{
+		_state_rdr._stream = this;
+
 #ifdef UNICODE
 		_state_rdr._parse_ctx._reader.setSystemId(std::string(XS_String(path)).c_str());
 #else
@@ -3195,6 +5674,16 @@ protected:
 
 	XMLNode	_node;
 
+	 // parameters of the running find_node() call to skip elements not containing the target node
+	bool	_skip;
+	LPCXSSTR _skip_tag;
+	int		_skip_level;
+	bool	_skip_stop_on_others;
+
+	bool	skip_element(const XS_String& name) const;
+
+	friend struct XMLStateReader;
+
 //protected:	XS_String	_instructions;
 
 	virtual void StartElementHandler(const XS_String& name, const XMLNode::AttributeMap& attr);
@@ -3410,6 +5899,8 @@ protected:
 	const_iterator	_end;
 };
 
+#endif // XS_NATIVE
+
 
  /// type converter for boolean data
 struct XMLBool
@@ -3431,10 +5922,10 @@ struct XMLBool
 
 	XMLBool(const XMLNode* node, const XS_String& attr_name, bool def=false)
 	{
-		const XS_String& value = node->get(attr_name);
+		const XS_SMNode* entry = node->get_entry(attr_name);
 
-		if (!value.empty())
-			_value = !XS_icmp(value.c_str(), XS_TRUE);
+		if (entry && !entry->second.empty())
+			_value = entry->get_bool();
 		else
 			_value = def;
 	}
@@ -3465,20 +5956,20 @@ private:
 struct XMLBoolRef
 {
 	XMLBoolRef(XMLNode* node, const XS_String& attr_name, bool def=false)
-	 :	_ref((*node)[attr_name])
+	 :	_entry(node->entry(attr_name))
 	{
-		if (_ref.empty())
+		if (_entry.second.empty())
 			assign(def);
 	}
 
 	operator bool() const
 	{
-		return !XS_icmp(_ref.c_str(), XS_TRUE);
+		return _entry.get_bool();
 	}
 
 	bool operator!() const
 	{
-		return XS_icmp(_ref.c_str(), XS_TRUE)? true: false;
+		return !_entry.get_bool();
 	}
 
 	XMLBoolRef& operator=(bool value)
@@ -3490,7 +5981,8 @@ struct XMLBoolRef
 
 	void assign(bool value)
 	{
-		_ref.assign(value? XS_TRUE: XS_FALSE);
+		_entry.second.assign(value? XS_TRUE: XS_FALSE);
+		_entry.invalidate();
 	}
 
 	void toggle()
@@ -3499,7 +5991,7 @@ struct XMLBoolRef
 	}
 
 protected:
-	XS_String& _ref;
+	XS_SMNode& _entry;
 };
 
 
@@ -3528,10 +6020,10 @@ struct XMLInt
 
 	XMLInt(const XMLNode* node, const XS_String& attr_name, int def=0)
 	{
-		const XS_String& value = node->get(attr_name);
+		const XS_SMNode* entry = node->get_entry(attr_name);
 
-		if (!value.empty())
-			_value = XS_toi(value.c_str());
+		if (entry && !entry->second.empty())
+			_value = entry->get_int();
 		else
 			_value = def;
 	}
@@ -3559,9 +6051,9 @@ private:
 struct XMLIntRef
 {
 	XMLIntRef(XMLNode* node, const XS_String& attr_name, int def=0)
-	 :	_ref((*node)[attr_name])
+	 :	_entry(node->entry(attr_name))
 	{
-		if (_ref.empty())
+		if (_entry.second.empty())
 			assign(def);
 	}
 
@@ -3574,18 +6066,19 @@ struct XMLIntRef
 
 	operator int() const
 	{
-		return XS_toi(_ref.c_str());
+		return _entry.get_int();
 	}
 
 	void assign(int value)
 	{
 		XS_CHAR buffer[32];
 		XS_snprintf(buffer, COUNTOF(buffer), XS_INTFMT, value);
-		_ref.assign(buffer);
+		_entry.second.assign(buffer);
+		_entry.invalidate();
 	}
 
 protected:
-	XS_String& _ref;
+	XS_SMNode& _entry;
 };
 
 
@@ -3614,10 +6107,10 @@ struct XMLInt64
 
 	XMLInt64(const XMLNode* node, const XS_String& attr_name, INT64 def=0)
 	{
-		const XS_String& value = node->get(attr_name);
+		const XS_SMNode* entry = node->get_entry(attr_name);
 
-		if (!value.empty())
-			_value = XS_toi64(value.c_str());
+		if (entry && !entry->second.empty())
+			_value = entry->get_int64();
 		else
 			_value = def;
 	}
@@ -3645,9 +6138,9 @@ private:
 struct XMLInt64Ref
 {
 	XMLInt64Ref(XMLNode* node, const XS_String& attr_name, INT64 def=0)
-	 :	_ref((*node)[attr_name])
+	 :	_entry(node->entry(attr_name))
 	{
-		if (_ref.empty())
+		if (_entry.second.empty())
 			assign(def);
 	}
 
@@ -3660,18 +6153,19 @@ struct XMLInt64Ref
 
 	operator INT64() const
 	{
-		return XS_toi64(_ref.c_str());
+		return _entry.get_int64();
 	}
 
 	void assign(INT64 value)
 	{
 		XS_CHAR buffer[64];
 		XS_snprintf(buffer, COUNTOF(buffer), XS_INT64FMT, value);
-		_ref.assign(buffer);
+		_entry.second.assign(buffer);
+		_entry.invalidate();
 	}
 
 protected:
-	XS_String& _ref;
+	XS_SMNode& _entry;
 };
 
 
@@ -3696,11 +6190,10 @@ struct XMLDouble
 
 	XMLDouble(const XMLNode* node, const XS_String& attr_name, double def=0.)
 	{
-		LPTSTR end;
-		const XS_String& value = node->get(attr_name);
+		const XS_SMNode* entry = node->get_entry(attr_name);
 
-		if (!value.empty())
-			_value = XS_tod(value.c_str(), &end);
+		if (entry && !entry->second.empty())
+			_value = entry->get_double();
 		else
 			_value = def;
 	}
@@ -3728,9 +6221,9 @@ private:
 struct XMLDoubleRef
 {
 	XMLDoubleRef(XMLNode* node, const XS_String& attr_name, double def=0.)
-	 :	_ref((*node)[attr_name])
+	 :	_entry(node->entry(attr_name))
 	{
-		if (_ref.empty())
+		if (_entry.second.empty())
 			assign(def);
 	}
 
@@ -3743,19 +6236,19 @@ struct XMLDoubleRef
 
 	operator double() const
 	{
-		LPTSTR end;
-		return XS_tod(_ref.c_str(), &end);
+		return _entry.get_double();
 	}
 
 	void assign(double value)
 	{
 		XS_CHAR buffer[32];
 		XS_snprintf(buffer, COUNTOF(buffer), XS_FLOATFMT, value);
-		_ref.assign(buffer);
+		_entry.second.assign(buffer);
+		_entry.invalidate();
 	}
 
 protected:
-	XS_String& _ref;
+	XS_SMNode& _entry;
 };
 
 
@@ -3806,16 +6299,16 @@ private:
 struct XMLStringRef
 {
 	XMLStringRef(XMLNode* node, const XS_String& attr_name, LPCXSSTR def=XS_EMPTY)
-	 :	_ref((*node)[attr_name])
+	 :	_entry(node->entry(attr_name))
 	{
-		if (_ref.empty())
+		if (_entry.second.empty())
 			assign(def);
 	}
 
 	XMLStringRef(const XS_String& node_name, XMLNode* node, const XS_String& attr_name, LPCXSSTR def=XS_EMPTY)
-	 :	_ref(node->subvalue(node_name, attr_name))
+	 :	_entry(node->subentry(node_name, attr_name))
 	{
-		if (_ref.empty())
+		if (_entry.second.empty())
 			assign(def);
 	}
 
@@ -3828,16 +6321,17 @@ struct XMLStringRef
 
 	operator const XS_String&() const
 	{
-		return _ref;
+		return _entry.second;
 	}
 
 	void assign(const XS_String& value)
 	{
-		_ref.assign(value);
+		_entry.second.assign(value);
+		_entry.invalidate();
 	}
 
 protected:
-	XS_String& _ref;
+	XS_SMNode& _entry;
 };
 
 
@@ -4030,6 +6524,7 @@ struct XMLMessageFromString : public XMLMessage
 {
 	XMLMessageFromString(const std::string& xml_str, const std::string& system_id=std::string())
 	{
+		use_arena();
 		read_buffer(xml_str.c_str(), xml_str.length(), system_id);
 	}
 };
@@ -4041,6 +6536,7 @@ struct XMLMessageReader : public XMLPos
 	XMLMessageReader(const std::string& xml_str, const std::string& system_id=std::string())
 	 :	XMLPos(&_msg)
 	{
+		_msg.use_arena();
 		_msg.read_buffer(xml_str.c_str(), xml_str.length(), system_id);
 	}
 
@@ -4179,6 +6675,151 @@ protected:
 };
 
 
+#ifndef XS_WRITE_BUFFER_SIZE
+#define XS_WRITE_BUFFER_SIZE 65536
+#endif
+
+ /// output buffer of XMLStreamWriter, flushed in big chunks to a stream or file descriptor
+struct XMLWriteBuffer
+{
+	XMLWriteBuffer(std::ostream& out, size_t size=XS_WRITE_BUFFER_SIZE);
+	XMLWriteBuffer(int fd, size_t size=XS_WRITE_BUFFER_SIZE);
+	~XMLWriteBuffer();
+
+	void append(char c)
+	{
+		if (_ptr == _end)
+			flush();
+
+		*_ptr++ = c;
+	}
+
+	void append(const char* s, size_t l)
+	{
+		if (l <= (size_t)(_end-_ptr)) {
+			memcpy(_ptr, s, l);
+			_ptr += l;
+		} else
+			append_long(s, l);
+	}
+
+	void append(const char* s) {append(s, strlen(s));}
+	void append(const std::string& s) {append(s.data(), s.length());}
+
+	void operator+=(char c) {append(c);}
+
+	 /// write the buffered output
+	bool flush();
+
+	bool good() const {return _good;}
+
+protected:
+	char*	_buffer;
+	char*	_ptr;
+	char*	_end;
+
+	std::ostream* _out;
+	int		_fd;
+	bool	_good;
+
+	void	append_long(const char* s, size_t l);
+	bool	write_out(const char* p, size_t l);
+
+private:
+	XMLWriteBuffer(const XMLWriteBuffer&);
+	XMLWriteBuffer& operator=(const XMLWriteBuffer&);
+};
+
+ /// streaming XML writer encoding tags, attributes and content directly into a reusable output buffer
+ // In contrast to XMLWriter no attribute maps or content strings are stored per element:
+ // put() must be called before content or child nodes of the current element,
+ // and set_content() writes the content immediately.
+struct XMLStreamWriter
+{
+	XMLStreamWriter(std::ostream& out, const XMLFormat& format=XMLFormat())
+	 :	_buffer(out),
+		_format(format)
+	{
+		write_header();
+	}
+
+	XMLStreamWriter(int fd, const XMLFormat& format=XMLFormat())
+	 :	_buffer(fd),
+		_format(format)
+	{
+		write_header();
+	}
+
+	~XMLStreamWriter()
+	{
+		_buffer.append(_format._endl);
+		_buffer.flush();
+	}
+
+	bool good() const
+	{
+		return _buffer.good();
+	}
+
+	bool flush()
+	{
+		return _buffer.flush();
+	}
+
+	 /// create node and move to it
+	void create(const XS_String& name);
+
+	 /// close the current node and go back to its parent
+	bool back();
+
+	 /// write an attribute of the current node
+	void put(const XS_String& attr_name, const XS_String& value);
+
+	void set_attributes(const XMLNode::AttributeMap& attrs)
+	{
+		for(XMLNode::AttributeMap::const_iterator it=attrs.begin(); it!=attrs.end(); ++it)
+			put(it->first, it->second);
+	}
+
+	 /// write element node content
+	void set_content(const XS_String& s, bool cdata=false);
+
+	 /// write element node content from encoded string
+	void set_encoded_content(const std::string& s);
+
+	 /// create node with string content
+	void create_node_content(const XS_String& node_name, const XS_String& content)
+	{
+		create(node_name);
+			set_content(content);
+		back();
+	}
+
+	 /// direct string output
+	void write(const std::string& s);
+
+protected:
+	XMLWriteBuffer	_buffer;
+	XMLFormat		_format;
+
+	 /// state of an open element, the encoded name is stored in _names
+	struct StackEntry {
+		size_t	_name_pos;
+		bool	_closed;		// '>' of the start tag written
+		bool	_children;
+		bool	_content;
+	};
+
+	std::vector<StackEntry> _stack;
+	std::string		_names;	// encoded names of all open elements
+
+	void	write_header();
+	void	write_indent(size_t level);
+	void	write_encoded(const XS_String& s);
+	void	close_pre();
+};
+
+
 }	// namespace XMLStorage
 
 #ifdef _MSC_VER
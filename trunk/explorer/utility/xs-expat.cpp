@@ -0,0 +1,217 @@
+
+ //
+ // XML storage C++ classes version 1.5
+ //
+ // Copyright (c) 2006, 2007, 2008, 2009, 2010, 2011, 2012 Martin Fuchs <martin-fuchs@gmx.net>
+ //
+
+ /// \file xs-expat.cpp
+ /// XMLStorage reader based on the Expat parser
+
+
+/*
+
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  * Redistributions of source code must retain the above copyright
+	notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+	notice, this list of conditions and the following disclaimer in
+	the documentation and/or other materials provided with the
+	distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef XS_NO_COMMENT
+#define XS_NO_COMMENT	// no #pragma comment(lib, ...) statements in .lib files to enable static linking
+#endif
+
+#include "xmlstorage.h"
+
+
+#ifdef XS_USE_EXPAT
+
+namespace XMLStorage {
+
+
+XMLReaderBase::XMLReaderBase(XMLNode* node)
+ :	_chunk_size(XS_EXPAT_CHUNK_SIZE),
+	_pos(node),
+	_endl_defined(false)
+{
+	_parser = XML_ParserCreate(NULL);
+
+	XML_SetUserData(_parser, this);
+	XML_SetXmlDeclHandler(_parser, XML_XmlDeclHandler);
+	XML_SetElementHandler(_parser, XML_StartElementHandler, XML_EndElementHandler);
+	XML_SetDefaultHandler(_parser, XML_DefaultHandler);	// unexpanded content, comments and white space
+
+	_last_tag = TAG_NONE;
+	_atoms = NULL;
+	_arena = NULL;
+	_use_arena = false;
+}
+
+XMLReaderBase::~XMLReaderBase()
+{
+	XML_ParserFree(_parser);
+}
+
+
+ /// read XML stream into XML tree below _pos
+ // Stream input is read directly into the parser buffer, in-memory input is passed without copying it first.
+void XMLReaderBase::read()
+{
+	XML_Status status = XML_STATUS_OK;
+	const char* begin;
+	const char* end;
+
+	if (get_mapped_input(begin, end)) {
+		 // pass big input in chunks to keep the length parameter of XML_Parse() in range
+		for(;;) {
+			size_t l = end - begin;
+
+			if (l > (size_t)_chunk_size)
+				l = _chunk_size;
+
+			status = XML_Parse(_parser, begin, (int)l, begin+l==end);
+			begin += l;
+
+			if (status!=XML_STATUS_OK || begin==end)
+				break;
+		}
+	} else {
+		for(;;) {
+			void* buffer = XML_GetBuffer(_parser, _chunk_size);
+
+			if (!buffer) {
+				status = XML_STATUS_ERROR;
+				break;
+			}
+
+			int l = read_buffer((char*)buffer, _chunk_size);
+
+			if (l < 0)
+				l = 0;
+
+			status = XML_ParseBuffer(_parser, l, !l);
+
+			if (status!=XML_STATUS_OK || !l)
+				break;
+		}
+	}
+
+	if (status == XML_STATUS_ERROR) {
+		XMLError error(get_expat_error_string(XML_GetErrorCode(_parser)).c_str());
+
+		error._line = (int)XML_GetCurrentLineNumber(_parser);
+		error._column = (int)XML_GetCurrentColumnNumber(_parser);
+		error._error_code = XML_GetErrorCode(_parser);
+
+		_errors.push_back(error);
+	}
+
+	finish_read();
+}
+
+std::string XMLReaderBase::get_position() const
+{
+	std::ostringstream out;
+
+	out << "(" << XML_GetCurrentLineNumber(_parser) << ") [column " << XML_GetCurrentColumnNumber(_parser) << "] :";
+
+	return out.str();
+}
+
+#ifdef XMLNODE_LOCATION
+XMLLocation XMLReaderBase::get_location() const
+{
+	return XMLLocation(_display_path, (int)XML_GetCurrentLineNumber(_parser), (int)XML_GetCurrentColumnNumber(_parser));
+}
+#endif
+
+std::string XMLReaderBase::get_expat_error_string(XML_Error error_code)
+{
+	const XML_LChar* msg = XML_ErrorString(error_code);
+	std::string str;
+
+	 // Expat error messages are ASCII, also in XML_UNICODE_WCHAR_T builds
+	if (msg)
+		for(; *msg; ++msg)
+			str += (char)*msg;
+	else
+		str = "XML parsing error";
+
+	return str;
+}
+
+
+void XMLCALL XMLReaderBase::XML_XmlDeclHandler(void* userData, const XML_Char* version, const XML_Char* encoding, int standalone)
+{
+	XMLReaderBase* pReader = (XMLReaderBase*) userData;
+
+#if defined(XML_UNICODE)
+	std::string version_str, encoding_str;
+
+	if (version)
+		version_str = std::string(String_from_XML_Char(version));
+
+	if (encoding)
+		encoding_str = std::string(String_from_XML_Char(encoding));
+
+	pReader->XmlDeclHandler(version? version_str.c_str(): NULL, encoding? encoding_str.c_str(): NULL, standalone);
+#else
+	pReader->XmlDeclHandler(version, encoding, standalone);
+#endif
+}
+
+void XMLCALL XMLReaderBase::XML_StartElementHandler(void* userData, const XML_Char* name, const XML_Char** atts)
+{
+	XMLReaderBase* pReader = (XMLReaderBase*) userData;
+
+	XMLNode::AttributeMap attributes;
+
+	 // Expat passes name/value pairs with already decoded entity references
+	while(*atts) {
+		const XML_Char* attr_name = *atts++;
+		const XML_Char* attr_value = *atts++;
+
+		attributes[String_from_XML_Char(attr_name)] = String_from_XML_Char(attr_value);
+	}
+
+	pReader->StartElementHandler(String_from_XML_Char(name), attributes);
+}
+
+void XMLCALL XMLReaderBase::XML_EndElementHandler(void* userData, const XML_Char* name)
+{
+	XMLReaderBase* pReader = (XMLReaderBase*) userData;
+
+	pReader->EndElementHandler();
+}
+
+void XMLCALL XMLReaderBase::XML_DefaultHandler(void* userData, const XML_Char* s, int len)
+{
+	XMLReaderBase* pReader = (XMLReaderBase*) userData;
+
+	pReader->DefaultHandler(s, len);
+}
+
+
+}	// namespace XMLStorage
+
+#endif // XS_USE_EXPAT
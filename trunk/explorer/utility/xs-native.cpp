@@ -43,6 +43,11 @@
 
 #include "xmlstorage.h"
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 
 #if !defined(XS_USE_EXPAT) && !defined(XS_USE_XERCES)
 
@@ -104,6 +109,23 @@ void ReadBuffer::append(int c)
 	*_wptr++ = static_cast<char>(c);
 }
 
+void ReadBuffer::append(const char* s, size_t l)
+{
+	size_t wpos = _wptr-_buffer;
+
+	if (wpos+l > _len) {
+		do
+			_len <<= 1;
+		while(wpos+l > _len);
+
+		_buffer = (char*) realloc(_buffer, _len);
+		_wptr = _buffer + wpos;
+	}
+
+	memcpy(_wptr, s, l);
+	_wptr += l;
+}
+
 const std::string& ReadBuffer::str(bool utf8)	// returns UTF-8 encoded buffer content
 {
 #if defined(_WIN32) && !defined(XS_STRING_UTF8)
@@ -155,8 +177,8 @@ XS_String ReadBuffer::get_tag() const
 #endif
 }
 
- /// read attributes and values
-void ReadBuffer::get_attributes(XMLNode::AttributeMap& attributes) const
+ /// return the position behind the tag name
+const char* ReadBuffer::get_attributes_start() const
 {
 	const char* p = _buffer_str.c_str();
 
@@ -169,82 +191,325 @@ void ReadBuffer::get_attributes(XMLNode::AttributeMap& attributes) const
 	else if (*p == '?')
 		++p;
 
-	p = get_xmlsym_end_utf8(p);
+	return get_xmlsym_end_utf8(p);
+}
+
+ /// read attributes and values
+void ReadBuffer::get_attributes(XMLNode::AttributeMap& attributes) const
+{
+	const char* p = get_attributes_start();
+	const char* end = _buffer_str.c_str() + _buffer_str.length();
+	XMLAttrToken attr;
+	const char* error;
 
 	 // read attributes from buffer
-	while(*p && *p!='>' && *p!='/') {
-		while(isspace((unsigned char)*p))
-			++p;
+	while(scan_xml_attribute(p, end, attr, error)) {
+#ifdef XS_STRING_UTF8
+		XS_String name_str(attr._name, attr._name_len);
+#else
+		XS_String name_str;
+		assign_utf8(name_str, attr._name, attr._name_len);
+#endif
 
-		if (*p=='?' || *p=='/')
-			break;
+		attributes[name_str] = DecodeXMLString(std::string(attr._value, attr._value_len));
+
+		if (error)
+			_errors.push_back(XMLError(_location, error));
+	}
 
-		const char* attr_name = p;
+	if (error)
+		_errors.push_back(XMLError(_location, error));
+}
 
-		p = get_xmlsym_end_utf8(p);
+ /// store the undecoded attributes for decoding on first access
+ // 'mapped' is the position of the tag in memory mapped input or NULL.
+ // The text isn't scanned here, so decoding stops silently at malformed attributes.
+void ReadBuffer::get_lazy_attributes(XMLNode::AttributeMap& attributes, const char* mapped) const
+{
+	const char* s = _buffer_str.c_str();
+	const char* begin = get_attributes_start();
+	const char* end = s + _buffer_str.length();
+	const char* p = begin;
 
-		if (*p != '=') {
-			_errors.push_back(XMLError(_location, "missing attribute assignment"));
-			break;
+	while(p<end && isspace((unsigned char)*p))
+		++p;
+
+	if (p==end || *p=='>' || *p=='/' || *p=='?')
+		return;	// no attributes
+
+	if (mapped)
+		attributes.set_raw_ref(mapped+(begin-s), end-begin);
+	else
+		attributes.set_raw(begin, end-begin);
+}
+
+
+ParseContext::ParseContext(XMLReaderBase& reader)
+ :	_reader(reader),
+	_buffer(reader._errors, reader._location),
+	_utf8(reader._utf8)
+{
+	const char* begin;
+	const char* end;
+
+	_mapped = reader.get_mapped_input(begin, end);
+
+	if (_mapped) {
+		 // parse directly from the memory mapped input
+		_window = NULL;
+		_rptr = begin;
+		_rend = end;
+	} else {
+		_window = (char*) malloc(READ_BLOCK_LEN);
+		_rptr = _rend = _window;
+	}
+
+	_block_read = true;
+
+	_next = get();
+	_in_comment = false;
+
+	 // check for UTF-8 signature
+	read_bom();
+}
+
+ParseContext::~ParseContext()
+{
+	_reader._utf8 = _utf8;
+
+	free(_window);
+}
+
+ /// refill the input window, return false if there is no more buffered input
+bool ParseContext::fill_window()
+{
+	if (!_block_read || _mapped)
+		return false;
+
+	int l = _reader.read_block(_window, READ_BLOCK_LEN);
+
+	if (l < 0) {
+		 // fall back to reading character by character
+		_block_read = false;
+		return false;
+	}
+
+	_rptr = _window;
+	_rend = _window + l;
+
+	return l > 0;
+}
+
+ /// read into _buffer up to and including the delimiter, return false at end of input
+bool ParseContext::read_until(int delim)
+{
+	for(;;) {
+		if (_rptr==_rend && !fill_window()) {
+			if (_block_read)
+				return false;
+
+			for(;;) {
+				int c = _reader.get();
+
+				if (c == EOF)
+					return false;
+
+				_buffer.append(c);
+
+				if (c == delim)
+					return true;
+			}
 		}
 
-		size_t attr_len = p - attr_name;
+		const char* p = find_xml_char(_rptr, _rend, static_cast<char>(delim));
+		const char* end = p<_rend? p+1: _rend;
+		size_t l = end - _rptr;
 
-		if (*++p!='"' && *p!='\'') {
-			_errors.push_back(XMLError(_location, "missing attribute value quote"));
-			break;
+		_buffer.append(_rptr, l);
+		_reader.count_location(_rptr, l);
+		_rptr = end;
+
+		if (p < end)
+			return true;
+	}
+}
+
+ /// read text content into _buffer up to the next '<', return that character or EOF
+int ParseContext::read_text(bool copy)
+{
+	for(;;) {
+		if (_rptr==_rend && !fill_window()) {
+			if (_block_read)
+				return EOF;
+
+			for(;;) {
+				int c = _reader.get();
+
+				if (c==EOF || c=='<')
+					return c;
+
+				char ch = static_cast<char>(c);
+				check_endl(&ch, 1);
+
+				_buffer.append(c);
+			}
 		}
 
-		char delim = *p;
-		const char* value = ++p;
+		const char* p = find_xml_char(_rptr, _rend, '<');
+		size_t l = p - _rptr;
 
-		while(*p && *p!=delim)
-			++p;
+		check_endl(_rptr, l);
 
-		size_t value_len = p - value;
+		if (copy)
+			_buffer.append(_rptr, l);
 
-		if (*p)
-			++p;	// '"' oder '\''
-		else
-			_errors.push_back(XMLError(_location, "unterminated attribute quote"));
+		_reader.count_location(_rptr, l);
+		_rptr = p;
 
-#ifdef XS_STRING_UTF8
-		XS_String name_str(attr_name, attr_len);
-#else
-		XS_String name_str;
-		assign_utf8(name_str, attr_name, attr_len);
-#endif
+		if (p < _rend) {
+			++_rptr;
+			_reader.count_location('<');
+			return '<';
+		}
+	}
+}
+
+ /// skip input up to and including the delimiter, return false at end of input
+bool ParseContext::skip_until(int delim)
+{
+	for(;;) {
+		if (_rptr==_rend && !fill_window()) {
+			if (_block_read)
+				return false;
+
+			for(;;) {
+				int c = _reader.get();
 
-		attributes[name_str] = DecodeXMLString(std::string(value, value_len));
+				if (c == EOF)
+					return false;
+
+				if (c == delim)
+					return true;
+			}
+		}
+
+		const char* p = find_xml_char(_rptr, _rend, static_cast<char>(delim));
+		const char* end = p<_rend? p+1: _rend;
+
+		_reader.count_location(_rptr, end-_rptr);
+		_rptr = end;
+
+		if (p < end)
+			return true;
 	}
 }
 
+ /// skip input up to and including 'end_str' of at most three characters
+void ParseContext::skip_past(const char* end_str)
+{
+	size_t l = strlen(end_str);
+	char last[3] = {0, 0, 0};
 
-ParseContext::ParseContext(XMLReaderBase& reader)
- :	_reader(reader),
-	_buffer(reader._errors, reader._location),
-	_utf8(false)
+	assert(l <= sizeof(last));
+
+	for(;;) {
+		int c = get();
+
+		if (c == EOF)
+			break;
+
+		last[0] = last[1];
+		last[1] = last[2];
+		last[2] = static_cast<char>(c);
+
+		if (!memcmp(last+sizeof(last)-l, end_str, l))
+			break;
+	}
+}
+
+ /// skip the content and the end tag of the element whose start tag has just been read
+ // Only the tag nesting is tracked using the same tag boundaries as process_next(), nothing is decoded.
+void ParseContext::skip_element()
 {
-	_next = reader.get();
-	_in_comment = false;
+	int depth = 1;
 
-	 // check for UTF-8 signature
-	read_bom();
+	while(depth > 0) {
+		if (!skip_until('<'))
+			break;
+
+		int c = get();
+
+		if (c == '/') {
+			--depth;
+			skip_until('>');
+		} else if (c == '!') {
+			c = get();
+
+			if (c == '-')
+				skip_past("-->");
+			else if (c == '[')
+				skip_past("]]>");
+			else
+				skip_until('>');
+		} else if (c == '?')
+			skip_until('>');
+		else {
+			 // start tag, ending like in process_next() at the first closing bracket
+			int last = c;
+
+			for(; c!=EOF && c!='>'; c=get())
+				last = c;
+
+			if (last != '/')
+				++depth;
+		}
+	}
+}
+
+ /// check for the encoding of the first line end
+void ParseContext::check_endl(const char* s, size_t l)
+{
+	if (_reader._endl_defined)
+		return;
+
+	for(const char* end=s+l; s<end; ++s)
+		if (*s == '\n') {
+			_reader._format._endl = "\n";
+			_reader._endl_defined = true;
+			break;
+		} else if (*s == '\r') {
+			_reader._format._endl = "\r\n";
+			_reader._endl_defined = true;
+			break;
+		}
+}
+
+int ParseContext::eat_endl()
+{
+	int c = get();
+
+	if (c == '\r')
+		c = get();
+
+	if (c == '\n')
+		c = get();
+
+	return c;
 }
 
 void ParseContext::read_bom()
 {
 	if (_next == 0xEF) {
-		_next = _reader.get();
+		_next = get();
 
 		if (_next == 0xBB) {
-			_next = _reader.get();
+			_next = get();
 
 			if (_next == 0xBF) {
 				_utf8 = true;
 				_reader._format._utf8_bom = true;
 
-				_next = _reader.get();
+				_next = get();
 			}
 		}
 	}
@@ -258,8 +523,19 @@ bool ParseContext::proceed()
 	return _next != EOF;
 }
 
+ /// pass content to the reader, referencing mapped input if possible
+void ParseContext::content_handler(const char* start, size_t len)
+{
+	if (ref_input())
+		_reader.MappedDefaultHandler(start, len);
+	else
+		_reader.DefaultHandler(_buffer.str(_utf8));
+}
+
 int ParseContext::process_next(int c)
 {
+	const char* start = _mapped? _rptr-1: NULL;	// input position of c in mapped input
+
 	if (_in_comment || c=='<') {
 		if (!_buffer.empty())
 			_buffer.reset();
@@ -267,31 +543,21 @@ int ParseContext::process_next(int c)
 		_buffer.append(c);
 
 		 // read start or end tag
-		for(;;) {
-			c = _reader.get();
-
-			if (c == EOF)
-				break;
-
-			_buffer.append(c);
-
-			if (c == '>')
-				break;
-		}
+		read_until('>');
 
 		const std::string& b = _buffer.str(_utf8);
 		const char* str = b.c_str();
 
 		if (_in_comment || !strncmp(str+1, "!--", 3)) {
 			 // XML comment
-			_reader.DefaultHandler(b);
+			content_handler(start, _buffer.len());
 
 			if (strcmp(str+b.length()-3, "-->"))
 				_in_comment = true;
 			else
 				_in_comment = false;
 
-			c = _reader.get();
+			c = get();
 		} else if (str[1] == '/') {
 			 // end tag
 
@@ -305,7 +571,7 @@ int ParseContext::process_next(int c)
 
 			_reader.EndElementHandler();
 
-			c = _reader.get();
+			c = get();
 		} else if (str[1] == '?') {
 			 // XML declaration
 			const XS_String& tag = _buffer.get_tag();
@@ -334,7 +600,7 @@ int ParseContext::process_next(int c)
 						assert(!_reader._format._utf8_bom); // mismatch between BOM and xml header
 				}
 
-				c = _reader.eat_endl();
+				c = eat_endl();
 			} else if (tag == "?xml-stylesheet") {
 				XMLNode::AttributeMap attributes;
 				_buffer.get_attributes(attributes);
@@ -346,75 +612,66 @@ int ParseContext::process_next(int c)
 
 				_reader._format._stylesheets.push_back(stylesheet);
 
-				c = _reader.eat_endl();
+				c = eat_endl();
 			} else {
-				_reader.DefaultHandler(b);
-				c = _reader.get();
+				content_handler(start, _buffer.len());
+				c = get();
 			}
 		} else if (str[1] == '!') {
 			if (!strncmp(str+2, "DOCTYPE ", 8)) {
 				_reader._format._doctype.parse(str+10);
 
-				c = _reader.eat_endl();
+				c = eat_endl();
 			} else if (!strncmp(str+2, "[CDATA[", 7)) {	// see CDATA_START
 				 // parse <![CDATA[ ... ]]> strings
-				while(!_buffer.has_CDEnd()) {
-					c = _reader.get();
-
-					if (c == EOF)
+				while(!_buffer.has_CDEnd())
+					if (!read_until('>'))
 						break;
 
-					_buffer.append(c);
-				}
-
-				_reader.DefaultHandler(_buffer.str(_utf8));
+				content_handler(start, _buffer.len());
 
-				c = _reader.get();
+				c = get();
 			}
 		} else {
 			 // start tag
 			const XS_String& tag = _buffer.get_tag();
 
 			if (!tag.empty()) {
-				XMLNode::AttributeMap attributes;
-				_buffer.get_attributes(attributes);
+				if (_reader.SkipElementHandler(tag)) {
+					if (str[b.length()-2] != '/')
+						skip_element();
+				} else {
+					XMLNode::AttributeMap attributes;
+					_buffer.get_lazy_attributes(attributes, ref_input()? start: NULL);
 
-				_reader.StartElementHandler(tag, attributes);
+					_reader.StartElementHandler(tag, attributes);
 
-				if (str[b.length()-2] == '/')
-					_reader.EndElementHandler();
+					if (str[b.length()-2] == '/')
+						_reader.EndElementHandler();
+				}
 			}
 
-			c = _reader.get();
+			c = get();
 		}
+	} else if (_reader.SkipTextHandler()) {
+		c = skip_until('<')? '<': EOF;
 	} else { // in_comment || c=='<'
-		_buffer.append(c);
-
-		 // read white space
-		for(;;) {
-			 // check for the encoding of the first line end
-			if (!_reader._endl_defined) {
-				if (c == '\n') {
-					_reader._format._endl = "\n";
-					_reader._endl_defined = true;
-				} else if (c == '\r') {
-					_reader._format._endl = "\r\n";
-					_reader._endl_defined = true;
-				}
-			}
+		bool ref = ref_input();
 
-			c = _reader.get();
+		if (!ref)
+			_buffer.append(c);
 
-			if (c == EOF)
-				break;
+		 // check for the encoding of the first line end
+		char ch = static_cast<char>(c);
+		check_endl(&ch, 1);
 
-			if (c == '<')
-				break;
+		 // read text and white space up to the next tag
+		c = read_text(!ref);
 
-			_buffer.append(c);
-		}
-
-		_reader.DefaultHandler(_buffer.str(_utf8));
+		if (ref)
+			_reader.MappedDefaultHandler(start, (c=='<'? _rptr-1: _rptr) - start);
+		else
+			_reader.DefaultHandler(_buffer.str(_utf8));
 	}
 
 	_buffer.reset();
@@ -433,6 +690,29 @@ bool XMLReaderBase::parse()
 	return true; //TODO return false on invalid XML
 }
 
+ /// update the line and column counters for a block of input characters
+void XMLReaderBase::count_location(const char* s, size_t l)
+{
+	const char* end = s + l;
+
+	while(s < end) {
+		const char* p = s;
+
+		while(p<end && *p!='\n' && *p!='\r')
+			++p;
+
+		if (p > s) {
+			_location._column += (int)(p - s);
+			_last_crlf = 0;
+		}
+
+		if (p < end)
+			count_location(*p++);
+
+		s = p;
+	}
+}
+
 int XMLReaderBase::eat_endl()
 {
 	int c = get();
@@ -453,6 +733,359 @@ void XMLReaderBase::DefaultHandler(const std::string& s)
 	_content.append(s);
 }
 
+ /// store content, white space and comments referencing the mapped input
+void XMLReaderBase::MappedDefaultHandler(const char* s, size_t l)
+{
+	_content.append_ref(s, l);
+}
+
+
+ /// NameChar test of ReadBuffer::get_tag() for the first character of a tag name
+static bool is_tag_start(char c)
+{
+	return isalnum((unsigned char)c) || c=='.' || c=='-' || c=='_' || c==':' || c=='\xC3';
+}
+
+ /// find the end of markup as process_next() splits the input
+const char* find_markup_end(const char* s, const char* end)
+{
+	const char* q;
+
+	if (*s=='!' && end-s>=3 && s[1]=='-' && s[2]=='-') {
+		 // comment ending at the first closing bracket after "--"
+		for(q=s; (q=find_xml_char(q, end, '>'))!=end; ++q)
+			if (q-s>=3 && q[-1]=='-' && q[-2]=='-')
+				break;
+	} else if (*s=='!' && end-s>=8 && !memcmp(s, "![CDATA[", 8)) {
+		for(q=s; (q=find_xml_char(q, end, '>'))!=end; ++q)
+			if (q-s>=10 && q[-1]==']' && q[-2]==']')
+				break;
+	} else
+		q = find_xml_char(s, end, '>');
+
+	return q;
+}
+
+ /// pre-scan the start tag positions of the root children using the same tag boundaries as process_next()
+ // Return false for input which can't be split safely.
+static bool scan_root_children(const char* p, const char* end, std::vector<const char*>& children, const char*& root_end)
+{
+	int depth = 0;
+
+	root_end = NULL;
+
+	while((p=find_xml_char(p, end, '<')) != end) {
+		const char* s = p + 1;
+		const char* q;
+
+		if (s == end)
+			return false;
+
+		q = find_markup_end(s, end);
+
+		if ((end-s>=3 && !memcmp(s, "!--", 3)) || (end-s>=8 && !memcmp(s, "![CDATA[", 8))) {
+			 // comment or CDATA section, which may contain markup characters
+		} else {
+			if (*s == '/') {
+				if (--depth < 0)
+					return false;
+
+				if (!depth) {
+					if (root_end)
+						return false;	// more than one root element
+
+					root_end = p;
+				}
+			} else if (*s=='!' || *s=='?') {
+				 // The parser eats the line end following XML and DOCTYPE declarations,
+				 // so split only documents declaring them before the root element.
+				if (depth && (!strncmp(s, "!DOCTYPE", 8) || !strncmp(s, "?xml", 4)))
+					return false;
+
+				 // DOCTYPE internal subset
+				if (*s=='!' && find_xml_char(s, q, '[')!=q)
+					return false;
+			} else if (is_tag_start(*s)) {
+				if (root_end)
+					return false;
+
+				if (depth == 1)
+					children.push_back(p);
+
+				if (q!=end && q[-1]!='/')
+					++depth;
+			}
+		}
+
+		if (q == end)
+			return false;
+
+		p = q + 1;
+	}
+
+	return root_end != NULL;
+}
+
+ /// move a chunk boundary before the white space preceding a tag, which then becomes leading white space of the node
+static const char* skip_space_back(const char* p, const char* begin)
+{
+	while(p>begin && isspace((unsigned char)p[-1]))
+		--p;
+
+	return p;
+}
+
+
+ /// part of a document parsed on a worker thread of XMLDoc::read_file_parallel()
+struct XMLParallelChunk
+{
+	XMLParallelChunk()
+	 :	_node(NULL),
+		_endl(NULL)
+	{
+	}
+
+	const char*	_begin;
+	const char*	_end;
+	XMLNode*	_node;	// temporary parent of the parsed nodes
+	XMLErrorList _errors;
+	const char*	_endl;	// line end detected in the chunk
+};
+
+ /// chunk list shared by the worker threads
+struct XMLParallelRead
+{
+	XMLParallelRead(XMLArena* arena, bool utf8, const char* display_path)
+	 :	_next(0),
+		_arena(arena),
+		_utf8(utf8),
+		_display_path(display_path)
+	{
+	}
+
+	std::vector<XMLParallelChunk> _chunks;
+
+#ifdef _WIN32
+	volatile LONG _next;
+#else
+	volatile long _next;
+#endif
+
+	XMLArena*	_arena;		// identifies the document, the nodes of the worker threads are allocated on the heap
+	bool		_utf8;
+	const char*	_display_path;
+
+	 /// parse chunks until all are taken
+	void run()
+	{
+		for(;;) {
+#ifdef _WIN32
+			size_t i = InterlockedIncrement(&_next) - 1;
+#else
+			size_t i = __sync_fetch_and_add(&_next, 1);
+#endif
+
+			if (i >= _chunks.size())
+				break;
+
+			XMLParallelChunk& chunk = _chunks[i];
+
+			XMLChunkReader reader(chunk._node, chunk._begin, chunk._end-chunk._begin, _utf8);
+
+			reader.setSystemId(_display_path);
+			reader._arena = _arena;
+			reader.read();
+
+			chunk._errors = reader.get_errors();
+
+			if (reader.endl_defined())
+				chunk._endl = reader.get_endl();
+		}
+	}
+};
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_read_thread(LPVOID param)
+{
+	((XMLParallelRead*)param)->run();
+
+	return 0;
+}
+#else
+static void* parallel_read_thread(void* param)
+{
+	((XMLParallelRead*)param)->run();
+
+	return NULL;
+}
+#endif
+
+static int get_processor_count()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n>0? (int)n: 1;
+#endif
+}
+
+bool XMLDoc::read_file_parallel(LPCTSTR path, int threads)
+{
+	XMLFileMapping* mapping = new XMLFileMapping;
+
+	if (!mapping->open(path)) {
+		delete mapping;
+		return false;
+	}
+
+#if defined(_STRING_DEFINED) && !defined(XS_STRING_UTF8)
+	std::string display_path = ANS(path);
+#else
+	std::string display_path = XS_String(path);
+#endif
+
+	const char* data = mapping->data();
+	const char* end = data + mapping->length();
+
+	if (threads <= 0)
+		threads = get_processor_count();
+
+	 // Chunk boundaries are placed before child start tags of the root element.
+	 // The first chunk includes the root start tag and at least one child, the last one the root end tag.
+	std::vector<const char*> bounds;
+	std::vector<const char*> children;
+	const char* root_end;
+
+	size_t chunk_size = mapping->length() / (threads*4);
+
+	if (chunk_size < XS_PARALLEL_CHUNK_MIN)
+		chunk_size = XS_PARALLEL_CHUNK_MIN;
+
+	if (threads>1 && get_children().empty() && mapping->length()>=2*chunk_size &&
+		scan_root_children(data, end, children, root_end)) {
+		const char* last = data;
+
+		for(size_t i=1; i<children.size(); ++i)
+			if ((size_t)(children[i]-last) >= chunk_size) {
+				last = skip_space_back(children[i], last);
+				bounds.push_back(last);
+			}
+
+		if (!bounds.empty())
+			bounds.push_back(skip_space_back(root_end, last));
+	}
+
+	if (bounds.empty()) {
+		XMLMappedReader reader(this, data, end-data);
+
+		bool ret = read(reader, display_path);
+
+		_mappings.push_back(mapping);	// after read(), which releases the mappings of previous reads
+
+		return ret;
+	}
+
+	 // parse the root start tag and the first children to detect the format and encoding
+	XMLChunkReader first(this, data, bounds.front()-data, false);
+
+	bool ok = read(first, display_path);
+
+	_mappings.push_back(mapping);
+
+	if (!ok)
+		return false;
+
+	XMLNode* root = get_children().back();
+
+	XMLParallelRead parallel(&_doc_arena, first.is_utf8(), display_path.c_str());
+
+	parallel._chunks.resize(bounds.size() - 1);
+
+	for(size_t i=0; i<parallel._chunks.size(); ++i) {
+		XMLParallelChunk& chunk = parallel._chunks[i];
+
+		chunk._begin = bounds[i];
+		chunk._end = bounds[i+1];
+		chunk._node = XMLNode::create(XS_String(), &_doc_arena, false);
+	}
+
+	if (threads > (int)parallel._chunks.size())
+		threads = (int)parallel._chunks.size();
+
+	 // the current thread parses chunks together with threads-1 worker threads
+#ifdef _WIN32
+	std::vector<HANDLE> workers;
+
+	for(int i=1; i<threads; ++i) {
+		HANDLE hThread = CreateThread(NULL, 0, parallel_read_thread, &parallel, 0, NULL);
+
+		if (hThread)
+			workers.push_back(hThread);
+	}
+
+	parallel.run();
+
+	for(size_t i=0; i<workers.size(); ++i) {
+		WaitForSingleObject(workers[i], INFINITE);
+		CloseHandle(workers[i]);
+	}
+#else
+	std::vector<pthread_t> workers;
+
+	for(int i=1; i<threads; ++i) {
+		pthread_t thread;
+
+		if (!pthread_create(&thread, NULL, parallel_read_thread, &parallel))
+			workers.push_back(thread);
+	}
+
+	parallel.run();
+
+	for(size_t i=0; i<workers.size(); ++i)
+		pthread_join(workers[i], NULL);
+#endif
+
+	 // splice the parsed nodes in document order
+	const char* endl = first.endl_defined()? first.get_endl(): NULL;
+
+	for(size_t i=0; i<parallel._chunks.size(); ++i) {
+		XMLParallelChunk& chunk = parallel._chunks[i];
+
+		root->move_children(*chunk._node);
+		delete chunk._node;
+
+		_errors.insert(_errors.end(), chunk._errors.begin(), chunk._errors.end());
+
+		if (!endl)
+			endl = chunk._endl;
+	}
+
+	 // parse the root end tag and the following white space into the document
+	XMLChunkReader last(this, bounds.back(), end-bounds.back(), first.is_utf8(), true);
+
+	last.setSystemId(display_path.c_str());
+	last._atoms = _atoms.get();
+	last._arena = &_doc_arena;
+	last._use_arena = _use_arena;
+
+	last.read();
+
+	_errors.insert(_errors.end(), last.get_errors().begin(), last.get_errors().end());
+
+	if (!endl && last.endl_defined())
+		endl = last.get_endl();
+
+	if (endl)
+		_format._endl = endl;
+
+	return _errors.empty();
+}
+
 
 } // namespace XMLStorage
 